@@ -0,0 +1,165 @@
+/**
+ * Copyright (C) 2020 NEC Corporation
+ * This file is part of the VEOS information library.
+ *
+ * The VEOS information library is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either version
+ * 2.1 of the License, or (at your option) any later version.
+ *
+ * The VEOS information library is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with the VEOS information library; if not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+/**
+ * @file ve_exporter.c
+ * @brief Daemon serving the metrics of VE nodes as OpenMetrics text
+ *
+ * @internal
+ * @author RPM command
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <getopt.h>
+#include "veosinfo.h"
+
+#define VE_EXPORTER_DEF_PORT	9856	/*!< Default loopback TCP port */
+
+/**
+ * @brief This function prints the usage of the daemon
+ */
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"Usage: %s [options]\n"
+		"  -s, --socket=PATH     serve on Unix socket PATH\n"
+		"  -p, --port=PORT       serve on 127.0.0.1:PORT (default %d)\n"
+		"  -i, --interval=MS     refresh every MS milliseconds "
+		"(default %d)\n"
+		"  -N, --max-nodes=N     export at most N VE nodes\n"
+		"  -c, --max-cores=N     export per core series of at most N "
+		"cores\n"
+		"  -S, --max-sensors=N   export at most N series per kind of "
+		"sensor\n"
+		"  -t, --top=N           export N (> 0) processes per node, "
+		"-1 for none (default %d)\n"
+		"  -h, --help            print this help\n",
+		prog, VE_EXPORTER_DEF_PORT, VE_EXPORT_DEF_INTERVAL,
+		VE_EXPORT_DEF_TOP);
+}
+
+/**
+ * @brief This function parses a non-negative option value
+ *
+ * @return 0 on success and -1 on failure
+ */
+static int parse_int(const char *arg, int min, int *val)
+{
+	char *end = NULL;
+	long v = 0;
+
+	errno = 0;
+	v = strtol(arg, &end, 10);
+	if (errno || end == arg || *end || v < min || v > 0x7fffffff)
+		return -1;
+	*val = (int)v;
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	static const struct option longopts[] = {
+		{"socket", required_argument, NULL, 's'},
+		{"port", required_argument, NULL, 'p'},
+		{"interval", required_argument, NULL, 'i'},
+		{"max-nodes", required_argument, NULL, 'N'},
+		{"max-cores", required_argument, NULL, 'c'},
+		{"max-sensors", required_argument, NULL, 'S'},
+		{"top", required_argument, NULL, 't'},
+		{"help", no_argument, NULL, 'h'},
+		{NULL, 0, NULL, 0}
+	};
+	struct ve_export_attr attr = {0};
+	struct ve_export *exp = NULL;
+	sigset_t set;
+	int opt = 0;
+	int sig = 0;
+	int ret = 0;
+
+	attr.port = VE_EXPORTER_DEF_PORT;
+	while (-1 != (opt = getopt_long(argc, argv, "s:p:i:N:c:S:t:h",
+						longopts, NULL))) {
+		switch (opt) {
+		case 's':
+			attr.path = optarg;
+			break;
+		case 'p':
+			ret = parse_int(optarg, 1, &attr.port);
+			break;
+		case 'i':
+			ret = parse_int(optarg, 1, &attr.interval);
+			break;
+		case 'N':
+			ret = parse_int(optarg, 0, &attr.max_nodes);
+			break;
+		case 'c':
+			ret = parse_int(optarg, 0, &attr.max_cores);
+			break;
+		case 'S':
+			ret = parse_int(optarg, 0, &attr.max_sensors);
+			break;
+		case 't':
+			/* 0 would silently mean the default in the library */
+			ret = parse_int(optarg, -1, &attr.top);
+			if (!ret && !attr.top)
+				ret = -1;
+			break;
+		case 'h':
+			usage(argv[0]);
+			return 0;
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+		if (ret) {
+			fprintf(stderr, "%s: invalid value of -%c: %s\n",
+				argv[0], opt, optarg);
+			return 1;
+		}
+	}
+	if (optind < argc) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	/* Block the signals before the threads start so that only sigwait()
+	 * gets them */
+	sigemptyset(&set);
+	sigaddset(&set, SIGINT);
+	sigaddset(&set, SIGTERM);
+	sigaddset(&set, SIGHUP);
+	pthread_sigmask(SIG_BLOCK, &set, NULL);
+	signal(SIGPIPE, SIG_IGN);
+
+	exp = ve_export_start(&attr);
+	if (!exp) {
+		fprintf(stderr, "%s: failed to start exporter: %s\n", argv[0],
+			strerror(errno));
+		return 1;
+	}
+	while (!sigwait(&set, &sig) && SIGHUP == sig)
+		;
+	ve_export_stop(exp);
+	return 0;
+}
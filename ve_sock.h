@@ -71,6 +71,18 @@ enum velib_cmdreq {
         VE_VEOSCTL_GET_PARAM,
         VE_VEOSCTL_SET_PARAM,
 	VE_SWAP_OUT_F,
+	VE_PROC_DELTA,
+	VE_THREAD_INFO,
+	VE_GET_REGVALS_BATCH,
+	VE_VMSTAT_INFO,
+	VE_SWAP_STATUSINFO_VL,
+	VE_SWAP_INFO_VL,
+	VE_SWAP_OUT_VL,
+	VE_SWAP_IN_VL,
+	VE_CREATE_PROCESS_BATCH,
+	VE_GET_AFFINITY_BATCH,
+	VE_SET_AFFINITY_BATCH,
+	VE_PRLIMIT_BATCH,
 	VE_RPM_INVALID = -1
 };
 
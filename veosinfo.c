@@ -35,10 +35,12 @@
 #include <unistd.h>
 #include <ctype.h>
 #include <stdint.h>
+#include <stddef.h>
 #include <sys/types.h>
 #include <libudev.h>
 #include <elf.h>
-#include <getopt.h>
+#include <time.h>
+#include <pthread.h>
 #include <sys/time.h>
 #include <sys/resource.h>
 #include <sys/stat.h>
@@ -50,6 +52,26 @@
 #include "veosinfo_comm.h"
 #include <productinfo.h>
 
+static int ve_message_send_receive(int, int, void *, size_t, void *, size_t);
+
+/**
+ * @brief Boot instant of VE node cached against CLOCK_MONOTONIC
+ *
+ *	  The entry is valid as long as the VEOS socket is the same file,
+ *	  a restart of VEOS creates a new one.
+ */
+struct ve_boot_cache {
+	bool valid;		/*!< Entry has been filled */
+	dev_t dev;		/*!< Device of VEOS socket */
+	ino_t ino;		/*!< Inode of VEOS socket */
+	struct timespec ctim;	/*!< Change time of VEOS socket */
+	struct timespec boot;	/*!< Boot instant on CLOCK_MONOTONIC */
+	unsigned long btime;	/*!< Boot time since the epoch */
+};
+
+static struct ve_boot_cache ve_boot_cache[VE_MAX_NODE];
+static pthread_mutex_t ve_boot_lock = PTHREAD_MUTEX_INITIALIZER;
+
 /**
  * @brief This function is used to compare the versions.
  *
@@ -697,107 +719,182 @@ out:
 }
 
 /**
- * @brief Parse VE_LIMIT_OPT and fetch the resource limit
- *
- * @param limit_opt [in] Resource limit passed by user as environment
- * variable in "VE_LIMIT_OPT"
- * @param ve_rlim [out] To set the resource limit
+ * @brief Options of VE_LIMIT_OPT
  *
- * @return 0 on success and negative value on failure.
+ *	  A long option sets the hard or the soft limit of a resource,
+ *	  a short option sets both.
  */
+static const struct {
+	const char *name;	/*!< Long option */
+	int opt;		/*!< As per "enum ve_rlim", 0 for a short option */
+	char letter;		/*!< Short option */
+	int resource;		/*!< Resource limited */
+	bool hard;		/*!< Sets the hard limit */
+} ve_limit_opts[] = {
+	{ "hardc", HARDC, 'c', RLIMIT_CORE, true },
+	{ "softc", SOFTC, 'c', RLIMIT_CORE, false },
+	{ "hardd", HARDD, 'd', RLIMIT_DATA, true },
+	{ "softd", SOFTD, 'd', RLIMIT_DATA, false },
+	{ "hardi", HARDI, 'i', RLIMIT_SIGPENDING, true },
+	{ "softi", SOFTI, 'i', RLIMIT_SIGPENDING, false },
+	{ "hardm", HARDM, 'm', RLIMIT_RSS, true },
+	{ "softm", SOFTM, 'm', RLIMIT_RSS, false },
+	{ "hards", HARDS, 's', RLIMIT_STACK, true },
+	{ "softs", SOFTS, 's', RLIMIT_STACK, false },
+	{ "hardt", HARDT, 't', RLIMIT_CPU, true },
+	{ "softt", SOFTT, 't', RLIMIT_CPU, false },
+	{ "hardv", HARDV, 'v', RLIMIT_AS, true },
+	{ "softv", SOFTV, 'v', RLIMIT_AS, false },
+};
+
+#define VE_LIMIT_NOPTS	(sizeof(ve_limit_opts) / sizeof(ve_limit_opts[0]))
 
-int get_ve_limit_opt(char *limit_opt, struct rlimit *ve_rlim)
-{
-	int arg_c = 0;
-	int opt = 0, limit = 0;
-	int len_optind_arg = 0, len_optarg = 0;
-	int retval = VE_EINVAL_LIMITOPT;
-	bool repeat_lim[VE_RLIM_CNT] = {0};
-	unsigned long long lim_val = 0;
-	char *arg_v[VE_BUF_LEN] = {0};
-	char *token = NULL;
+/**
+ * @brief Table parsed from VE_LIMIT_OPT, published by
+ *	  ve_limit_opt_get() and never modified afterwards
+ */
+static struct ve_limit_opt *ve_limit_opt_cache;
 
-	static const struct option longopts[] = {
-		{ "hardc",        required_argument, NULL, 1 },
-		{ "softc",     required_argument, NULL, 2 },
-		{ "hardd",      required_argument, NULL, 3 },
-		{ "softd",       required_argument, NULL, 4 },
-		{ "hardi",        required_argument, NULL, 5 },
-		{ "softi",       required_argument, NULL, 6 },
-		{ "hardm",      required_argument, NULL, 7 },
-		{ "softm",      required_argument, NULL, 8 },
-		{ "hards",    required_argument, NULL, 9 },
-		{ "softs",   required_argument, NULL, 10 },
-		{ "hardt",       required_argument, NULL, 11 },
-		{ "softt",     required_argument, NULL, 12 },
-		{ "hardv",      required_argument, NULL, 13 },
-		{ "softv",        required_argument, NULL, 14 },
-		{ NULL, 0, NULL, 0 }
-	};
+/**
+ * @brief Number of tables published or being published, at most
+ *	  VE_LIMIT_OPT_CACHE
+ */
+static int ve_limit_opt_ncache;
 
-	VE_RPMLIB_TRACE("Entering");
-	if (!limit_opt || !ve_rlim) {
-		VE_RPMLIB_ERR("Wrong argument received:limit_opt = %p," \
-				" ve_rlim = %p", limit_opt, ve_rlim);
-		goto out;
+/**
+ * @brief This function sets a limit of the table parsed from VE_LIMIT_OPT,
+ *	  the first value given for a limit is kept
+ *
+ * @param tbl[in/out] Table being parsed
+ * @param indx[in] Index of the option in ve_limit_opts
+ * @param lim_val[in] Value of the limit
+ */
+static void ve_limit_opt_set(struct ve_limit_opt *tbl, int indx,
+				unsigned long long lim_val)
+{
+	int resource = ve_limit_opts[indx].resource;
+
+	if (ve_limit_opts[indx].hard) {
+		if (tbl->max_set[resource])
+			return;
+		tbl->rlim[resource].rlim_max = lim_val;
+		tbl->max_set[resource] = true;
+	} else {
+		if (tbl->cur_set[resource])
+			return;
+		tbl->rlim[resource].rlim_cur = lim_val;
+		tbl->cur_set[resource] = true;
 	}
-	token = strtok(limit_opt, " ");
-	arg_v[arg_c] = strndup("error", strlen("error"));
-	if (!arg_v[arg_c]) {
-		VE_RPMLIB_ERR("Failed to allocate memory");
-		goto out;
+}
+
+/**
+ * @brief This function finds a long option of VE_LIMIT_OPT, which may be
+ *	  abbreviated as long as it stays unambiguous
+ *
+ * @param name[in] Option without the leading "--"
+ *
+ * @return Index in ve_limit_opts on success and -1 on failure
+ */
+static int ve_limit_opt_find(const char *name)
+{
+	size_t len = strlen(name);
+	int found = -1;
+	int indx = 0;
+
+	if (!len)
+		return -1;
+	for (indx = 0; indx < VE_LIMIT_NOPTS; indx++) {
+		if (strncmp(name, ve_limit_opts[indx].name, len))
+			continue;
+		if (!ve_limit_opts[indx].name[len])
+			return indx;
+		if (0 <= found)
+			return -1;
+		found = indx;
 	}
-	arg_c++;
+	return found;
+}
 
-	/* Tokenize the value of VE_LIMIT_OPT environment variable */
-	while (token != NULL) {
-		arg_v[arg_c] = strndup(token, strlen(token));
-		if (!arg_v[arg_c]) {
-			VE_RPMLIB_ERR("Failed to allocate memory");
-			goto out;
+/**
+ * @brief This function parses VE_LIMIT_OPT into a table of limits
+ *
+ *	  The syntax is the one getopt_long() accepted with "+:c:d:i:m:s:t:v:"
+ *	  and the long options of ve_limit_opts, but the parser keeps no
+ *	  global state, so threads may parse at the same time.
+ *
+ * @param limit_opt[in/out] Value of VE_LIMIT_OPT, tokenized in place
+ * @param tbl[out] Limits given, zero-initialized by the caller
+ *
+ * @return 0 on success and negative value on failure.
+ */
+static int ve_limit_opt_parse(char *limit_opt, struct ve_limit_opt *tbl)
+{
+	char *save = NULL;
+	char *token = NULL;
+	char *name = NULL;
+	char *value = NULL;
+	char letter = 0;
+	int retval = VE_EINVAL_LIMITOPT;
+	int indx = 0;
+	int opt = 0;
+	unsigned long long lim_val = 0;
+
+	for (token = strtok_r(limit_opt, " ", &save); token;
+			token = strtok_r(NULL, " ", &save)) {
+		if (!strcmp(token, "--")) {
+			token = strtok_r(NULL, " ", &save);
+			break;
 		}
-		token = strtok(NULL, " ");
-		arg_c++;
-	}
-	arg_v[arg_c] = '\0';
-	optind = 1;
-	/* Check the option specified with VE_LIMIT_OPT */
-	while ((opt = getopt_long(arg_c, arg_v, "+:c:d:i:m:s:t:v:",
-					longopts, NULL)) != -1) {
-		/* If valid option is specified and no option
-		 * argument is missing */
-		if (opt != '?' && opt != ':') {
-			lim_val = 0;
-			retval = get_value(optarg, &lim_val);
-			if (0 > retval) {
-				VE_RPMLIB_ERR("Error in value conversion");
-				retval = (VE_EINVAL_LIMITOPT);
+		/* Options end at the first argument which is not one */
+		if ('-' != token[0] || !token[1])
+			break;
+		value = NULL;
+		letter = 0;
+		opt = 0;
+		if ('-' == token[1]) {
+			name = token + 2;
+			value = strchr(name, '=');
+			if (value)
+				*value++ = '\0';
+			indx = ve_limit_opt_find(name);
+			if (0 > indx) {
+				VE_RPMLIB_ERR("Unrecognized option");
 				goto out_err;
 			}
-			retval = VE_EINVAL_LIMITOPT;
-		}
-		/* Validate the resource limit values*/
-		if (opt == 'c' || opt == 'd' || opt == 'i' ||
-				opt == 'm' || opt == 's' ||
-				opt == 't' || opt == 'v') {
-			len_optind_arg = strlen(arg_v[optind - 1]);
-			len_optarg = strlen(optarg);
-			if (strncmp(arg_v[optind-1], optarg,
-						(len_optind_arg > len_optarg ?
-						len_optind_arg : len_optarg)))
+			opt = ve_limit_opts[indx].opt;
+			letter = ve_limit_opts[indx].letter;
+		} else {
+			letter = token[1];
+			if (!strchr("cdimstv", letter)) {
+				VE_RPMLIB_ERR("Unrecognized option");
+				goto out_err;
+			}
+			/* The value must be a separate argument */
+			if (token[2]) {
+				VE_RPMLIB_ERR("Invalid limit value in optarg: %s",
+						token + 2);
 				goto out_err;
+			}
+		}
+		if (!value)
+			value = strtok_r(NULL, " ", &save);
+		if (!value) {
+			VE_RPMLIB_ERR("Missing option argument");
+			goto out_err;
+		}
+
+		lim_val = 0;
+		if (0 > get_value(value, &lim_val)) {
+			VE_RPMLIB_ERR("Error in value conversion");
+			goto out_err;
 		}
 		/* Validate RLIMIT_CPU resource limit's minimum value*/
-		if ((lim_val == 0) && ((opt == 't') || (opt == SOFTT)))
+		if (!lim_val && ((!opt && 't' == letter) || SOFTT == opt))
 			lim_val = 1;
-		/*Resource limit value should not be greater than
-		* than MAX_RESOURCE_LIMIT for c, d, m, s and
-		* v resources */
-		if (opt != HARDI && opt != SOFTI &&
-			opt != HARDT && opt != SOFTT &&
-			opt != 'i' && opt != 't' &&
-			optarg != NULL &&
-			strncmp(optarg, "unlimited", sizeof("unlimited"))) {
+		/* Resource limit value should not be greater than
+		 * MAX_RESOURCE_LIMIT for c, d, m, s and v resources */
+		if ('i' != letter && 't' != letter &&
+				strncmp(value, "unlimited", sizeof("unlimited"))) {
 			if (lim_val > MAX_RESOURCE_LIMIT) {
 				VE_RPMLIB_DEBUG("Resource limit out of range");
 				retval = VE_ERANGE_LIMITOPT;
@@ -805,141 +902,41 @@ int get_ve_limit_opt(char *limit_opt, struct rlimit *ve_rlim)
 			}
 			lim_val = lim_val * KB;
 		}
-		/* Only consider the first value if the same resource limit
-		 * mentioned repeatedly */
-		if (opt < VE_RLIM_CNT) {
-			if (!repeat_lim[opt])
-				repeat_lim[opt] = 1;
-			else
-				continue;
-		}
-		switch (opt) {
-		case 1:
-			ve_rlim[RLIMIT_CORE].rlim_max = lim_val;
-			break;
-		case 2:
-			ve_rlim[RLIMIT_CORE].rlim_cur = lim_val;
-			break;
-		case 3:
-			ve_rlim[RLIMIT_DATA].rlim_max = lim_val;
-			break;
-		case 4:
-			ve_rlim[RLIMIT_DATA].rlim_cur = lim_val;
-			break;
-		case 5:
-			ve_rlim[RLIMIT_SIGPENDING].rlim_max = lim_val;
-			break;
-		case 6:
-			ve_rlim[RLIMIT_SIGPENDING].rlim_cur = lim_val;
-			break;
-		case 7:
-			ve_rlim[RLIMIT_RSS].rlim_max = lim_val;
-			break;
-		case 8:
-			ve_rlim[RLIMIT_RSS].rlim_cur = lim_val;
-			break;
-		case 9:
-			ve_rlim[RLIMIT_STACK].rlim_max = lim_val;
-			break;
-		case 10:
-			ve_rlim[RLIMIT_STACK].rlim_cur = lim_val;
-			break;
-		case 11:
-			ve_rlim[RLIMIT_CPU].rlim_max = lim_val;
-			break;
-		case 12:
-			ve_rlim[RLIMIT_CPU].rlim_cur = lim_val;
-			break;
-		case 13:
-			ve_rlim[RLIMIT_AS].rlim_max = lim_val;
-			break;
-		case 14:
-			ve_rlim[RLIMIT_AS].rlim_cur = lim_val;
-			break;
-		case 'c':
-			if (!repeat_lim[SOFTC]) {
-				ve_rlim[RLIMIT_CORE].rlim_cur = lim_val;
-				repeat_lim[SOFTC] = 1;
-			}
-			if (!repeat_lim[HARDC]) {
-				ve_rlim[RLIMIT_CORE].rlim_max = lim_val;
-				repeat_lim[HARDC] = 1;
-			}
-			break;
-		case 'd':
-			if (!repeat_lim[SOFTD]) {
-				ve_rlim[RLIMIT_DATA].rlim_cur = lim_val;
-				repeat_lim[SOFTD] = 1;
-			}
-			if (!repeat_lim[HARDD]) {
-				ve_rlim[RLIMIT_DATA].rlim_max = lim_val;
-				repeat_lim[HARDD] = 1;
-			}
-			break;
-		case 'i':
-			if (!repeat_lim[SOFTI]) {
-				ve_rlim[RLIMIT_SIGPENDING].rlim_cur = lim_val;
-				repeat_lim[SOFTI] = 1;
-			}
-			if (!repeat_lim[HARDI]) {
-				ve_rlim[RLIMIT_SIGPENDING].rlim_max = lim_val;
-				repeat_lim[HARDI] = 1;
-			}
-			break;
-		case 'm':
-			if (!repeat_lim[SOFTM]) {
-				ve_rlim[RLIMIT_RSS].rlim_cur = lim_val;
-				repeat_lim[SOFTM] = 1;
-			}
-			if (!repeat_lim[HARDM]) {
-				ve_rlim[RLIMIT_RSS].rlim_max = lim_val;
-				repeat_lim[HARDM] = 1;
-			}
-			break;
-		case 's':
-			if (!repeat_lim[SOFTS]) {
-				ve_rlim[RLIMIT_STACK].rlim_cur = lim_val;
-				repeat_lim[SOFTS] = 1;
-			}
-			if (!repeat_lim[HARDS]) {
-				ve_rlim[RLIMIT_STACK].rlim_max = lim_val;
-				repeat_lim[HARDS] = 1;
-			}
-			break;
-		case 't':
-			if (!repeat_lim[SOFTT]) {
-				ve_rlim[RLIMIT_CPU].rlim_cur = lim_val;
-				repeat_lim[SOFTT] = 1;
-			}
-			if (!repeat_lim[HARDT]) {
-				ve_rlim[RLIMIT_CPU].rlim_max = lim_val;
-				repeat_lim[HARDT] = 1;
-			}
-			break;
-		case 'v':
-			if (!repeat_lim[SOFTV]) {
-				ve_rlim[RLIMIT_AS].rlim_cur = lim_val;
-				repeat_lim[SOFTV] = 1;
-			}
-			if (!repeat_lim[HARDV]) {
-				ve_rlim[RLIMIT_AS].rlim_max = lim_val;
-				repeat_lim[HARDV] = 1;
-			}
-			break;
-		case '?':
-			VE_RPMLIB_ERR("Unrecognized option");
-			goto out_err;
-		case ':':
-			VE_RPMLIB_ERR("Missing option argument");
-			goto out_err;
-		}
+		for (indx = 0; indx < VE_LIMIT_NOPTS; indx++)
+			if (opt ? opt == ve_limit_opts[indx].opt :
+					letter == ve_limit_opts[indx].letter)
+				ve_limit_opt_set(tbl, indx, lim_val);
 	}
 	/* For error checking, if any value is specified without any option */
-	if (arg_v[optind]) {
-		VE_RPMLIB_ERR("Invalid Value: %s", arg_v[optind]);
-		retval = VE_EINVAL_LIMITOPT;
+	if (token) {
+		VE_RPMLIB_ERR("Invalid Value: %s", token);
 		goto out_err;
 	}
+	return 0;
+out_err:
+	VE_RPMLIB_ERR("Invalid input in VE_LIMIT_OPT");
+	return retval;
+}
+
+/**
+ * @brief This function applies the limits parsed from VE_LIMIT_OPT
+ *
+ * @param tbl[in] Limits parsed from VE_LIMIT_OPT
+ * @param ve_rlim[in/out] Resource limits to update
+ *
+ * @return 0 on success and negative value on failure.
+ */
+static int ve_limit_opt_apply(const struct ve_limit_opt *tbl,
+				struct rlimit *ve_rlim)
+{
+	int limit = 0;
+
+	for (limit = 0; limit < RLIM_NLIMITS; limit++) {
+		if (tbl->cur_set[limit])
+			ve_rlim[limit].rlim_cur = tbl->rlim[limit].rlim_cur;
+		if (tbl->max_set[limit])
+			ve_rlim[limit].rlim_max = tbl->rlim[limit].rlim_max;
+	}
 	/* To validate that hard limit should be greater than its soft limit */
 	for (limit = 0; limit < RLIM_NLIMITS; limit++) {
 		if (ve_rlim[limit].rlim_cur > ve_rlim[limit].rlim_max) {
@@ -947,22 +944,116 @@ int get_ve_limit_opt(char *limit_opt, struct rlimit *ve_rlim)
 					" %llu", limit, ve_rlim[limit].rlim_cur,
 					ve_rlim[limit].rlim_max);
 			VE_RPMLIB_ERR("Soft limit is greater than hard limit");
-			goto out_err;
+			VE_RPMLIB_ERR("Invalid input in VE_LIMIT_OPT");
+			return VE_EINVAL_LIMITOPT;
 		}
 		VE_RPMLIB_DEBUG("limit: %d, soft lim: %llu, hard lim: %llu",
 				limit, ve_rlim[limit].rlim_cur,
 				ve_rlim[limit].rlim_max);
 	}
-	retval = 0;
-	goto out;
-out_err:
-	VE_RPMLIB_ERR("Invalid input in VE_LIMIT_OPT");
-out:
-	arg_c--;
-	while (arg_c >= 0) {
-		free(arg_v[arg_c]);
-		arg_c--;
+	return 0;
+}
+
+/**
+ * @brief This function gets the table parsed from the current value of
+ *	  VE_LIMIT_OPT
+ *
+ *	  The value is parsed only when no published table has it. A new
+ *	  table is published with compare-and-swap, so readers never lock.
+ *	  Superseded tables stay allocated, as a reader may still use them,
+ *	  and a value seen again reuses its table. Once VE_LIMIT_OPT_CACHE
+ *	  values are published, further values are parsed into 'local' on
+ *	  every call instead.
+ *
+ * @param limit_opt[in] Value of VE_LIMIT_OPT
+ * @param local[out] Table to parse into when no more can be published
+ *
+ * @return Table on success and NULL on failure
+ */
+static const struct ve_limit_opt *ve_limit_opt_get(const char *limit_opt,
+						struct ve_limit_opt *local)
+{
+	struct ve_limit_opt *cur = NULL;
+	struct ve_limit_opt *tbl = NULL;
+	char *copy = NULL;
+
+	cur = __atomic_load_n(&ve_limit_opt_cache, __ATOMIC_ACQUIRE);
+	for (tbl = cur; tbl; tbl = tbl->next)
+		if (!strcmp(tbl->env, limit_opt))
+			return tbl;
+
+	copy = strdup(limit_opt);
+	if (!copy) {
+		VE_RPMLIB_ERR("Memory allocation failed: %s",
+				strerror(errno));
+		return NULL;
+	}
+	/* Reserve a place in the cache, else parse for this call only */
+	if (VE_LIMIT_OPT_CACHE <= __atomic_fetch_add(&ve_limit_opt_ncache,
+						1, __ATOMIC_RELAXED)) {
+		__atomic_fetch_sub(&ve_limit_opt_ncache, 1, __ATOMIC_RELAXED);
+		memset(local, '\0', sizeof(struct ve_limit_opt));
+		local->retval = ve_limit_opt_parse(copy, local);
+		free(copy);
+		return local;
+	}
+	tbl = calloc(1, sizeof(struct ve_limit_opt));
+	if (tbl)
+		tbl->env = strdup(limit_opt);
+	if (!tbl || !tbl->env) {
+		VE_RPMLIB_ERR("Memory allocation failed: %s",
+				strerror(errno));
+		__atomic_fetch_sub(&ve_limit_opt_ncache, 1, __ATOMIC_RELAXED);
+		free(tbl);
+		free(copy);
+		return NULL;
+	}
+	tbl->retval = ve_limit_opt_parse(copy, tbl);
+	free(copy);
+
+	tbl->next = cur;
+	while (!__atomic_compare_exchange_n(&ve_limit_opt_cache, &tbl->next,
+				tbl, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+		/* Another thread published first, maybe the same value */
+		if (!strcmp(tbl->next->env, limit_opt)) {
+			cur = tbl->next;
+			__atomic_fetch_sub(&ve_limit_opt_ncache, 1,
+					__ATOMIC_RELAXED);
+			free(tbl->env);
+			free(tbl);
+			return cur;
+		}
+	}
+	VE_RPMLIB_DEBUG("Parsed VE_LIMIT_OPT: %d", tbl->retval);
+	return tbl;
+}
+
+/**
+ * @brief Parse VE_LIMIT_OPT and fetch the resource limit
+ *
+ * @param limit_opt [in] Resource limit passed by user as environment
+ * variable in "VE_LIMIT_OPT"
+ * @param ve_rlim [out] To set the resource limit
+ *
+ * @return 0 on success and negative value on failure.
+ */
+
+int get_ve_limit_opt(char *limit_opt, struct rlimit *ve_rlim)
+{
+	int retval = VE_EINVAL_LIMITOPT;
+	struct ve_limit_opt tbl = {0};
+
+	VE_RPMLIB_TRACE("Entering");
+	if (!limit_opt || !ve_rlim) {
+		VE_RPMLIB_ERR("Wrong argument received:limit_opt = %p," \
+				" ve_rlim = %p", limit_opt, ve_rlim);
+		goto out;
 	}
+	retval = ve_limit_opt_parse(limit_opt, &tbl);
+	if (0 > retval)
+		goto out;
+	retval = ve_limit_opt_apply(&tbl, ve_rlim);
+out:
 	VE_RPMLIB_TRACE("Exiting");
 	return retval;
 }
@@ -970,6 +1061,8 @@ out:
 /**
  * @brief Fetch the resource limit.
  *
+ *	  VE_LIMIT_OPT is parsed once per value and shared by all threads.
+ *
  * @param ve_rlim[out] resource limit
  *
  * @return 0 on success and negative value on failure.
@@ -978,9 +1071,10 @@ out:
 int get_ve_rlimit(struct rlimit *ve_rlim)
 {
 	int resource = 0;
-	int limit_opt_length = 0;
 	int retval = 0;
 	char *limit_opt = NULL;
+	const struct ve_limit_opt *tbl = NULL;
+	struct ve_limit_opt local;
 	struct rlimit *limit = ve_rlim;
 
 	VE_RPMLIB_TRACE("Entering");
@@ -1010,19 +1104,19 @@ int get_ve_rlimit(struct rlimit *ve_rlim)
 	ve_rlim = limit;
 	/* Check for VE_LIMIT_OPT environment variable */
 	limit_opt = getenv("VE_LIMIT_OPT");
-	if (limit_opt) {
-		limit_opt_length = strlen(limit_opt);
-		/* If VE_LIMIT_OPT=<empty> */
-		if(limit_opt_length) {
-			char tmp[limit_opt_length];
-
-			memcpy(tmp, limit_opt, limit_opt_length);
-			tmp[limit_opt_length] = '\0';
-			retval = get_ve_limit_opt(tmp, ve_rlim);
-			if (retval < 0) {
-				VE_RPMLIB_ERR("VE_LIMIT_OPT parsing failed");
-				goto out;
-			}
+	/* If VE_LIMIT_OPT=<empty> */
+	if (limit_opt && *limit_opt) {
+		tbl = ve_limit_opt_get(limit_opt, &local);
+		if (!tbl) {
+			retval = -errno;
+			goto out;
+		}
+		retval = tbl->retval;
+		if (0 <= retval)
+			retval = ve_limit_opt_apply(tbl, ve_rlim);
+		if (retval < 0) {
+			VE_RPMLIB_ERR("VE_LIMIT_OPT parsing failed");
+			goto out;
 		}
 	}
 out:
@@ -1268,6 +1362,216 @@ hndl_return:
 	return retval;
 }
 
+/**
+ * @brief This function sends one chunk of batched process creation to VEOS
+ *	  and stores the result of each entry of the chunk.
+ *
+ * @param nodeid[in] VE node ID
+ * @param ent[in/out] Entries included in the chunk
+ * @param req[in] Request built for the chunk
+ *
+ * @return 0 on success and negative value on failure
+ */
+static int ve_create_batch_chunk(int nodeid, struct ve_create_req **ent,
+				struct velib_create_process_batch *req)
+{
+	int retval = -1;
+	int indx = 0;
+	struct velib_create_process_batch_res res = {0};
+
+	retval = ve_message_send_receive(nodeid, VE_CREATE_PROCESS_BATCH, req,
+			offsetof(struct velib_create_process_batch, ent) +
+			sizeof(req->ent[0]) * req->nent,
+			&res, sizeof(struct velib_create_process_batch_res));
+	if (0 > retval)
+		return retval;
+	if (res.nent != req->nent) {
+		VE_RPMLIB_ERR("Invalid number of entries: %d (sent %d)",
+				res.nent, req->nent);
+		errno = EPROTO;
+		return -EPROTO;
+	}
+	for (indx = 0; indx < req->nent; indx++)
+		ent[indx]->status = res.retval[indx];
+	return 0;
+}
+
+/**
+ * @brief This function will create several VE processes on given VE node
+ *	  with a VE driver file the caller already holds open.
+ *
+ *	  VEOS records 'fd' as the VE driver file of every created process,
+ *	  so each process must hold the file open at that descriptor: the
+ *	  caller itself, or children forked after 'fd' was opened. The
+ *	  descriptor is not closed here and must stay open for the life of
+ *	  the VE tasks. The parent of each process defaults to the caller,
+ *	  or to the caller's parent for the caller itself.
+ *
+ * @param nodeid[in] Create processes on given node number
+ * @param fd[in] VE driver file of the node, opened with O_RDWR
+ * @param nent[in] Number of entries in 'req'
+ * @param req[in/out] Processes to create, results are returned in the
+ *		      same entries
+ *
+ * @return 0 on success and negative value on failure
+ */
+int ve_create_process_batch_fd(int nodeid, int fd, int nent,
+				struct ve_create_req *req)
+{
+	int retval = -1;
+	int indx = 0;
+	int created = 0;
+	struct ve_create_req *ent[VE_CREATE_BATCH_ENT] = {NULL};
+	struct velib_create_process_batch *breq = NULL;
+
+	VE_RPMLIB_TRACE("Entering");
+	if (!req || nent < 1 || fd < 0) {
+		VE_RPMLIB_ERR("Wrong argument received: req = %p, nent = %d, "
+				"fd = %d", req, nent, fd);
+		errno = EINVAL;
+		retval = -EINVAL;
+		goto hndl_return;
+	}
+	breq = calloc(1, sizeof(struct velib_create_process_batch));
+	if (!breq) {
+		VE_RPMLIB_ERR("Memory allocation failed: %s",
+				strerror(errno));
+		retval = -errno;
+		goto hndl_fail;
+	}
+	memset(breq->ve_rlim, -1, sizeof(breq->ve_rlim));
+	/* To set the resource limit */
+	if (get_ve_rlimit(breq->ve_rlim) < 0) {
+		VE_RPMLIB_ERR("Failed to set resource limit");
+		errno = EINVAL;
+		retval = -EINVAL;
+		goto hndl_fail;
+	}
+	breq->vedl_fd = fd;
+
+	for (indx = 0; indx < nent; indx++) {
+		if (0 > req[indx].pid) {
+			VE_RPMLIB_DEBUG("Skipping invalid entry %d of pid %d",
+					indx, req[indx].pid);
+			req[indx].status = -EINVAL;
+			continue;
+		}
+		/* Flush the chunk if it is full */
+		if (breq->nent == VE_CREATE_BATCH_ENT) {
+			retval = ve_create_batch_chunk(nodeid, ent, breq);
+			if (0 > retval)
+				goto hndl_fail;
+			breq->nent = 0;
+		}
+		ent[breq->nent] = &req[indx];
+		breq->ent[breq->nent].pid = req[indx].pid;
+		if (req[indx].ppid)
+			breq->ent[breq->nent].ppid = req[indx].ppid;
+		else if (req[indx].pid == getpid())
+			breq->ent[breq->nent].ppid = getppid();
+		else
+			breq->ent[breq->nent].ppid = getpid();
+		breq->ent[breq->nent].flag = req[indx].flag;
+		breq->ent[breq->nent].numa_num = req[indx].numa_num;
+		breq->ent[breq->nent].membind_flag = req[indx].membind_flag ?
+						MPOL_DEFAULT : MPOL_BIND;
+		breq->ent[breq->nent].cpu_mask_flag = !!req[indx].set;
+		if (req[indx].set)
+			memcpy(&breq->ent[breq->nent].set, req[indx].set,
+					sizeof(cpu_set_t));
+		else
+			CPU_ZERO(&breq->ent[breq->nent].set);
+		breq->nent++;
+	}
+	retval = 0;
+	if (breq->nent) {
+		retval = ve_create_batch_chunk(nodeid, ent, breq);
+		if (0 > retval)
+			goto hndl_fail;
+	}
+	for (indx = 0; indx < nent; indx++)
+		if (0 <= req[indx].status)
+			created++;
+	VE_RPMLIB_DEBUG("Created %d of %d processes", created, nent);
+	goto hndl_free;
+
+hndl_fail:
+	/* Entries of the failed chunk and the ones after it are not created */
+	for (; breq && breq->nent > 0; breq->nent--)
+		ent[breq->nent - 1]->status = retval;
+	for (; indx < nent; indx++)
+		req[indx].status = retval;
+hndl_free:
+	free(breq);
+hndl_return:
+	VE_RPMLIB_TRACE("Exiting");
+	return retval;
+}
+
+/**
+ * @brief This function will create several VE processes on given VE node,
+ *	  e.g. the ranks of a parallel job.
+ *
+ *	  The VE node is opened and the resource limits are parsed once
+ *	  for the whole batch, and entries are sent in chunks of up to
+ *	  VE_CREATE_BATCH_ENT processes, so 32 ranks take two round trips.
+ *	  The result of each process is reported in its 'status'; a
+ *	  process which cannot be created does not fail the call.
+ *
+ *	  The VE driver file is opened here, in the calling process, and
+ *	  is handed to ve_create_process_batch_fd(). It is the caller's
+ *	  descriptor, so the processes are the caller itself or children
+ *	  it forks afterwards; processes forked earlier do not hold it and
+ *	  are created with ve_create_process_batch_fd() instead. As for
+ *	  ve_create_process(), the descriptor stays open in the caller when
+ *	  any process is created.
+ *
+ * @param nodeid[in] Create processes on given node number
+ * @param nent[in] Number of entries in 'req'
+ * @param req[in/out] Processes to create, results are returned in the
+ *		      same entries
+ *
+ * @return 0 on success and negative value on failure
+ */
+int ve_create_process_batch(int nodeid, int nent, struct ve_create_req *req)
+{
+	int retval = -1;
+	int indx = 0;
+	int err = 0;
+	int fd = -1;
+	char ve_dev_filename[VE_FILE_NAME] = {0};
+
+	VE_RPMLIB_TRACE("Entering");
+	if (!req || nent < 1) {
+		VE_RPMLIB_ERR("Wrong argument received: req = %p, nent = %d",
+				req, nent);
+		errno = EINVAL;
+		retval = -EINVAL;
+		goto hndl_return;
+	}
+	snprintf(ve_dev_filename, sizeof(ve_dev_filename), "%s/%s%d",
+			DEV_PATH, VE_DEVICE_NAME, nodeid);
+	fd = open(ve_dev_filename, O_RDWR);
+	if (fd < 0) {
+		VE_RPMLIB_ERR("Couldn't open file (%s): %s",
+				ve_dev_filename, strerror(errno));
+		retval = -errno;
+		goto hndl_return;
+	}
+	retval = ve_create_process_batch_fd(nodeid, fd, nent, req);
+	for (indx = 0; indx < nent; indx++)
+		if (0 <= req[indx].status)
+			break;
+	if (indx == nent) {
+		err = errno;
+		close(fd);
+		errno = err;
+	}
+hndl_return:
+	VE_RPMLIB_TRACE("Exiting");
+	return retval;
+}
+
 /**
  * @brief This function will check that pid is running on given VE node or not
  *
@@ -1574,37 +1878,124 @@ hndl_return:
 }
 
 /**
- * @brief This function is used to get uptime information.
+ * @brief This function is used to get boot time and uptime of VE node.
+ *
+ *	  CPU statistics are fetched from VEOS only on the first call and
+ *	  after VEOS restarted. Otherwise the uptime is computed from the
+ *	  cached boot instant and CLOCK_MONOTONIC, and only the VEOS socket
+ *	  is checked with stat().
  *
  * @param nodeid[in] VE node number
- * @param uptime_secs[out] Value of uptime
+ * @param boot[out] Boot time and uptime
  *
  * @return 0 on success and -1 on failure
  */
-int ve_uptime_info(int nodeid, double *uptime_secs)
+int ve_boot_info(int nodeid, struct ve_boot_stat *boot)
 {
 	int retval = -1;
+	char sock_name[VE_PATH_MAX] = {0};
 	struct ve_statinfo ve_statinfo_req = { {0} };
+	struct ve_boot_cache ent = {0};
+	struct ve_boot_cache *cache = NULL;
+	struct timespec now = {0};
+	struct stat st = {0};
+	double uptime = 0;
 
 	VE_RPMLIB_TRACE("Entering");
-	if (!uptime_secs) {
-		VE_RPMLIB_ERR("Wrong argument received: uptime_secs = %p",
-						uptime_secs);
+	if (!boot) {
+		VE_RPMLIB_ERR("Wrong argument received: boot = %p", boot);
 		errno = EINVAL;
 		goto hndl_return;
 	}
+	if (0 <= nodeid && VE_MAX_NODE > nodeid) {
+		cache = &ve_boot_cache[nodeid];
+		snprintf(sock_name, sizeof(sock_name), "%s/veos%d.sock",
+				VE_SOC_PATH, nodeid);
+		if (0 > stat(sock_name, &st)) {
+			VE_RPMLIB_ERR("VEOS is not running on node %d: %s",
+					nodeid, strerror(errno));
+			pthread_mutex_lock(&ve_boot_lock);
+			cache->valid = false;
+			pthread_mutex_unlock(&ve_boot_lock);
+			goto hndl_return;
+		}
+		pthread_mutex_lock(&ve_boot_lock);
+		ent = *cache;
+		pthread_mutex_unlock(&ve_boot_lock);
+		if (ent.valid && ent.dev == st.st_dev && ent.ino == st.st_ino &&
+				ent.ctim.tv_sec == st.st_ctim.tv_sec &&
+				ent.ctim.tv_nsec == st.st_ctim.tv_nsec)
+			goto hndl_cached;
+	}
+
 	if (0 > ve_stat_info(nodeid, &ve_statinfo_req)) {
 		VE_RPMLIB_ERR("Failed to get CPU statistics: %s",
 				strerror(errno));
 		goto hndl_return;
 	}
-	*uptime_secs = (((double)ve_statinfo_req.user[0] 
-			+ (double)ve_statinfo_req.idle[0]) 
-			/ MICROSEC_TO_SEC);
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	uptime = ((double)ve_statinfo_req.user[0] +
+			(double)ve_statinfo_req.idle[0]) / MICROSEC_TO_SEC;
+	boot->uptime = uptime;
+	boot->btime = ve_statinfo_req.btime;
+	if (cache) {
+		ent.valid = true;
+		ent.dev = st.st_dev;
+		ent.ino = st.st_ino;
+		ent.ctim = st.st_ctim;
+		ent.btime = ve_statinfo_req.btime;
+		ent.boot.tv_sec = now.tv_sec - (time_t)uptime;
+		ent.boot.tv_nsec = now.tv_nsec - (long)((uptime -
+				(time_t)uptime) * 1000000000);
+		if (ent.boot.tv_nsec < 0) {
+			ent.boot.tv_nsec += 1000000000;
+			ent.boot.tv_sec--;
+		}
+		pthread_mutex_lock(&ve_boot_lock);
+		*cache = ent;
+		pthread_mutex_unlock(&ve_boot_lock);
+	}
+	retval = 0;
+	goto hndl_debug;
+
+hndl_cached:
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	boot->uptime = (now.tv_sec - ent.boot.tv_sec) +
+		(double)(now.tv_nsec - ent.boot.tv_nsec) / 1000000000;
+	boot->btime = ent.btime;
 	retval = 0;
+hndl_debug:
 	VE_RPMLIB_DEBUG("Value of uptime for VE node (%d): %f",
-					nodeid, *uptime_secs);
+					nodeid, boot->uptime);
+hndl_return:
+	VE_RPMLIB_TRACE("Exiting");
+	return retval;
+}
 
+/**
+ * @brief This function is used to get uptime information.
+ *
+ * @param nodeid[in] VE node number
+ * @param uptime_secs[out] Value of uptime
+ *
+ * @return 0 on success and -1 on failure
+ */
+int ve_uptime_info(int nodeid, double *uptime_secs)
+{
+	int retval = -1;
+	struct ve_boot_stat boot = {0};
+
+	VE_RPMLIB_TRACE("Entering");
+	if (!uptime_secs) {
+		VE_RPMLIB_ERR("Wrong argument received: uptime_secs = %p",
+						uptime_secs);
+		errno = EINVAL;
+		goto hndl_return;
+	}
+	if (0 > ve_boot_info(nodeid, &boot))
+		goto hndl_return;
+	*uptime_secs = boot.uptime;
+	retval = 0;
 hndl_return:
 	VE_RPMLIB_TRACE("Exiting");
 	return retval;
@@ -2523,6 +2914,194 @@ hndl_return:
 	return retval;
 }
 
+/**
+ * @brief This function sends one chunk of batched affinity request to VEOS
+ *	  and stores the result of each entry of the chunk.
+ *
+ * @param nodeid[in] VE node ID
+ * @param subcmd[in] VE_GET_AFFINITY_BATCH or VE_SET_AFFINITY_BATCH
+ * @param ent[in/out] Entries included in the chunk
+ * @param req[in] Request built for the chunk
+ * @param res[out] Buffer to receive the reply
+ *
+ * @return 0 on success and negative value on failure
+ */
+static int ve_affinity_batch_chunk(int nodeid, int subcmd,
+				struct ve_affinity_req **ent,
+				struct velib_affinity_batch *req,
+				struct velib_affinity_batch *res)
+{
+	int retval = -1;
+	int indx = 0;
+	int core = 0;
+
+	retval = ve_message_send_receive(nodeid, subcmd, req,
+			offsetof(struct velib_affinity_batch, ent) +
+			sizeof(req->ent[0]) * req->nent,
+			res, sizeof(struct velib_affinity_batch));
+	if (0 > retval)
+		return retval;
+	if (res->nent != req->nent) {
+		VE_RPMLIB_ERR("Invalid number of entries: %d (sent %d)",
+				res->nent, req->nent);
+		errno = EPROTO;
+		return -EPROTO;
+	}
+	for (indx = 0; indx < req->nent; indx++) {
+		ent[indx]->status = res->ent[indx].status;
+		if (VE_GET_AFFINITY_BATCH != subcmd || res->ent[indx].status)
+			continue;
+		CPU_ZERO(&ent[indx]->mask);
+		for (core = 0; core < VE_MAX_CORE_PER_NODE; core++)
+			if (res->ent[indx].mask & (1ULL << core))
+				CPU_SET(core, &ent[indx]->mask);
+	}
+	return 0;
+}
+
+/**
+ * @brief This function gets or sets the CPU affinity of several VE
+ *	  processes, VE_AFFINITY_BATCH_ENT processes per round trip.
+ *
+ * @param nodeid[in] VE node ID
+ * @param subcmd[in] VE_GET_AFFINITY_BATCH or VE_SET_AFFINITY_BATCH
+ * @param nent[in] Number of entries in 'req'
+ * @param req[in/out] Processes and masks
+ *
+ * @return 0 on success and negative value on failure
+ */
+static int ve_affinity_batch(int nodeid, int subcmd, int nent,
+				struct ve_affinity_req *req)
+{
+	int retval = -1;
+	int indx = 0;
+	int core = 0;
+	uint64_t mask = 0;
+	struct ve_affinity_req *ent[VE_AFFINITY_BATCH_ENT] = {NULL};
+	struct velib_affinity_batch *breq = NULL;
+	struct velib_affinity_batch *bres = NULL;
+
+	if (!req || nent < 1) {
+		VE_RPMLIB_ERR("Wrong argument received: req = %p, nent = %d",
+				req, nent);
+		errno = EINVAL;
+		return -EINVAL;
+	}
+	breq = calloc(1, sizeof(struct velib_affinity_batch));
+	bres = calloc(1, sizeof(struct velib_affinity_batch));
+	if (!breq || !bres) {
+		VE_RPMLIB_ERR("Memory allocation failed: %s",
+				strerror(errno));
+		retval = -errno;
+		goto hndl_free;
+	}
+
+	for (indx = 0; indx < nent; indx++) {
+		mask = 0;
+		if (VE_SET_AFFINITY_BATCH == subcmd) {
+			for (core = 0; core < VE_MAX_CORE_PER_NODE; core++)
+				if (CPU_ISSET(core, &req[indx].mask))
+					mask |= 1ULL << core;
+		}
+		/* A mask to set must name a VE core and only VE cores */
+		if (0 >= req[indx].pid || (VE_SET_AFFINITY_BATCH == subcmd &&
+				(!mask || CPU_COUNT(&req[indx].mask) !=
+				 __builtin_popcountll(mask)))) {
+			VE_RPMLIB_DEBUG("Skipping invalid entry %d of pid %d",
+					indx, req[indx].pid);
+			req[indx].status = -EINVAL;
+			continue;
+		}
+		/* Flush the chunk if it is full */
+		if (breq->nent == VE_AFFINITY_BATCH_ENT) {
+			retval = ve_affinity_batch_chunk(nodeid, subcmd, ent,
+							breq, bres);
+			if (0 > retval)
+				goto hndl_fail;
+			breq->nent = 0;
+		}
+		ent[breq->nent] = &req[indx];
+		breq->ent[breq->nent].pid = req[indx].pid;
+		breq->ent[breq->nent].status = 0;
+		breq->ent[breq->nent].mask = mask;
+		breq->nent++;
+	}
+	retval = 0;
+	if (breq->nent) {
+		retval = ve_affinity_batch_chunk(nodeid, subcmd, ent, breq,
+						bres);
+		if (0 > retval)
+			goto hndl_fail;
+	}
+	goto hndl_free;
+
+hndl_fail:
+	/* Entries of the failed chunk and the ones after it are not done */
+	for (; breq->nent > 0; breq->nent--)
+		ent[breq->nent - 1]->status = retval;
+	for (; indx < nent; indx++)
+		req[indx].status = retval;
+hndl_free:
+	free(breq);
+	free(bres);
+	return retval;
+}
+
+/**
+ * @brief This function is used to get the CPU affinity masks of several
+ *	  VE processes or threads of given VE node in as few round trips
+ *	  as possible.
+ *
+ *	  The result of each process is reported in its 'status'; a
+ *	  process which exited does not fail the call.
+ *
+ * @param nodeid[in] VE node number
+ * @param nent[in] Number of entries in 'req'
+ * @param req[in/out] PIDs, masks and status are returned in the same
+ *		      entries
+ *
+ * @return 0 on success and negative value on failure
+ */
+int ve_sched_getaffinity_batch(int nodeid, int nent,
+				struct ve_affinity_req *req)
+{
+	int retval = -1;
+
+	VE_RPMLIB_TRACE("Entering");
+	retval = ve_affinity_batch(nodeid, VE_GET_AFFINITY_BATCH, nent, req);
+	VE_RPMLIB_DEBUG("Got affinity of %d processes: %d", nent, retval);
+	VE_RPMLIB_TRACE("Exiting");
+	return retval;
+}
+
+/**
+ * @brief This function is used to set the CPU affinity masks of several
+ *	  VE processes or threads of given VE node in as few round trips
+ *	  as possible.
+ *
+ *	  The result of each process is reported in its 'status'; a mask
+ *	  with no VE core or a core beyond VE_MAX_CORE_PER_NODE gets
+ *	  -EINVAL without being sent.
+ *
+ * @param nodeid[in] VE node number
+ * @param nent[in] Number of entries in 'req'
+ * @param req[in/out] PIDs and masks to set, status is returned in the
+ *		      same entries
+ *
+ * @return 0 on success and negative value on failure
+ */
+int ve_sched_setaffinity_batch(int nodeid, int nent,
+				struct ve_affinity_req *req)
+{
+	int retval = -1;
+
+	VE_RPMLIB_TRACE("Entering");
+	retval = ve_affinity_batch(nodeid, VE_SET_AFFINITY_BATCH, nent, req);
+	VE_RPMLIB_DEBUG("Set affinity of %d processes: %d", nent, retval);
+	VE_RPMLIB_TRACE("Exiting");
+	return retval;
+}
+
 /**
  * @brief This function will be used to communicate with VEOS and get/set
  * resource limit of VE process for given VE node
@@ -2715,9 +3294,256 @@ hndl_return:
 	return retval;
 }
 
+/**
+ * @brief This function sends one chunk of batched prlimit to VEOS and
+ *	  stores the result of each entry of the chunk.
+ *
+ * @param nodeid[in] VE node ID
+ * @param ent[in/out] Entries included in the chunk
+ * @param req[in] Request built for the chunk
+ * @param res[out] Buffer to receive the reply
+ *
+ * @return 0 on success and negative value on failure
+ */
+static int ve_prlimit_batch_chunk(int nodeid, struct ve_prlimit_req **ent,
+				struct velib_prlimit_batch *req,
+				struct velib_prlimit_batch *res)
+{
+	int retval = -1;
+	int indx = 0;
+
+	retval = ve_message_send_receive(nodeid, VE_PRLIMIT_BATCH, req,
+			offsetof(struct velib_prlimit_batch, ent) +
+			sizeof(req->ent[0]) * req->nent,
+			res, sizeof(struct velib_prlimit_batch));
+	if (0 > retval)
+		return retval;
+	if (res->nent != req->nent) {
+		VE_RPMLIB_ERR("Invalid number of entries: %d (sent %d)",
+				res->nent, req->nent);
+		errno = EPROTO;
+		return -EPROTO;
+	}
+	for (indx = 0; indx < req->nent; indx++) {
+		ent[indx]->status = res->ent[indx].status;
+		if (!res->ent[indx].status)
+			ent[indx]->old_limit = res->ent[indx].old_limit;
+	}
+	return 0;
+}
+
+/**
+ * @brief This function will be used to get/set resource limits of several
+ *	  VE processes of given VE node, VE_PRLIMIT_BATCH_ENT entries per
+ *	  exchange with VEOS.
+ *
+ *	  Each entry gets or sets one resource of one process as
+ *	  ve_prlimit() does; previous limits are returned in 'old_limit'
+ *	  and the result in 'status'. An entry which fails, e.g. because
+ *	  its process exited, does not fail the call.
+ *
+ * @param nodeid[in] VE node number
+ * @param nent[in] Number of entries in 'req'
+ * @param req[in/out] PIDs, resources and new limits, previous limits and
+ *		      status are returned in the same entries
+ *
+ * @return 0 on success and negative value on failure
+ */
+int ve_prlimit_batch(int nodeid, int nent, struct ve_prlimit_req *req)
+{
+	int retval = -1;
+	int indx = 0;
+	struct ve_prlimit_req *ent[VE_PRLIMIT_BATCH_ENT] = {NULL};
+	struct velib_prlimit_batch *breq = NULL;
+	struct velib_prlimit_batch *bres = NULL;
+
+	VE_RPMLIB_TRACE("Entering");
+	if (!req || nent < 1) {
+		VE_RPMLIB_ERR("Wrong argument received: req = %p, nent = %d",
+				req, nent);
+		errno = EINVAL;
+		retval = -EINVAL;
+		goto hndl_return;
+	}
+	breq = calloc(1, sizeof(struct velib_prlimit_batch));
+	bres = calloc(1, sizeof(struct velib_prlimit_batch));
+	if (!breq || !bres) {
+		VE_RPMLIB_ERR("Memory allocation failed: %s",
+				strerror(errno));
+		retval = -errno;
+		goto hndl_free;
+	}
+
+	for (indx = 0; indx < nent; indx++) {
+		if (0 >= req[indx].pid || 0 > req[indx].resource ||
+				RLIM_NLIMITS <= req[indx].resource ||
+				(req[indx].new_limit &&
+				 req[indx].new_limit->rlim_cur >
+				 req[indx].new_limit->rlim_max)) {
+			VE_RPMLIB_DEBUG("Skipping invalid entry %d of pid %d",
+					indx, req[indx].pid);
+			req[indx].status = -EINVAL;
+			continue;
+		}
+		/* Flush the chunk if it is full */
+		if (breq->nent == VE_PRLIMIT_BATCH_ENT) {
+			retval = ve_prlimit_batch_chunk(nodeid, ent, breq, bres);
+			if (0 > retval)
+				goto hndl_fail;
+			breq->nent = 0;
+		}
+		ent[breq->nent] = &req[indx];
+		memset(&breq->ent[breq->nent], '\0', sizeof(breq->ent[0]));
+		breq->ent[breq->nent].pid = req[indx].pid;
+		breq->ent[breq->nent].resource = req[indx].resource;
+		if (req[indx].new_limit) {
+			breq->ent[breq->nent].new_limit = *req[indx].new_limit;
+			breq->ent[breq->nent].is_new_lim = true;
+		}
+		breq->nent++;
+	}
+	retval = 0;
+	if (breq->nent) {
+		retval = ve_prlimit_batch_chunk(nodeid, ent, breq, bres);
+		if (0 > retval)
+			goto hndl_fail;
+	}
+	VE_RPMLIB_DEBUG("Processed limits of %d entries", nent);
+	goto hndl_free;
+
+hndl_fail:
+	/* Entries of the failed chunk and the ones after it are not done */
+	for (; breq->nent > 0; breq->nent--)
+		ent[breq->nent - 1]->status = retval;
+	for (; indx < nent; indx++)
+		req[indx].status = retval;
+hndl_free:
+	free(breq);
+	free(bres);
+hndl_return:
+	VE_RPMLIB_TRACE("Exiting");
+	return retval;
+}
+
+/**
+ * @brief This function sets the same resource limits on every task of a
+ *	  VE thread group, e.g. to clamp the memory of a whole job.
+ *
+ *	  The tasks are listed with ve_thread_info() and all limits are set
+ *	  with ve_prlimit_batch(); a task which exited meanwhile is skipped.
+ *
+ * @param nodeid[in] VE node number
+ * @param tgid[in] Thread Group ID of VE process
+ * @param nres[in] Number of entries in 'resource' and 'new_limit'
+ * @param resource[in] Resources to set
+ * @param new_limit[in] New limits of each resource
+ *
+ * @return Number of tasks whose limits were all set on success and -1 on
+ *	   failure, with errno EINVAL when a resource or limit is invalid
+ */
+int ve_prlimit_tgid(int nodeid, pid_t tgid, int nres, int *resource,
+			struct rlimit *new_limit)
+{
+	int retval = -1;
+	int nreq = 0;
+	int ntask = 0;
+	int task = 0;
+	int indx = 0;
+	int res = 0;
+	bool done = false;
+	pid_t cursor = 0;
+	struct ve_prlimit_req *req = NULL;
+	struct ve_prlimit_req *tmp = NULL;
+	struct ve_thread_info *threads = NULL;
+
+	VE_RPMLIB_TRACE("Entering");
+	if (0 >= tgid || 1 > nres || !resource || !new_limit) {
+		VE_RPMLIB_ERR("Wrong argument received: tgid = %d, nres = %d,"
+				" resource = %p, new_limit = %p", tgid, nres,
+				resource, new_limit);
+		errno = EINVAL;
+		goto hndl_return;
+	}
+	for (res = 0; res < nres; res++) {
+		if (0 > resource[res] || RLIM_NLIMITS <= resource[res] ||
+				new_limit[res].rlim_cur >
+				new_limit[res].rlim_max) {
+			VE_RPMLIB_ERR("Invalid limit %d of resource %d", res,
+					resource[res]);
+			errno = EINVAL;
+			goto hndl_return;
+		}
+	}
+	threads = malloc(sizeof(struct ve_thread_info));
+	if (!threads) {
+		VE_RPMLIB_ERR("Memory allocation failed: %s",
+				strerror(errno));
+		goto hndl_return;
+	}
+	do {
+		if (0 > ve_thread_info(nodeid, tgid, cursor, threads))
+			goto hndl_free;
+		if (threads->more && threads->cursor <= cursor) {
+			VE_RPMLIB_ERR("Thread cursor of %d did not advance: %d",
+					tgid, threads->cursor);
+			errno = EPROTO;
+			goto hndl_free;
+		}
+		tmp = realloc(req, sizeof(struct ve_prlimit_req) *
+					(nreq + threads->len * nres + 1));
+		if (!tmp) {
+			VE_RPMLIB_ERR("Memory allocation failed: %s",
+					strerror(errno));
+			goto hndl_free;
+		}
+		req = tmp;
+		for (indx = 0; indx < threads->len; indx++) {
+			for (res = 0; res < nres; res++) {
+				memset(&req[nreq], '\0',
+					sizeof(struct ve_prlimit_req));
+				req[nreq].pid = threads->thread[indx].tid;
+				req[nreq].resource = resource[res];
+				req[nreq].new_limit = &new_limit[res];
+				nreq++;
+			}
+		}
+		cursor = threads->cursor;
+	} while (threads->more);
+
+	if (nreq && 0 > ve_prlimit_batch(nodeid, nreq, req))
+		goto hndl_free;
+	ntask = nreq / nres;
+	retval = 0;
+	for (task = 0; task < ntask; task++) {
+		done = true;
+		for (res = 0; res < nres; res++) {
+			indx = task * nres + res;
+			if (!req[indx].status)
+				continue;
+			VE_RPMLIB_DEBUG("Failed to set limit %d of task %d: %s",
+					req[indx].resource, req[indx].pid,
+					strerror(-req[indx].status));
+			done = false;
+		}
+		if (done)
+			retval++;
+	}
+	VE_RPMLIB_DEBUG("Set %d limits on %d of %d tasks of %d", nres,
+			retval, ntask, tgid);
+hndl_free:
+	free(req);
+	free(threads);
+hndl_return:
+	VE_RPMLIB_TRACE("Exiting");
+	return retval;
+}
+
 /**
  * @brief This function populates the virtual memory information of VE node
  *
+ *	  Page and swap counters are the totals since VEOS started. When VEOS
+ *	  does not provide them, zeros are returned as before.
+ *
  * @param nodeid[in] VE node number
  * @param ve_vmstatinfo_req[out] Structure to get virtual memory statistics
  *
@@ -2736,13 +3562,80 @@ int ve_vmstat_info(int nodeid, struct ve_vmstat *ve_vmstatinfo_req)
 		goto hndl_return;
 	}
 	memset(ve_vmstatinfo_req, '\0', sizeof(struct ve_vmstat));
-	retval = 0;
+	retval = ve_message_send_receive(nodeid, VE_VMSTAT_INFO, NULL, 0,
+			ve_vmstatinfo_req, sizeof(struct ve_vmstat));
+	if (-EINVAL == retval || -ENOTSUP == retval) {
+		VE_RPMLIB_DEBUG("VEOS does not provide vmstat counters");
+		memset(ve_vmstatinfo_req, '\0', sizeof(struct ve_vmstat));
+		errno = 0;
+		retval = 0;
+	} else if (0 > retval) {
+		VE_RPMLIB_ERR("Failed to get vmstat counters: %s",
+				strerror(errno));
+		retval = -1;
+	}
 
 hndl_return:
 	VE_RPMLIB_TRACE("Exiting");
 	return retval;
 }
 
+/**
+ * @brief This function computes the rate per second of one counter
+ *
+ * @param prev[in] Previous value
+ * @param cur[in] Current value
+ * @param interval[in] Seconds between the values
+ *
+ * @return Rate rounded to the nearest integer, 0 if the counter went back
+ */
+static unsigned long ve_vmstat_rate(unsigned long prev, unsigned long cur,
+					double interval)
+{
+	/* Counters go back when VEOS is restarted */
+	if (cur < prev)
+		return 0;
+	return (unsigned long)((cur - prev) / interval + 0.5);
+}
+
+/**
+ * @brief This function turns two snapshots taken by ve_vmstat_info() into
+ *	  the rates per second over the interval between them.
+ *
+ * @param prev[in] Earlier snapshot
+ * @param cur[in] Later snapshot
+ * @param interval[in] Seconds between the snapshots
+ * @param rate[out] Rates per second, may be the same as 'cur'
+ *
+ * @return 0 on success and -1 on failure
+ */
+int ve_vmstat_delta(struct ve_vmstat *prev, struct ve_vmstat *cur,
+			double interval, struct ve_vmstat *rate)
+{
+	struct ve_vmstat delta = {0};
+
+	if (!prev || !cur || !rate || !(interval > 0)) {
+		VE_RPMLIB_ERR("Wrong argument received: prev = %p, cur = %p, "
+				"rate = %p, interval = %f",
+				prev, cur, rate, interval);
+		errno = EINVAL;
+		return -1;
+	}
+	delta.pgfree = ve_vmstat_rate(prev->pgfree, cur->pgfree, interval);
+	delta.pgscan_direct = ve_vmstat_rate(prev->pgscan_direct,
+					cur->pgscan_direct, interval);
+	delta.pgsteal = ve_vmstat_rate(prev->pgsteal, cur->pgsteal, interval);
+	delta.pswpin = ve_vmstat_rate(prev->pswpin, cur->pswpin, interval);
+	delta.pswpout = ve_vmstat_rate(prev->pswpout, cur->pswpout, interval);
+	delta.pgfault = ve_vmstat_rate(prev->pgfault, cur->pgfault, interval);
+	delta.pgmajfault = ve_vmstat_rate(prev->pgmajfault, cur->pgmajfault,
+					interval);
+	delta.pgscan_kswapd = ve_vmstat_rate(prev->pgscan_kswapd,
+					cur->pgscan_kswapd, interval);
+	*rate = delta;
+	return 0;
+}
+
 /**
  * @brief This function will be used to communicate with VEOS and get the
  * memory map information for given PID on given VE node
@@ -5910,29 +6803,116 @@ end:
 }
 
 /**
- * @brief This function is request send to veos,
- *	  and recive from veos
+ * @brief This function reads a base 128 varint of protobuf wire format
+ *
+ * @param buf[in/out] Cursor in the buffer, advanced past the varint
+ * @param end[in] End of the buffer
+ * @param val[out] Value read
+ *
+ * @return 0 on success and -1 if the varint is truncated or too long
+ */
+static int velib_read_varint(const uint8_t **buf, const uint8_t *end,
+				uint64_t *val)
+{
+	int shift = 0;
+
+	*val = 0;
+	for (shift = 0; shift < 64 && *buf < end; shift += 7) {
+		*val |= (uint64_t)(**buf & 0x7f) << shift;
+		if (!(*(*buf)++ & 0x80))
+			return 0;
+	}
+	return -1;
+}
+
+/**
+ * @brief This function decodes the velib_connect envelope of a reply
+ *	  from VEOS in place
+ *
+ *	  Unlike velib_connect__unpack(), nothing is allocated and the
+ *	  payload is not copied: 'reply->msg' points into 'buf'.
+ *
+ * @param buf[in] Received message
+ * @param len[in] Length of the received message
+ * @param reply[out] Decoded envelope
+ *
+ * @return 0 on success and -1 if the message is malformed
+ */
+static int velib_reply_decode(const uint8_t *buf, size_t len,
+				struct velib_reply *reply)
+{
+	const uint8_t *end = buf + len;
+	uint64_t key = 0;
+	uint64_t val = 0;
+	bool has_cmd = false;
+
+	memset(reply, '\0', sizeof(struct velib_reply));
+	while (buf < end) {
+		if (0 > velib_read_varint(&buf, end, &key))
+			return -1;
+		switch (key & 0x7) {
+		case 0:		/* varint */
+			if (0 > velib_read_varint(&buf, end, &val))
+				return -1;
+			if (1 == key >> 3)
+				has_cmd = true;
+			else if (4 == key >> 3)
+				reply->retval = (int64_t)val;
+			break;
+		case 1:		/* 64-bit */
+			if (end - buf < 8)
+				return -1;
+			buf += 8;
+			break;
+		case 2:		/* length-delimited */
+			if (0 > velib_read_varint(&buf, end, &val) ||
+					val > (uint64_t)(end - buf))
+				return -1;
+			if (5 == key >> 3) {
+				reply->has_msg = true;
+				reply->msg = buf;
+				reply->len = val;
+			}
+			buf += val;
+			break;
+		case 5:		/* 32-bit */
+			if (end - buf < 4)
+				return -1;
+			buf += 4;
+			break;
+		default:
+			return -1;
+		}
+	}
+	return has_cmd ? 0 : -1;
+}
+
+/**
+ * @brief This function is request send to veos about given VE process,
+ *	  and recive from veos without copying the reply
  *
  * @param nodeid[in] VE node ID
  * @param subcmd sub command to send
+ * @param pid[in] VE process ID to send, negative value to send none
  * @param sendmsg[in] message to send
  * @param sendmsg_len[in] the length of the message to send
- * @param recv_buf[out] buffer to store the received message
- * @param recv_bufsize[in] the size of the buffer to receive a message
+ * @param recv_buf[out] buffer of MAX_PROTO_MSG_SIZE bytes to receive
+ *			the message in
+ * @param reply[out] reply decoded in place, its payload points into
+ *		     'recv_buf'
  * @return 0 on success and negative value on failure
  */
-static int ve_message_send_receive(int nodeid, int subcmd, void *sendmsg,
-	size_t sendmsg_len, void *recv_buf, size_t recv_bufsize)
+static int ve_message_view(int nodeid, int subcmd, pid_t pid,
+	void *sendmsg, size_t sendmsg_len, uint8_t *recv_buf,
+	struct velib_reply *reply)
 {
 	int retval = -1;
 	int sock_fd = -1;
 	int pack_msg_len = -1;
 	char *ve_sock_name = NULL;
-	uint8_t *unpack_buf_recv = NULL;
 	void *pack_buf_send = NULL;
 
 	VelibConnect request = VELIB_CONNECT__INIT;
-	VelibConnect *res;
 
 	VE_RPMLIB_TRACE("Entering");
 
@@ -5941,6 +6921,10 @@ static int ve_message_send_receive(int nodeid, int subcmd, void *sendmsg,
 	request.subcmd_str = subcmd;
 	request.has_rpm_pid = true;
 	request.rpm_pid = getpid();
+	if (0 <= pid) {
+		request.has_ve_pid = true;
+		request.ve_pid = pid;
+	}
 	if (sendmsg) {
 		request.has_rpm_msg = true;
 		request.rpm_msg.data = sendmsg;
@@ -6009,53 +6993,27 @@ static int ve_message_send_receive(int nodeid, int subcmd, void *sendmsg,
 	}
 	VE_RPMLIB_DEBUG("Send data successfully to VEOS and "
 						"waiting to receive....");
-	unpack_buf_recv = malloc(MAX_PROTO_MSG_SIZE);
-	if (!unpack_buf_recv) {
-		VE_RPMLIB_ERR("Memory allocation failed: %s",
-				strerror(errno));
-		retval = -ECANCELED;
-		goto hndl_free_buff;
-	}
 
 	/*
 	 * Receive the IPC message from VEOS
 	 */
-	retval = velib_recv_cmd(sock_fd, unpack_buf_recv, MAX_PROTO_MSG_SIZE);
+	retval = velib_recv_cmd(sock_fd, recv_buf, MAX_PROTO_MSG_SIZE);
 	VE_RPMLIB_DEBUG("Data received from VEOS %d bytes", retval);
 
-	/* Unpack the data received from VEOS */
-	res = velib_connect__unpack(NULL, retval,
-					(const uint8_t *)(unpack_buf_recv));
-	if (!res) {
+	/* Decode the data received from VEOS */
+	if (0 > retval || 0 > velib_reply_decode(recv_buf, retval, reply)) {
 		VE_RPMLIB_ERR("Failed to unpack message: %d", retval);
 		fprintf(stderr, "Failed to unpack message\n");
 		goto abort;
 	}
 
-	if (recv_buf) {
-		if (!res->has_rpm_msg) {
-			VE_RPMLIB_ERR("No data in the received data",
-				res->rpm_msg.len, recv_bufsize);
-			fprintf(stderr, "No data in the received data\n");
-			goto abort;
-		}
-		if (res->rpm_msg.len > recv_bufsize) {
-			VE_RPMLIB_ERR("The length of the received message is too long: %d",
-				res->rpm_msg.len);
-			fprintf(stderr, "The length of the received message too long\n");
-			goto abort;
-		}
-		memcpy(recv_buf, res->rpm_msg.data, recv_bufsize);
-	}
-
-	retval = res->rpm_retval;
-	goto hndl_free_unpacked_msg;
+	retval = reply->retval;
+	if (0 > retval)
+		errno = -retval;
+	goto hndl_free_buff;
 abort:
 	close(sock_fd);
 	abort();
-hndl_free_unpacked_msg:
-	velib_connect__free_unpacked(res, NULL);
-	free(unpack_buf_recv);
 hndl_free_buff:
 	free(pack_buf_send);
 hndl_close_sock:
@@ -6067,6 +7025,70 @@ hndl_return:
 	return retval;
 }
 
+/**
+ * @brief This function is request send to veos about given VE process,
+ *	  and recive from veos
+ *
+ *	  Exactly the received payload is copied to 'recv_buf'. A message
+ *	  shorter than 'recv_bufsize' is padded with zeros.
+ *
+ * @param nodeid[in] VE node ID
+ * @param subcmd sub command to send
+ * @param pid[in] VE process ID to send, negative value to send none
+ * @param sendmsg[in] message to send
+ * @param sendmsg_len[in] the length of the message to send
+ * @param recv_buf[out] buffer to store the received message
+ * @param recv_bufsize[in] the size of the buffer to receive a message
+ * @return 0 on success and negative value on failure
+ */
+static int ve_pid_message_send_receive(int nodeid, int subcmd, pid_t pid,
+	void *sendmsg, size_t sendmsg_len, void *recv_buf, size_t recv_bufsize)
+{
+	int retval = -1;
+	uint8_t buf[MAX_PROTO_MSG_SIZE];
+	struct velib_reply reply = {0};
+
+	retval = ve_message_view(nodeid, subcmd, pid, sendmsg, sendmsg_len,
+				buf, &reply);
+	/* A failed request does not have to carry data, e.g. when VEOS
+	 * does not know the sub-command */
+	if (!recv_buf || 0 > retval)
+		return retval;
+	if (!reply.has_msg) {
+		VE_RPMLIB_ERR("No data in the received data");
+		fprintf(stderr, "No data in the received data\n");
+		abort();
+	}
+	if (reply.len > recv_bufsize) {
+		VE_RPMLIB_ERR("The length of the received message is too long: %zu",
+			reply.len);
+		fprintf(stderr, "The length of the received message too long\n");
+		abort();
+	}
+	memcpy(recv_buf, reply.msg, reply.len);
+	memset((uint8_t *)recv_buf + reply.len, '\0', recv_bufsize - reply.len);
+	return retval;
+}
+
+/**
+ * @brief This function is request send to veos,
+ *	  and recive from veos
+ *
+ * @param nodeid[in] VE node ID
+ * @param subcmd sub command to send
+ * @param sendmsg[in] message to send
+ * @param sendmsg_len[in] the length of the message to send
+ * @param recv_buf[out] buffer to store the received message
+ * @param recv_bufsize[in] the size of the buffer to receive a message
+ * @return 0 on success and negative value on failure
+ */
+static int ve_message_send_receive(int nodeid, int subcmd, void *sendmsg,
+	size_t sendmsg_len, void *recv_buf, size_t recv_bufsize)
+{
+	return ve_pid_message_send_receive(nodeid, subcmd, -1, sendmsg,
+				sendmsg_len, recv_buf, recv_bufsize);
+}
+
 /**
  * @brief This function is used to get the swapped memory size
  *	  from VEOS for the given VE process id.
@@ -6186,6 +7208,182 @@ ve_swap_get_cns(int nodeid, struct ve_swap_pids *pids,
 				cns_info, sizeof(struct ve_cns_info));
 }
 
+/**
+ * @brief This function sends a swap request for any number of VE processes
+ *	  in chunks of VE_SWAP_VL_CHUNK PIDs and gathers the entries VEOS
+ *	  returns for each chunk.
+ *
+ *	  Only the PIDs of a chunk are sent and only the entries VEOS
+ *	  returns are received, so the size of the messages follows the
+ *	  number of processes. Entries are copied once, from the received
+ *	  message to 'ent'.
+ *
+ * @param nodeid[in] VE node ID
+ * @param subcmd[in] Variable length swap sub-command
+ * @param num[in] Number of PIDs
+ * @param pids[in] VE process ID array
+ * @param required_free_size[in] Required-free-size, 0 for none
+ * @param ent[out] Array of 'num' entries of 'entsize' bytes to get the
+ *		   entries, NULL if VEOS returns none
+ * @param entsize[in] Size of one entry
+ * @param len[out] Number of entries received
+ *
+ * @return 0 on success and negative value on failure
+ */
+static int ve_swap_vl(int nodeid, int subcmd, int num, const pid_t *pids,
+			size_t required_free_size, void *ent, size_t entsize,
+			int *len)
+{
+	int retval = -1;
+	int done = 0;
+	int total = 0;
+	int nres = 0;
+	size_t hdr = offsetof(struct velib_swap_vl_res, ent);
+	uint8_t buf[MAX_PROTO_MSG_SIZE];
+	struct velib_reply reply = {0};
+	struct velib_swap_vl_req *req = NULL;
+
+	VE_RPMLIB_TRACE("Entering");
+	if (!pids || 0 > num || (ent && !len)) {
+		VE_RPMLIB_ERR("Wrong argument received: pids = %p, num = %d",
+				pids, num);
+		errno = EINVAL;
+		retval = -EINVAL;
+		goto hndl_return;
+	}
+	req = malloc(sizeof(struct velib_swap_vl_req));
+	if (!req) {
+		VE_RPMLIB_ERR("Memory allocation failed: %s",
+				strerror(errno));
+		retval = -errno;
+		goto hndl_free;
+	}
+	req->required_free_size = required_free_size;
+
+	retval = 0;
+	for (done = 0; done < num; done += req->num) {
+		req->num = num - done < VE_SWAP_VL_CHUNK ?
+				num - done : VE_SWAP_VL_CHUNK;
+		memcpy(req->pid, &pids[done], sizeof(pid_t) * req->num);
+		retval = ve_message_view(nodeid, subcmd, -1, req,
+				offsetof(struct velib_swap_vl_req, pid) +
+				sizeof(pid_t) * req->num, buf, &reply);
+		if (0 > retval)
+			goto hndl_free;
+		if (!ent)
+			continue;
+		/* The payload is not aligned inside the received message */
+		if (reply.len >= hdr)
+			memcpy(&nres, reply.msg, sizeof(int));
+		if (reply.len < hdr || 0 > nres || nres > req->num ||
+				reply.len != hdr + entsize * nres) {
+			VE_RPMLIB_ERR("Invalid swap reply: %d entries in %zu "
+					"bytes", nres, reply.len);
+			errno = EPROTO;
+			retval = -EPROTO;
+			goto hndl_free;
+		}
+		memcpy((char *)ent + entsize * total, reply.msg + hdr,
+				entsize * nres);
+		total += nres;
+	}
+	VE_RPMLIB_DEBUG("Swap request %d done for %d processes", subcmd, num);
+
+hndl_free:
+	if (len)
+		*len = total;
+	free(req);
+hndl_return:
+	VE_RPMLIB_TRACE("Exiting");
+	return retval;
+}
+
+/**
+ * @brief This function is used to get the swap status information
+ *	  from VEOS for any number of VE processes.
+ *
+ * @param nodeid[in] VE node ID
+ * @param num[in] Number of PIDs
+ * @param pids[in] VE process ID array
+ * @param status[out] Array of 'num' entries to get status information
+ *		      of swap about VE processes
+ * @param len[out] Number of entries received
+ *
+ * @return 0 on success and negative value on failure
+ */
+int ve_swap_statusinfo_vl(int nodeid, int num, const pid_t *pids,
+			struct ve_swap_status_struct *status, int *len)
+{
+	if (!status) {
+		VE_RPMLIB_ERR("Wrong argument received: status = %p", status);
+		errno = EINVAL;
+		return -EINVAL;
+	}
+	return ve_swap_vl(nodeid, VE_SWAP_STATUSINFO_VL, num, pids, 0,
+			status, sizeof(struct ve_swap_status_struct), len);
+}
+
+/**
+ * @brief This function is used to get the swap information
+ *	  from VEOS for any number of VE processes.
+ *
+ * @param nodeid[in] VE node ID
+ * @param num[in] Number of PIDs
+ * @param pids[in] VE process ID array
+ * @param info[out] Array of 'num' entries to get information of
+ *		    swap about VE processes
+ * @param len[out] Number of entries received
+ *
+ * @return 0 on success and negative value on failure
+ */
+int ve_swap_info_vl(int nodeid, int num, const pid_t *pids,
+			struct ve_swap_struct *info, int *len)
+{
+	if (!info) {
+		VE_RPMLIB_ERR("Wrong argument received: info = %p", info);
+		errno = EINVAL;
+		return -EINVAL;
+	}
+	return ve_swap_vl(nodeid, VE_SWAP_INFO_VL, num, pids, 0,
+			info, sizeof(struct ve_swap_struct), len);
+}
+
+/**
+ * @brief This function is used to request for VEOS to swap out
+ *	  any number of VE processes.
+ *
+ *	  With a required-free-size, VEOS stops swapping out once that much
+ *	  memory is free; later chunks are then answered without swapping.
+ *
+ * @param nodeid[in] VE node ID
+ * @param num[in] Number of PIDs
+ * @param pids[in] VE process ID array
+ * @param required_free_size[in] Required-free-size, 0 for none
+ *
+ * @return 0 on success and negative value on failure
+ */
+int ve_swap_out_vl(int nodeid, int num, const pid_t *pids,
+			size_t required_free_size)
+{
+	return ve_swap_vl(nodeid, VE_SWAP_OUT_VL, num, pids,
+			required_free_size, NULL, 0, NULL);
+}
+
+/**
+ * @brief This function is used to request for VEOS to swap in
+ *	  any number of VE processes.
+ *
+ * @param nodeid[in] VE node ID
+ * @param num[in] Number of PIDs
+ * @param pids[in] VE process ID array
+ *
+ * @return 0 on success and negative value on failure
+ */
+int ve_swap_in_vl(int nodeid, int num, const pid_t *pids)
+{
+	return ve_swap_vl(nodeid, VE_SWAP_IN_VL, num, pids, 0, NULL, 0, NULL);
+}
+
 /**
  * @brief This function populates the architecture for given VE node.
  *
@@ -6626,3 +7824,412 @@ hndl_return:
         return retval;
 
 }
+
+/**
+ * @brief This function is used to get the changes of VE process table
+ *	  from VEOS since the given generation.
+ *
+ * @param nodeid[in] VE node ID
+ * @param generation[in] Generation the caller is synced to, 0 to get a full
+ *			 snapshot
+ * @param cursor[in] PID returned as 'cursor' of previous chunk, 0 for the
+ *		     first chunk
+ * @param delta[out] Structure to get changed tasks and the new generation
+ *
+ * @return 0 on success and negative value on failure
+ */
+int ve_proc_delta_info(int nodeid, uint64_t generation, pid_t cursor,
+			struct ve_proc_delta *delta)
+{
+	struct velib_proc_delta_req req = {0};
+
+	if (!delta) {
+		VE_RPMLIB_ERR("Wrong argument received: delta = %p", delta);
+		errno = EINVAL;
+		return -EINVAL;
+	}
+	req.generation = generation;
+	req.cursor = cursor;
+	return ve_message_send_receive(nodeid, VE_PROC_DELTA,
+				&req, sizeof(struct velib_proc_delta_req),
+				delta, sizeof(struct ve_proc_delta));
+}
+
+/**
+ * @brief Find the position of given PID in process table sorted by PID
+ *
+ * @param table[in] Process table
+ * @param pid[in] PID to look up
+ * @param found[out] Set to true if PID exists in table
+ *
+ * @return Index of the entry, or index where it has to be inserted
+ */
+static int ve_proc_table_index(struct ve_proc_table *table, pid_t pid,
+				bool *found)
+{
+	int low = 0;
+	int high = table->len;
+	int mid = 0;
+
+	*found = false;
+	/* Fast path for snapshots which are received in PID order */
+	if (table->len && table->entry[table->len - 1].pid < pid)
+		return table->len;
+	while (low < high) {
+		mid = low + (high - low) / 2;
+		if (table->entry[mid].pid == pid) {
+			*found = true;
+			return mid;
+		}
+		if (table->entry[mid].pid < pid)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+	return low;
+}
+
+/**
+ * @brief Merge one delta entry into process table
+ *
+ * @param table[in/out] Process table
+ * @param ent[in] Entry received from VEOS
+ *
+ * @return 0 on success and -1 on failure
+ */
+static int ve_proc_table_merge(struct ve_proc_table *table,
+				const struct ve_proc_entry *ent)
+{
+	int indx = 0;
+	int size = 0;
+	bool found = false;
+	struct ve_proc_entry *tmp = NULL;
+
+	indx = ve_proc_table_index(table, ent->pid, &found);
+	if (VE_PROC_EXITED == ent->change) {
+		if (found) {
+			memmove(&table->entry[indx], &table->entry[indx + 1],
+				(table->len - indx - 1) *
+				sizeof(struct ve_proc_entry));
+			table->len--;
+		}
+		return 0;
+	}
+	if (found) {
+		table->entry[indx] = *ent;
+		return 0;
+	}
+	if (table->len == table->size) {
+		size = table->size ? table->size * 2 : VE_PROC_DELTA_MAX * 4;
+		tmp = realloc(table->entry, size * sizeof(struct ve_proc_entry));
+		if (!tmp) {
+			VE_RPMLIB_ERR("Memory allocation failed: %s",
+					strerror(errno));
+			return -1;
+		}
+		table->entry = tmp;
+		table->size = size;
+	}
+	memmove(&table->entry[indx + 1], &table->entry[indx],
+			(table->len - indx) * sizeof(struct ve_proc_entry));
+	table->entry[indx] = *ent;
+	table->len++;
+	return 0;
+}
+
+/**
+ * @brief This function brings the client side process table up to date
+ *	  by fetching and merging only the tasks changed since its
+ *	  generation.
+ *
+ * @param nodeid[in] VE node ID
+ * @param table[in/out] Process table, zero-initialized before first use
+ *
+ * @return Number of changes merged on success and -1 on failure
+ */
+int ve_proc_table_update(int nodeid, struct ve_proc_table *table)
+{
+	int retval = -1;
+	int lv = 0;
+	int changes = 0;
+	pid_t cursor = 0;
+	bool cleared = false;
+	bool restart = false;
+	uint64_t new_gen = 0;
+	struct ve_proc_delta *delta = NULL;
+
+	VE_RPMLIB_TRACE("Entering");
+	if (!table) {
+		VE_RPMLIB_ERR("Wrong argument received: table = %p", table);
+		errno = EINVAL;
+		goto hndl_return;
+	}
+	delta = malloc(sizeof(struct ve_proc_delta));
+	if (!delta) {
+		VE_RPMLIB_ERR("Memory allocation failed: %s", strerror(errno));
+		goto hndl_return;
+	}
+	do {
+		restart = false;
+		if (0 > ve_proc_delta_info(nodeid, table->generation, cursor,
+						delta)) {
+			VE_RPMLIB_ERR("Failed to get process table delta: %s",
+					strerror(errno));
+			goto hndl_free;
+		}
+		if (delta->len < 0 || delta->len > VE_PROC_DELTA_MAX) {
+			VE_RPMLIB_ERR("Invalid delta length: %d", delta->len);
+			errno = EPROTO;
+			goto hndl_free;
+		}
+		/* Keep the generation of the first chunk. Changes made while
+		 * the remaining chunks are fetched are reported again by the
+		 * next update, and merging them twice is harmless.
+		 */
+		if (!cursor)
+			new_gen = delta->generation;
+		if (delta->reset && !cleared) {
+			VE_RPMLIB_DEBUG("Full snapshot from generation %llu",
+					(unsigned long long)delta->generation);
+			table->len = 0;
+			/* Table is incomplete until the last chunk is merged */
+			table->generation = 0;
+			cleared = true;
+			/* Chunks merged before the reset were of the stale
+			 * generation, fetch the snapshot from its start */
+			if (cursor) {
+				cursor = 0;
+				changes = 0;
+				restart = true;
+				continue;
+			}
+		}
+		for (lv = 0; lv < delta->len; lv++) {
+			if (ve_proc_table_merge(table, &delta->entry[lv]))
+				goto hndl_free;
+		}
+		changes += delta->len;
+		cursor = delta->cursor;
+	} while (restart || (delta->more && cursor > 0));
+
+	table->generation = new_gen;
+	retval = changes;
+	VE_RPMLIB_DEBUG("Merged %d changes, %d tasks at generation %llu",
+			changes, table->len,
+			(unsigned long long)table->generation);
+hndl_free:
+	free(delta);
+hndl_return:
+	VE_RPMLIB_TRACE("Exiting");
+	return retval;
+}
+
+/**
+ * @brief This function looks up a task in the client side process table
+ *
+ * @param table[in] Process table
+ * @param pid[in] PID of VE task
+ *
+ * @return Pointer to the entry on success and NULL if not found
+ */
+struct ve_proc_entry *ve_proc_table_find(struct ve_proc_table *table,
+					pid_t pid)
+{
+	int indx = 0;
+	bool found = false;
+
+	if (!table || !table->len)
+		return NULL;
+	indx = ve_proc_table_index(table, pid, &found);
+	return found ? &table->entry[indx] : NULL;
+}
+
+/**
+ * @brief This function releases the memory held by process table
+ *
+ * @param table[in] Process table
+ */
+void ve_proc_table_free(struct ve_proc_table *table)
+{
+	if (!table)
+		return;
+	free(table->entry);
+	memset(table, '\0', sizeof(struct ve_proc_table));
+}
+
+/**
+ * @brief This function is used to get the threads of given VE thread group
+ *	  with their state, processor, CPU time and context switches.
+ *
+ * @param nodeid[in] VE node ID
+ * @param tgid[in] Thread Group ID of VE process
+ * @param cursor[in] TID returned as 'cursor' of previous chunk, 0 for the
+ *		     first chunk
+ * @param threads[out] Structure to get the threads of the thread group
+ *
+ * @return 0 on success and negative value on failure
+ */
+int ve_thread_info(int nodeid, pid_t tgid, pid_t cursor,
+			struct ve_thread_info *threads)
+{
+	int retval = -1;
+	struct velib_thread_info_req req = {0};
+
+	VE_RPMLIB_TRACE("Entering");
+	if (!threads || 0 >= tgid) {
+		VE_RPMLIB_ERR("Wrong argument received: threads = %p, tgid = %d",
+				threads, tgid);
+		errno = EINVAL;
+		retval = -EINVAL;
+		goto hndl_return;
+	}
+	req.cursor = cursor;
+	retval = ve_pid_message_send_receive(nodeid, VE_THREAD_INFO, tgid,
+				&req, sizeof(struct velib_thread_info_req),
+				threads, sizeof(struct ve_thread_info));
+	if (0 > retval)
+		goto hndl_return;
+	if (threads->len < 0 || threads->len > VE_THREAD_INFO_MAX) {
+		VE_RPMLIB_ERR("Invalid number of threads: %d", threads->len);
+		errno = EPROTO;
+		retval = -EPROTO;
+		goto hndl_return;
+	}
+	VE_RPMLIB_DEBUG("Received %d threads of tgid %d, more = %d",
+			threads->len, tgid, threads->more);
+hndl_return:
+	VE_RPMLIB_TRACE("Exiting");
+	return retval;
+}
+
+/**
+ * @brief This function sends one chunk of batched register read to VEOS and
+ *	  scatters the received values to the entries of the chunk.
+ *
+ * @param nodeid[in] VE node ID
+ * @param ent[in/out] Entries included in the chunk
+ * @param req[in] Request built for the chunk
+ * @param res[out] Buffer to receive the reply
+ *
+ * @return 0 on success and negative value on failure
+ */
+static int ve_regvals_batch_chunk(int nodeid, struct ve_regvals_req **ent,
+				struct velib_regvals_batch_req *req,
+				struct velib_regvals_batch_res *res)
+{
+	int retval = -1;
+	int indx = 0;
+	int offset = 0;
+
+	retval = ve_message_send_receive(nodeid, VE_GET_REGVALS_BATCH,
+				req, sizeof(struct velib_regvals_batch_req),
+				res, sizeof(struct velib_regvals_batch_res));
+	if (0 > retval)
+		return retval;
+	if (res->nent != req->nent) {
+		VE_RPMLIB_ERR("Invalid number of entries: %d (sent %d)",
+				res->nent, req->nent);
+		errno = EPROTO;
+		return -EPROTO;
+	}
+	for (indx = 0; indx < req->nent; indx++) {
+		ent[indx]->status = res->status[indx];
+		if (!res->status[indx])
+			memcpy(ent[indx]->regval, &res->regval[offset],
+				sizeof(uint64_t) * ent[indx]->numregs);
+		offset += ent[indx]->numregs;
+	}
+	return 0;
+}
+
+/**
+ * @brief This function is used to get the register values of several VE
+ *	  processes with as few exchanges with VEOS as possible.
+ *
+ *	  Entries are packed into chunks of up to VE_REGVALS_BATCH_ENT
+ *	  processes and VE_REGVALS_BATCH_REGS registers, so the number of
+ *	  round trips does not grow with the number of processes for a
+ *	  typical sampling set. The result of each process is reported in
+ *	  its 'status'; a process which exited does not fail the call.
+ *
+ * @param nodeid[in] VE node ID
+ * @param nent[in] Number of entries in 'req'
+ * @param req[in/out] PIDs and registers to read, values and status are
+ *		      returned in the same entries
+ *
+ * @return 0 on success and negative value on failure
+ */
+int ve_get_regvals_batch(int nodeid, int nent, struct ve_regvals_req *req)
+{
+	int retval = -1;
+	int indx = 0;
+	int nregs = 0;
+	struct ve_regvals_req *ent[VE_REGVALS_BATCH_ENT] = {NULL};
+	struct velib_regvals_batch_req *breq = NULL;
+	struct velib_regvals_batch_res *bres = NULL;
+
+	VE_RPMLIB_TRACE("Entering");
+	if (!req || nent < 1) {
+		VE_RPMLIB_ERR("Wrong argument received: req = %p, nent = %d",
+				req, nent);
+		errno = EINVAL;
+		retval = -EINVAL;
+		goto hndl_return;
+	}
+	breq = calloc(1, sizeof(struct velib_regvals_batch_req));
+	bres = calloc(1, sizeof(struct velib_regvals_batch_res));
+	if (!breq || !bres) {
+		VE_RPMLIB_ERR("Memory allocation failed: %s",
+				strerror(errno));
+		retval = -errno;
+		goto hndl_free;
+	}
+
+	for (indx = 0; indx < nent; indx++) {
+		if (0 >= req[indx].pid || !req[indx].regid ||
+				!req[indx].regval || req[indx].numregs < 1 ||
+				req[indx].numregs > VE_MAX_REGVALS) {
+			VE_RPMLIB_DEBUG("Skipping invalid entry %d of pid %d",
+					indx, req[indx].pid);
+			req[indx].status = -EINVAL;
+			continue;
+		}
+		/* Flush the chunk if this entry does not fit in it */
+		if (breq->nent == VE_REGVALS_BATCH_ENT ||
+			nregs + req[indx].numregs > VE_REGVALS_BATCH_REGS) {
+			retval = ve_regvals_batch_chunk(nodeid, ent, breq, bres);
+			if (0 > retval)
+				goto hndl_fail;
+			breq->nent = 0;
+			nregs = 0;
+		}
+		ent[breq->nent] = &req[indx];
+		breq->ent[breq->nent].pid = req[indx].pid;
+		breq->ent[breq->nent].numregs = req[indx].numregs;
+		memcpy(&breq->regid[nregs], req[indx].regid,
+			sizeof(int) * req[indx].numregs);
+		nregs += req[indx].numregs;
+		breq->nent++;
+	}
+	retval = 0;
+	if (breq->nent) {
+		retval = ve_regvals_batch_chunk(nodeid, ent, breq, bres);
+		if (0 > retval)
+			goto hndl_fail;
+	}
+	VE_RPMLIB_DEBUG("Read registers of %d processes", nent);
+	goto hndl_free;
+
+hndl_fail:
+	/* Entries of the failed chunk and the ones after it are not read */
+	for (; breq->nent > 0; breq->nent--)
+		ent[breq->nent - 1]->status = retval;
+	for (; indx < nent; indx++)
+		req[indx].status = retval;
+hndl_free:
+	free(breq);
+	free(bres);
+hndl_return:
+	VE_RPMLIB_TRACE("Exiting");
+	return retval;
+}
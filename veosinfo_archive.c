@@ -0,0 +1,873 @@
+/**
+ * Copyright (C) 2020 NEC Corporation
+ * This file is part of the VEOS information library.
+ *
+ * The VEOS information library is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either version
+ * 2.1 of the License, or (at your option) any later version.
+ *
+ * The VEOS information library is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with the VEOS information library; if not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+/**
+ * @file veosinfo_archive.c
+ * @brief Keeps CPU and memory samples of VE node in a compressed archive
+ *	  file for long-term history
+ *
+ *	  Samples are buffered and written as blocks. A block stores each
+ *	  column (timestamp, counter of a core, memory field) contiguously:
+ *	  timestamps as delta-of-delta and values as the XOR of consecutive
+ *	  deltas, both zigzag and varint encoded, with runs of zeros folded
+ *	  into one token. Regular sampling and idle counters thus cost almost
+ *	  nothing. Every block starts with a header carrying its time range,
+ *	  so the index is rebuilt by walking the headers and a query decodes
+ *	  only the blocks overlapping the requested range.
+ *
+ * @internal
+ * @author RPM command
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include "veosinfo.h"
+#include "veosinfo_log.h"
+#include "veosinfo_internal.h"
+
+#define VE_ARCHIVE_MAX_BLOCK	65536	/*!< Maximum nr of samples in block */
+#define VE_ARCHIVE_BLK_MAGIC	0x42414556	/*!< "VEAB" */
+#define VE_ARCHIVE_STAT_COLS	(10 * VE_MAX_CORE_PER_NODE + 6)
+#define VE_ARCHIVE_MEM_COLS	(sizeof(struct ve_meminfo) / \
+					sizeof(unsigned long))
+#define VE_ARCHIVE_NCOL		(VE_ARCHIVE_STAT_COLS + VE_ARCHIVE_MEM_COLS)
+/* A value takes at most 10 bytes, a run of zeros 11 bytes */
+#define VE_ARCHIVE_ENC_MAX(n)	(((size_t)VE_ARCHIVE_NCOL + 1) * (n) * 11)
+
+/**
+ * @brief Header of archive file
+ */
+struct ve_archive_file {
+	char magic[8];		/*!< VE_ARCHIVE_MAGIC */
+	uint32_t version;	/*!< VE_ARCHIVE_VERSION */
+	uint32_t ncol;		/*!< Number of columns of a sample */
+	int32_t nodeid;		/*!< VE node number */
+	uint32_t block;		/*!< Number of samples in full block */
+	uint64_t reserved[5];
+};
+
+/**
+ * @brief Header of block in archive file
+ */
+struct ve_archive_blk {
+	uint32_t magic;		/*!< VE_ARCHIVE_BLK_MAGIC */
+	uint32_t count;		/*!< Number of samples */
+	uint32_t len;		/*!< Length of encoded columns */
+	uint32_t sum;		/*!< FNV-1a hash of encoded columns */
+	uint64_t first;		/*!< Time of the first sample */
+	uint64_t last;		/*!< Time of the last sample */
+};
+
+/**
+ * @brief Index entry of a block
+ */
+struct ve_archive_idx {
+	off_t off;		/*!< Offset of block header */
+	uint32_t count;		/*!< Number of samples */
+	uint32_t len;		/*!< Length of encoded columns */
+	uint32_t sum;		/*!< FNV-1a hash of encoded columns */
+	uint64_t first;		/*!< Time of the first sample */
+	uint64_t last;		/*!< Time of the last sample */
+};
+
+/**
+ * @brief Archive handle
+ */
+struct ve_archive {
+	int fd;				/*!< Archive file */
+	bool writable;			/*!< Opened by ve_archive_create() */
+	int nodeid;			/*!< VE node number */
+	int block;			/*!< Number of samples in full block */
+	off_t end;			/*!< End of the last valid block */
+	struct ve_archive_idx *idx;	/*!< Index of blocks */
+	size_t nidx;			/*!< Number of blocks */
+	size_t cap;			/*!< Capacity of 'idx' */
+	uint64_t *time;			/*!< Times of buffered samples */
+	uint64_t *row;			/*!< Columns of buffered samples */
+	int npend;			/*!< Number of buffered samples */
+	unsigned char *enc;		/*!< Buffer of block being written */
+};
+
+/**
+ * @brief This function returns the FNV-1a hash of a buffer
+ */
+static uint32_t ve_archive_hash(const unsigned char *buf, size_t len)
+{
+	uint32_t hash = 2166136261U;
+	size_t i = 0;
+
+	for (i = 0; i < len; i++) {
+		hash ^= buf[i];
+		hash *= 16777619U;
+	}
+	return hash;
+}
+
+/**
+ * @brief This function converts a sample into columns
+ *
+ * @param smp[in] Sample
+ * @param row[out] VE_ARCHIVE_NCOL columns
+ */
+static void ve_archive_pack(const struct ve_archive_sample *smp,
+				uint64_t *row)
+{
+	const struct ve_statinfo *st = &smp->stat;
+	const unsigned long *mem = (const unsigned long *)&smp->mem;
+	int core = 0;
+	int i = 0;
+
+	for (core = 0; core < VE_MAX_CORE_PER_NODE; core++) {
+		row[0 * VE_MAX_CORE_PER_NODE + core] = st->user[core];
+		row[1 * VE_MAX_CORE_PER_NODE + core] = st->nice[core];
+		row[2 * VE_MAX_CORE_PER_NODE + core] = st->idle[core];
+		row[3 * VE_MAX_CORE_PER_NODE + core] = st->iowait[core];
+		row[4 * VE_MAX_CORE_PER_NODE + core] = st->sys[core];
+		row[5 * VE_MAX_CORE_PER_NODE + core] = st->hardirq[core];
+		row[6 * VE_MAX_CORE_PER_NODE + core] = st->softirq[core];
+		row[7 * VE_MAX_CORE_PER_NODE + core] = st->steal[core];
+		row[8 * VE_MAX_CORE_PER_NODE + core] = st->guest[core];
+		row[9 * VE_MAX_CORE_PER_NODE + core] = st->guest_nice[core];
+	}
+	row += 10 * VE_MAX_CORE_PER_NODE;
+	row[0] = st->intr;
+	row[1] = st->ctxt;
+	row[2] = st->running;
+	row[3] = st->blocked;
+	row[4] = st->btime;
+	row[5] = st->processes;
+	row += 6;
+	/* All the fields of struct ve_meminfo are unsigned long */
+	for (i = 0; i < VE_ARCHIVE_MEM_COLS; i++)
+		row[i] = mem[i];
+}
+
+/**
+ * @brief This function converts columns back into a sample
+ *
+ * @param row[in] VE_ARCHIVE_NCOL columns
+ * @param smp[out] Sample
+ */
+static void ve_archive_unpack(const uint64_t *row,
+				struct ve_archive_sample *smp)
+{
+	struct ve_statinfo *st = &smp->stat;
+	unsigned long *mem = (unsigned long *)&smp->mem;
+	int core = 0;
+	int i = 0;
+
+	for (core = 0; core < VE_MAX_CORE_PER_NODE; core++) {
+		st->user[core] = row[0 * VE_MAX_CORE_PER_NODE + core];
+		st->nice[core] = row[1 * VE_MAX_CORE_PER_NODE + core];
+		st->idle[core] = row[2 * VE_MAX_CORE_PER_NODE + core];
+		st->iowait[core] = row[3 * VE_MAX_CORE_PER_NODE + core];
+		st->sys[core] = row[4 * VE_MAX_CORE_PER_NODE + core];
+		st->hardirq[core] = row[5 * VE_MAX_CORE_PER_NODE + core];
+		st->softirq[core] = row[6 * VE_MAX_CORE_PER_NODE + core];
+		st->steal[core] = row[7 * VE_MAX_CORE_PER_NODE + core];
+		st->guest[core] = row[8 * VE_MAX_CORE_PER_NODE + core];
+		st->guest_nice[core] = row[9 * VE_MAX_CORE_PER_NODE + core];
+	}
+	row += 10 * VE_MAX_CORE_PER_NODE;
+	st->intr = row[0];
+	st->ctxt = row[1];
+	st->running = row[2];
+	st->blocked = row[3];
+	st->btime = row[4];
+	st->processes = row[5];
+	row += 6;
+	for (i = 0; i < VE_ARCHIVE_MEM_COLS; i++)
+		mem[i] = row[i];
+}
+
+/**
+ * @brief This function appends a varint to a buffer
+ *
+ * @return Pointer past the varint
+ */
+static unsigned char *ve_archive_put(unsigned char *p, uint64_t val)
+{
+	while (val >= 0x80) {
+		*p++ = (unsigned char)(val | 0x80);
+		val >>= 7;
+	}
+	*p++ = (unsigned char)val;
+	return p;
+}
+
+/**
+ * @brief This function reads a varint from a buffer
+ *
+ * @return Pointer past the varint, or NULL if it overruns 'end'
+ */
+static const unsigned char *ve_archive_get(const unsigned char *p,
+				const unsigned char *end, uint64_t *val)
+{
+	uint64_t v = 0;
+	int shift = 0;
+
+	for (; p < end && shift < 64; shift += 7) {
+		v |= (uint64_t)(*p & 0x7f) << shift;
+		if (!(*p++ & 0x80)) {
+			*val = v;
+			return p;
+		}
+	}
+	return NULL;
+}
+
+/**
+ * @brief This function encodes a column
+ *
+ *	  The first value is stored as is. For timestamps ('dod' is true)
+ *	  the following tokens are the zigzag of the change of delta,
+ *	  otherwise the XOR of the zigzag of consecutive deltas. A zero
+ *	  token is followed by the length of the run of zeros, no other
+ *	  varint starts with a zero byte.
+ *
+ * @param p[out] Buffer to append to
+ * @param val[in] Values of the column
+ * @param stride[in] Distance between consecutive values
+ * @param count[in] Number of values
+ * @param dod[in] Encode as delta-of-delta
+ *
+ * @return Pointer past the column
+ */
+static unsigned char *ve_archive_put_col(unsigned char *p,
+			const uint64_t *val, size_t stride, int count, bool dod)
+{
+	uint64_t prev = 0;
+	uint64_t tok = 0;
+	int64_t delta = 0;
+	int64_t zz = 0;
+	uint64_t run = 0;
+	int i = 0;
+
+	if (!count)
+		return p;
+	p = ve_archive_put(p, val[0]);
+	for (i = 1; i < count; i++) {
+		delta = (int64_t)(val[i * stride] - val[(i - 1) * stride]);
+		if (dod) {
+			zz = delta - (int64_t)prev;
+			tok = ((uint64_t)zz << 1) ^ (uint64_t)(zz >> 63);
+			prev = delta;
+		} else {
+			zz = ((uint64_t)delta << 1) ^ (uint64_t)(delta >> 63);
+			tok = (uint64_t)zz ^ prev;
+			prev = zz;
+		}
+		if (!tok) {
+			run++;
+			continue;
+		}
+		if (run) {
+			*p++ = 0;
+			p = ve_archive_put(p, run);
+			run = 0;
+		}
+		p = ve_archive_put(p, tok);
+	}
+	if (run) {
+		*p++ = 0;
+		p = ve_archive_put(p, run);
+	}
+	return p;
+}
+
+/**
+ * @brief This function decodes a column encoded by ve_archive_put_col()
+ *
+ * @return Pointer past the column, or NULL if the column is malformed
+ */
+static const unsigned char *ve_archive_get_col(const unsigned char *p,
+			const unsigned char *end, uint64_t *val, size_t stride,
+			int count, bool dod)
+{
+	uint64_t prev = 0;
+	uint64_t tok = 0;
+	uint64_t zz = 0;
+	int64_t delta = 0;
+	uint64_t run = 0;
+	int i = 0;
+
+	if (!count)
+		return p;
+	p = ve_archive_get(p, end, &val[0]);
+	for (i = 1; p && i < count; i++) {
+		if (run) {
+			run--;
+			tok = 0;
+		} else if (p < end && !*p) {
+			p = ve_archive_get(p + 1, end, &run);
+			if (!p || !run || run > (uint64_t)(count - i))
+				return NULL;
+			run--;
+			tok = 0;
+		} else {
+			p = ve_archive_get(p, end, &tok);
+			if (!p)
+				return NULL;
+		}
+		if (dod) {
+			delta = (int64_t)prev +
+				(int64_t)((tok >> 1) ^ -(tok & 1));
+			prev = delta;
+		} else {
+			zz = tok ^ prev;
+			prev = zz;
+			delta = (int64_t)((zz >> 1) ^ -(zz & 1));
+		}
+		val[i * stride] = val[(i - 1) * stride] + (uint64_t)delta;
+	}
+	if (run)
+		return NULL;
+	return p;
+}
+
+/**
+ * @brief This function adds a block to the index
+ *
+ * @return 0 on success and -1 on failure
+ */
+static int ve_archive_index(struct ve_archive *arch, off_t off,
+				const struct ve_archive_blk *blk)
+{
+	struct ve_archive_idx *idx = NULL;
+	size_t cap = 0;
+
+	if (arch->nidx == arch->cap) {
+		cap = arch->cap ? arch->cap * 2 : 64;
+		idx = realloc(arch->idx, cap * sizeof(struct ve_archive_idx));
+		if (!idx) {
+			VE_RPMLIB_ERR("Memory allocation failed: %s",
+					strerror(errno));
+			return -1;
+		}
+		arch->idx = idx;
+		arch->cap = cap;
+	}
+	idx = &arch->idx[arch->nidx++];
+	idx->off = off;
+	idx->count = blk->count;
+	idx->len = blk->len;
+	idx->sum = blk->sum;
+	idx->first = blk->first;
+	idx->last = blk->last;
+	return 0;
+}
+
+/**
+ * @brief This function opens an archive file and indexes its blocks
+ *
+ *	  The scan stops at the first block which is cut off or out of
+ *	  order, which is where a writer was interrupted. A writer truncates
+ *	  the file there and continues.
+ *
+ * @param path[in] Path of the archive file
+ * @param nodeid[in] VE node number of a new file, ignored by a reader
+ * @param block[in] Samples per block of a new file, ignored by a reader
+ * @param writable[in] Open for writing
+ *
+ * @return Archive handle on success and NULL on failure
+ */
+static struct ve_archive *ve_archive_load(const char *path, int nodeid,
+					int block, bool writable)
+{
+	struct ve_archive *arch = NULL;
+	struct ve_archive_file file = { {0} };
+	struct ve_archive_blk blk = {0};
+	struct stat st = {0};
+	off_t off = 0;
+	uint64_t last = 0;
+	ssize_t ret = 0;
+	int err = 0;
+
+	arch = calloc(1, sizeof(struct ve_archive));
+	if (!arch) {
+		VE_RPMLIB_ERR("Memory allocation failed: %s",
+				strerror(errno));
+		return NULL;
+	}
+	arch->writable = writable;
+	arch->fd = open(path, writable ? (O_RDWR | O_CREAT | O_CLOEXEC) :
+				(O_RDONLY | O_CLOEXEC), 0644);
+	if (0 > arch->fd || 0 > fstat(arch->fd, &st)) {
+		VE_RPMLIB_ERR("Failed(%s) to open archive file: %s",
+				strerror(errno), path);
+		goto hndl_free;
+	}
+	/* One writer per file, the lock is dropped when the file closes */
+	if (writable && 0 > flock(arch->fd, LOCK_EX | LOCK_NB)) {
+		VE_RPMLIB_ERR("Archive file is in use: %s", path);
+		errno = EBUSY;
+		goto hndl_free;
+	}
+	if (writable && !st.st_size) {
+		memcpy(file.magic, VE_ARCHIVE_MAGIC, sizeof(VE_ARCHIVE_MAGIC));
+		file.version = VE_ARCHIVE_VERSION;
+		file.ncol = VE_ARCHIVE_NCOL;
+		file.nodeid = nodeid;
+		file.block = block;
+		if (sizeof(file) != pwrite(arch->fd, &file, sizeof(file), 0)) {
+			VE_RPMLIB_ERR("Failed(%s) to initialize archive "
+					"file: %s", strerror(errno), path);
+			if (!errno)
+				errno = EIO;
+			goto hndl_free;
+		}
+		st.st_size = sizeof(file);
+	} else if (sizeof(file) != pread(arch->fd, &file, sizeof(file), 0) ||
+			memcmp(file.magic, VE_ARCHIVE_MAGIC,
+				sizeof(VE_ARCHIVE_MAGIC)) ||
+			VE_ARCHIVE_VERSION != file.version ||
+			VE_ARCHIVE_NCOL != file.ncol ||
+			!file.block || VE_ARCHIVE_MAX_BLOCK < file.block) {
+		VE_RPMLIB_ERR("Not an archive file: %s", path);
+		errno = EINVAL;
+		goto hndl_free;
+	} else if (writable && file.nodeid != nodeid) {
+		VE_RPMLIB_ERR("Archive file %s is of node %d, not %d",
+				path, file.nodeid, nodeid);
+		errno = EINVAL;
+		goto hndl_free;
+	}
+	arch->nodeid = file.nodeid;
+	arch->block = file.block;
+
+	for (off = sizeof(file); off < st.st_size;
+			off += sizeof(blk) + blk.len) {
+		ret = pread(arch->fd, &blk, sizeof(blk), off);
+		if (sizeof(blk) != ret || VE_ARCHIVE_BLK_MAGIC != blk.magic ||
+				!blk.count || blk.count > arch->block ||
+				blk.first > blk.last || blk.first < last ||
+				off + (off_t)sizeof(blk) + blk.len >
+				st.st_size)
+			break;
+		if (0 > ve_archive_index(arch, off, &blk))
+			goto hndl_free;
+		last = blk.last;
+	}
+	arch->end = off;
+	if (off < st.st_size) {
+		VE_RPMLIB_DEBUG("Archive file %s is cut off at %lld of %lld",
+				path, (long long)off, (long long)st.st_size);
+		if (writable && 0 > ftruncate(arch->fd, off)) {
+			VE_RPMLIB_ERR("Failed(%s) to truncate archive file: "
+					"%s", strerror(errno), path);
+			goto hndl_free;
+		}
+	}
+	if (writable) {
+		arch->time = calloc(arch->block, sizeof(uint64_t));
+		arch->row = calloc((size_t)arch->block * VE_ARCHIVE_NCOL,
+					sizeof(uint64_t));
+		arch->enc = malloc(sizeof(blk) +
+					VE_ARCHIVE_ENC_MAX(arch->block));
+		if (!arch->time || !arch->row || !arch->enc) {
+			VE_RPMLIB_ERR("Memory allocation failed: %s",
+					strerror(errno));
+			goto hndl_free;
+		}
+	}
+	VE_RPMLIB_DEBUG("Archive file %s of node %d has %zu blocks", path,
+			arch->nodeid, arch->nidx);
+	return arch;
+
+hndl_free:
+	err = errno;
+	if (0 <= arch->fd)
+		close(arch->fd);
+	free(arch->idx);
+	free(arch->time);
+	free(arch->row);
+	free(arch->enc);
+	free(arch);
+	errno = err;
+	return NULL;
+}
+
+/**
+ * @brief This function opens an archive file for appending samples
+ *
+ *	  An existing archive of the same node is continued, in which case
+ *	  its block size is kept. A handle must not be shared by threads
+ *	  without a lock.
+ *
+ * @param path[in] Path of the archive file
+ * @param nodeid[in] VE node number
+ * @param block[in] Number of samples per block of a new file, 0 for
+ *		    VE_ARCHIVE_BLOCK
+ *
+ * @return Archive handle on success and NULL on failure
+ */
+struct ve_archive *ve_archive_create(const char *path, int nodeid, int block)
+{
+	struct ve_archive *arch = NULL;
+
+	VE_RPMLIB_TRACE("Entering");
+	if (!path || 0 > block || VE_ARCHIVE_MAX_BLOCK < block) {
+		VE_RPMLIB_ERR("Wrong argument received: path = %p, block = %d",
+				path, block);
+		errno = EINVAL;
+		goto hndl_return;
+	}
+	arch = ve_archive_load(path, nodeid,
+				block ? block : VE_ARCHIVE_BLOCK, true);
+hndl_return:
+	VE_RPMLIB_TRACE("Exiting");
+	return arch;
+}
+
+/**
+ * @brief This function opens an archive file for queries
+ *
+ *	  Blocks written after the file was opened are not seen.
+ *
+ * @param path[in] Path of the archive file
+ *
+ * @return Archive handle on success and NULL on failure
+ */
+struct ve_archive *ve_archive_open(const char *path)
+{
+	struct ve_archive *arch = NULL;
+
+	VE_RPMLIB_TRACE("Entering");
+	if (!path) {
+		VE_RPMLIB_ERR("Wrong argument received: path = %p", path);
+		errno = EINVAL;
+		goto hndl_return;
+	}
+	arch = ve_archive_load(path, 0, 0, false);
+hndl_return:
+	VE_RPMLIB_TRACE("Exiting");
+	return arch;
+}
+
+/**
+ * @brief This function writes buffered samples to the archive as a block
+ *
+ * @param arch[in] Archive handle from ve_archive_create()
+ *
+ * @return 0 on success and -1 on failure
+ */
+int ve_archive_flush(struct ve_archive *arch)
+{
+	int retval = -1;
+	int col = 0;
+	struct ve_archive_blk *blk = NULL;
+	unsigned char *p = NULL;
+	ssize_t len = 0;
+
+	VE_RPMLIB_TRACE("Entering");
+	if (!arch || !arch->writable) {
+		VE_RPMLIB_ERR("Wrong argument received: arch = %p", arch);
+		errno = EINVAL;
+		goto hndl_return;
+	}
+	if (!arch->npend) {
+		retval = 0;
+		goto hndl_return;
+	}
+	blk = (struct ve_archive_blk *)arch->enc;
+	p = arch->enc + sizeof(struct ve_archive_blk);
+	p = ve_archive_put_col(p, arch->time, 1, arch->npend, true);
+	for (col = 0; col < VE_ARCHIVE_NCOL; col++)
+		p = ve_archive_put_col(p, arch->row + col, VE_ARCHIVE_NCOL,
+					arch->npend, false);
+	blk->magic = VE_ARCHIVE_BLK_MAGIC;
+	blk->count = arch->npend;
+	blk->len = p - arch->enc - sizeof(struct ve_archive_blk);
+	blk->sum = ve_archive_hash(arch->enc + sizeof(struct ve_archive_blk),
+					blk->len);
+	blk->first = arch->time[0];
+	blk->last = arch->time[arch->npend - 1];
+
+	len = p - arch->enc;
+	if (len != pwrite(arch->fd, arch->enc, len, arch->end)) {
+		VE_RPMLIB_ERR("Failed(%s) to write archive block",
+				strerror(errno));
+		if (!errno)
+			errno = EIO;
+		/* Drop the partial block so that the file stays valid */
+		if (0 > ftruncate(arch->fd, arch->end))
+			VE_RPMLIB_DEBUG("Failed(%s) to truncate archive file",
+					strerror(errno));
+		goto hndl_return;
+	}
+	if (0 > fdatasync(arch->fd))
+		VE_RPMLIB_DEBUG("Failed(%s) to sync archive file",
+				strerror(errno));
+	if (0 > ve_archive_index(arch, arch->end, blk))
+		goto hndl_return;
+	VE_RPMLIB_DEBUG("Archived %d samples into %zd bytes", arch->npend, len);
+	arch->end += len;
+	arch->npend = 0;
+	retval = 0;
+hndl_return:
+	VE_RPMLIB_TRACE("Exiting");
+	return retval;
+}
+
+/**
+ * @brief This function appends a sample to the archive
+ *
+ *	  The sample is buffered and written when a block is full. When
+ *	  that write fails, the full block is written again by the next
+ *	  call, which fails without storing its sample if it fails again.
+ *
+ * @param arch[in] Archive handle from ve_archive_create()
+ * @param smp[in] Sample, not older than the previous one
+ *
+ * @return 0 on success and -1 on failure
+ */
+int ve_archive_append(struct ve_archive *arch, struct ve_archive_sample *smp)
+{
+	uint64_t last = 0;
+
+	if (!arch || !arch->writable || !smp) {
+		VE_RPMLIB_ERR("Wrong argument received: arch = %p, smp = %p",
+				arch, smp);
+		errno = EINVAL;
+		return -1;
+	}
+	if (arch->npend)
+		last = arch->time[arch->npend - 1];
+	else if (arch->nidx)
+		last = arch->idx[arch->nidx - 1].last;
+	if (smp->time < last) {
+		VE_RPMLIB_ERR("Sample at %llu is older than %llu",
+				(unsigned long long)smp->time,
+				(unsigned long long)last);
+		errno = EINVAL;
+		return -1;
+	}
+	/* A block left full by a failed write is written first */
+	if (arch->npend == arch->block && 0 > ve_archive_flush(arch))
+		return -1;
+	arch->time[arch->npend] = smp->time;
+	ve_archive_pack(smp, arch->row + (size_t)arch->npend * VE_ARCHIVE_NCOL);
+	arch->npend++;
+	if (arch->npend == arch->block)
+		return ve_archive_flush(arch);
+	return 0;
+}
+
+/**
+ * @brief This function passes the samples in a block to the callback
+ *
+ * @param nemit[in/out] Number of samples passed so far
+ *
+ * @return true if the callback stopped the query and false otherwise
+ */
+static bool ve_archive_emit(const uint64_t *time, const uint64_t *row,
+			int count, uint64_t from, uint64_t to,
+			int (*cb)(struct ve_archive_sample *, void *),
+			void *arg, struct ve_archive_sample *smp, int *nemit)
+{
+	int i = 0;
+
+	for (i = 0; i < count && time[i] <= to; i++) {
+		if (time[i] < from)
+			continue;
+		smp->time = time[i];
+		ve_archive_unpack(row + (size_t)i * VE_ARCHIVE_NCOL, smp);
+		(*nemit)++;
+		if (cb(smp, arg))
+			return true;
+	}
+	return false;
+}
+
+/**
+ * @brief This function passes the samples in a time range to a callback
+ *
+ *	  Only the blocks overlapping the range are read. A block which
+ *	  fails its hash or does not decode is skipped, so the samples of
+ *	  the other blocks are still passed. Samples still buffered by a
+ *	  writer are included. The query stops when the callback returns
+ *	  non-zero.
+ *
+ * @param arch[in] Archive handle
+ * @param from[in] Start of range in nanoseconds
+ * @param to[in] End of range in nanoseconds, inclusive
+ * @param cb[in] Function called with each sample in time order
+ * @param arg[in] Argument passed to 'cb'
+ *
+ * @return Number of samples passed to 'cb' on success and -1 on failure
+ */
+int ve_archive_query(struct ve_archive *arch, uint64_t from, uint64_t to,
+		int (*cb)(struct ve_archive_sample *, void *), void *arg)
+{
+	int retval = -1;
+	int nemit = 0;
+	int col = 0;
+	size_t lo = 0;
+	size_t hi = 0;
+	size_t mid = 0;
+	size_t n = 0;
+	struct ve_archive_idx *idx = NULL;
+	struct ve_archive_sample *smp = NULL;
+	unsigned char *buf = NULL;
+	const unsigned char *p = NULL;
+	const unsigned char *end = NULL;
+	uint64_t *time = NULL;
+	uint64_t *row = NULL;
+
+	VE_RPMLIB_TRACE("Entering");
+	if (!arch || !cb || from > to) {
+		VE_RPMLIB_ERR("Wrong argument received: arch = %p, cb = %p",
+				arch, cb);
+		errno = EINVAL;
+		goto hndl_return;
+	}
+	smp = malloc(sizeof(struct ve_archive_sample));
+	buf = malloc(sizeof(struct ve_archive_blk) +
+			VE_ARCHIVE_ENC_MAX(arch->block));
+	time = malloc(arch->block * sizeof(uint64_t));
+	row = malloc((size_t)arch->block * VE_ARCHIVE_NCOL * sizeof(uint64_t));
+	if (!smp || !buf || !time || !row) {
+		VE_RPMLIB_ERR("Memory allocation failed: %s",
+				strerror(errno));
+		goto hndl_free;
+	}
+	memset(smp, '\0', sizeof(struct ve_archive_sample));
+
+	/* First block which ends at or after 'from' */
+	lo = 0;
+	hi = arch->nidx;
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (arch->idx[mid].last < from)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	for (n = lo; n < arch->nidx && arch->idx[n].first <= to; n++) {
+		idx = &arch->idx[n];
+		if ((ssize_t)idx->len != pread(arch->fd, buf, idx->len,
+				idx->off + sizeof(struct ve_archive_blk)) ||
+				ve_archive_hash(buf, idx->len) != idx->sum) {
+			VE_RPMLIB_ERR("Skipping unreadable archive block at "
+					"%lld", (long long)idx->off);
+			continue;
+		}
+		p = buf;
+		end = buf + idx->len;
+		p = ve_archive_get_col(p, end, time, 1, idx->count, true);
+		for (col = 0; p && col < VE_ARCHIVE_NCOL; col++)
+			p = ve_archive_get_col(p, end, row + col,
+					VE_ARCHIVE_NCOL, idx->count, false);
+		if (!p || p != end) {
+			VE_RPMLIB_ERR("Skipping corrupted archive block at "
+					"%lld", (long long)idx->off);
+			continue;
+		}
+		if (ve_archive_emit(time, row, idx->count, from, to, cb, arg,
+					smp, &nemit))
+			break;
+	}
+	if (n == arch->nidx || arch->idx[n].first > to)
+		ve_archive_emit(arch->time, arch->row, arch->npend, from, to,
+				cb, arg, smp, &nemit);
+	retval = nemit;
+hndl_free:
+	free(smp);
+	free(buf);
+	free(time);
+	free(row);
+hndl_return:
+	VE_RPMLIB_TRACE("Exiting");
+	return retval;
+}
+
+/**
+ * @brief This function returns statistics of the archive
+ *
+ * @param arch[in] Archive handle
+ * @param stat[out] Statistics, buffered samples included
+ *
+ * @return 0 on success and -1 on failure
+ */
+int ve_archive_stats(struct ve_archive *arch, struct ve_archive_stat *stat)
+{
+	size_t n = 0;
+
+	if (!arch || !stat) {
+		VE_RPMLIB_ERR("Wrong argument received: arch = %p, stat = %p",
+				arch, stat);
+		errno = EINVAL;
+		return -1;
+	}
+	memset(stat, '\0', sizeof(struct ve_archive_stat));
+	stat->nodeid = arch->nodeid;
+	stat->nblock = arch->nidx;
+	stat->bytes = arch->end;
+	for (n = 0; n < arch->nidx; n++)
+		stat->nsample += arch->idx[n].count;
+	stat->nsample += arch->npend;
+	if (arch->nidx) {
+		stat->first = arch->idx[0].first;
+		stat->last = arch->idx[arch->nidx - 1].last;
+	} else if (arch->npend) {
+		stat->first = arch->time[0];
+	}
+	if (arch->npend)
+		stat->last = arch->time[arch->npend - 1];
+	return 0;
+}
+
+/**
+ * @brief This function closes the archive
+ *
+ *	  Buffered samples of a writer are written first.
+ *
+ * @param arch[in] Archive handle
+ *
+ * @return 0 on success and -1 if the buffered samples were lost
+ */
+int ve_archive_close(struct ve_archive *arch)
+{
+	int retval = 0;
+
+	VE_RPMLIB_TRACE("Entering");
+	if (!arch) {
+		VE_RPMLIB_ERR("Wrong argument received: arch = %p", arch);
+		errno = EINVAL;
+		retval = -1;
+		goto hndl_return;
+	}
+	if (arch->writable && 0 > ve_archive_flush(arch))
+		retval = -1;
+	close(arch->fd);
+	free(arch->idx);
+	free(arch->time);
+	free(arch->row);
+	free(arch->enc);
+	free(arch);
+hndl_return:
+	VE_RPMLIB_TRACE("Exiting");
+	return retval;
+}
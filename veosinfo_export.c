@@ -0,0 +1,1037 @@
+/**
+ * Copyright (C) 2020 NEC Corporation
+ * This file is part of the VEOS information library.
+ *
+ * The VEOS information library is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either version
+ * 2.1 of the License, or (at your option) any later version.
+ *
+ * The VEOS information library is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with the VEOS information library; if not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+/**
+ * @file veosinfo_export.c
+ * @brief Serves the metrics of VE nodes and processes as OpenMetrics text
+ *
+ *	  A refresher thread fetches the metrics from VEOS and renders the
+ *	  whole exposition into a buffer which replaces the previous one.
+ *	  A server thread answers each scrape with the latest buffer, so a
+ *	  scrape never waits for VEOS.
+ *
+ * @internal
+ * @author RPM command
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/stat.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "veosinfo.h"
+#include "veosinfo_log.h"
+#include "veosinfo_internal.h"
+
+#define VE_EXPORT_REQ_LEN	1024	/*!< Longest request read */
+#define VE_EXPORT_TIMEOUT	2	/*!< Seconds a client may stall */
+#define VE_EXPORT_CONTENT_TYPE \
+	"application/openmetrics-text; version=1.0.0; charset=utf-8"
+
+/**
+ * @brief Rendered exposition shared by the refresher and the server
+ */
+struct ve_export_text {
+	int ref;		/*!< References, protected by 'lock' */
+	char *buf;		/*!< OpenMetrics text */
+	size_t len;		/*!< Length of 'buf' */
+};
+
+/**
+ * @brief Metrics of one VE node fetched by a refresh
+ */
+struct ve_export_node {
+	int nodeid;			/*!< VE node number */
+	int numcore;			/*!< Number of cores */
+	bool up;			/*!< Node information was fetched */
+	struct ve_node_snap snap;	/*!< Memory, CPU and load */
+	bool numa_ok;
+	struct ve_numa_stat numa;
+	bool swap_ok;
+	struct ve_swap_node_info swap;
+	bool temp_ok;
+	struct ve_pwr_temp temp;
+	bool fan_ok;
+	struct ve_pwr_fan fan;
+	bool volt_ok;
+	struct ve_pwr_voltage volt;
+	bool top_ok;			/*!< 'top' has been initialized */
+	struct ve_top top;		/*!< Top engine of the node */
+	int nproc;			/*!< Number of processes in 'proc' */
+};
+
+/**
+ * @brief State of the exporter
+ */
+struct ve_export {
+	struct ve_export_attr attr;	/*!< Attributes, defaults applied */
+	char *path;			/*!< Copy of Unix socket path */
+	int sock;			/*!< Listening socket */
+	int wake[2];			/*!< Pipe waking the server to stop */
+	pthread_t refresher;		/*!< Refresher thread */
+	pthread_t server;		/*!< Server thread */
+	pthread_mutex_t lock;		/*!< Protects 'stop' and 'text' */
+	pthread_cond_t cond;		/*!< Signals 'stop' */
+	bool stop;			/*!< Request the threads to stop */
+	struct ve_export_text *text;	/*!< Latest exposition */
+	struct ve_export_node *node;	/*!< Nodes, VE_MAX_NODE entries */
+	int nnode;			/*!< Number of nodes fetched */
+	struct ve_top_proc *proc;	/*!< Top processes of each node */
+	unsigned long dropped;		/*!< Series dropped by the limits */
+	double duration;		/*!< Seconds taken by last refresh */
+};
+
+/**
+ * @brief This function drops a reference to an exposition
+ *
+ * @param exp[in] Exporter
+ * @param text[in] Exposition
+ */
+static void ve_export_put(struct ve_export *exp, struct ve_export_text *text)
+{
+	bool last = false;
+
+	if (!text)
+		return;
+	pthread_mutex_lock(&exp->lock);
+	last = !--text->ref;
+	pthread_mutex_unlock(&exp->lock);
+	if (last) {
+		free(text->buf);
+		free(text);
+	}
+}
+
+/**
+ * @brief This function takes a reference to the latest exposition
+ *
+ * @param exp[in] Exporter
+ *
+ * @return Exposition, released by ve_export_put()
+ */
+static struct ve_export_text *ve_export_get(struct ve_export *exp)
+{
+	struct ve_export_text *text = NULL;
+
+	pthread_mutex_lock(&exp->lock);
+	text = exp->text;
+	text->ref++;
+	pthread_mutex_unlock(&exp->lock);
+	return text;
+}
+
+/**
+ * @brief This function replaces the latest exposition
+ *
+ * @param exp[in] Exporter
+ * @param buf[in] OpenMetrics text, owned by the exposition on success
+ * @param len[in] Length of 'buf'
+ *
+ * @return 0 on success and -1 on failure
+ */
+static int ve_export_publish(struct ve_export *exp, char *buf, size_t len)
+{
+	struct ve_export_text *text = NULL;
+	struct ve_export_text *old = NULL;
+
+	text = malloc(sizeof(struct ve_export_text));
+	if (!text) {
+		VE_RPMLIB_ERR("Memory allocation failed: %s",
+				strerror(errno));
+		return -1;
+	}
+	text->ref = 1;
+	text->buf = buf;
+	text->len = len;
+	pthread_mutex_lock(&exp->lock);
+	old = exp->text;
+	exp->text = text;
+	pthread_mutex_unlock(&exp->lock);
+	ve_export_put(exp, old);
+	return 0;
+}
+
+/**
+ * @brief This function writes a label value escaped as OpenMetrics
+ *	  requires
+ */
+static void ve_export_label(FILE *fp, const char *val)
+{
+	for (; *val; val++) {
+		if ('\\' == *val || '"' == *val)
+			fprintf(fp, "\\%c", *val);
+		else if ('\n' == *val)
+			fputs("\\n", fp);
+		else
+			fputc(*val, fp);
+	}
+}
+
+/**
+ * @brief This function writes the metadata of a metric family
+ */
+static void ve_export_family(FILE *fp, const char *name, const char *type,
+				const char *help)
+{
+	fprintf(fp, "# TYPE %s %s\n# HELP %s %s\n", name, type, name, help);
+}
+
+/**
+ * @brief This function returns how many of 'count' series a limit allows
+ *	  and accounts the dropped ones
+ */
+static int ve_export_limit(struct ve_export *exp, int count, int limit)
+{
+	if (limit <= 0 || count <= limit)
+		return count;
+	exp->dropped += count - limit;
+	return limit;
+}
+
+/**
+ * @brief This function fetches the metrics of one VE node
+ *
+ * @param exp[in] Exporter
+ * @param node[in/out] Node to fetch, 'nodeid' set by the caller
+ */
+static void ve_export_fetch(struct ve_export *exp, struct ve_export_node *node)
+{
+	int top = exp->attr.top;
+
+	node->up = !ve_core_info(node->nodeid, &node->numcore);
+	ve_node_snapshot(node->nodeid, VE_SNAP_ALL, &node->snap);
+	node->numa_ok = !ve_numa_info(node->nodeid, &node->numa);
+	node->swap_ok = !ve_swap_nodeinfo(node->nodeid, &node->swap);
+	node->temp_ok = !ve_read_temp(node->nodeid, &node->temp);
+	node->fan_ok = !ve_read_fan(node->nodeid, &node->fan);
+	node->volt_ok = !ve_read_voltage(node->nodeid, &node->volt);
+	node->nproc = 0;
+	if (0 > top)
+		return;
+	if (!node->top_ok && !ve_top_init(&node->top, node->nodeid, false))
+		node->top_ok = true;
+	if (!node->top_ok || 0 > ve_top_sample(&node->top)) {
+		/* Start over, the node may have been restarted */
+		if (node->top_ok)
+			ve_top_free(&node->top);
+		node->top_ok = false;
+		return;
+	}
+	/* Rates need two samples */
+	if (node->top.nsample < 2)
+		return;
+	node->nproc = ve_top_select(&node->top, VE_TOP_CPU,
+			exp->proc + (node - exp->node) * top, top);
+	if (0 > node->nproc)
+		node->nproc = 0;
+	if (node->nproc == top && node->top.nproc > top)
+		exp->dropped += node->top.nproc - top;
+}
+
+/**
+ * @brief This function writes the node metrics of the exposition
+ */
+static void ve_export_render_node(struct ve_export *exp, FILE *fp)
+{
+	static const struct {
+		const char *name;
+		size_t off;
+	} mem[] = {
+		{"total", offsetof(struct ve_meminfo, kb_main_total)},
+		{"used", offsetof(struct ve_meminfo, kb_main_used)},
+		{"free", offsetof(struct ve_meminfo, kb_main_free)},
+		{"shared", offsetof(struct ve_meminfo, kb_main_shared)},
+		{"buffers", offsetof(struct ve_meminfo, kb_main_buffers)},
+		{"cached", offsetof(struct ve_meminfo, kb_main_cached)},
+		{"swap_cached", offsetof(struct ve_meminfo, kb_swap_cached)},
+		{"swap_total", offsetof(struct ve_meminfo, kb_swap_total)},
+		{"swap_free", offsetof(struct ve_meminfo, kb_swap_free)},
+		{"active", offsetof(struct ve_meminfo, kb_active)},
+		{"inactive", offsetof(struct ve_meminfo, kb_inactive)},
+		{"dirty", offsetof(struct ve_meminfo, kb_dirty)},
+		{"committed_as", offsetof(struct ve_meminfo, kb_committed_as)},
+		{"hugepage_total", offsetof(struct ve_meminfo, hugepage_total)},
+		{"hugepage_free", offsetof(struct ve_meminfo, hugepage_free)},
+	};
+	static const char *mode[] = {"user", "nice", "idle", "iowait",
+					"system", "irq", "softirq", "steal"};
+	struct ve_export_node *node = NULL;
+	struct ve_statinfo *st = NULL;
+	unsigned long long cpu = 0;
+	int ncore = 0;
+	int indx = 0;
+	int core = 0;
+	int m = 0;
+
+	ve_export_family(fp, "ve_up", "gauge",
+			"Whether the VE node answered the last refresh");
+	for (indx = 0; indx < exp->nnode; indx++)
+		fprintf(fp, "ve_up{node=\"%d\"} %d\n", exp->node[indx].nodeid,
+				exp->node[indx].up);
+
+	ve_export_family(fp, "ve_memory_bytes", "gauge",
+			"Memory of VE node by field of /proc/meminfo");
+	for (indx = 0; indx < exp->nnode; indx++) {
+		node = &exp->node[indx];
+		if (!(node->snap.mask & VE_SNAP_MEM))
+			continue;
+		for (m = 0; m < sizeof(mem) / sizeof(mem[0]); m++)
+			fprintf(fp, "ve_memory_bytes{node=\"%d\",field=\"%s\"} "
+				"%lu\n", node->nodeid, mem[m].name,
+				*(unsigned long *)((char *)&node->snap.mem +
+					mem[m].off) * 1024);
+	}
+
+	ve_export_family(fp, "ve_cpu_seconds", "counter",
+			"Time spent by VE core in each mode");
+	for (indx = 0; indx < exp->nnode; indx++) {
+		node = &exp->node[indx];
+		if (!(node->snap.mask & VE_SNAP_STAT))
+			continue;
+		st = &node->snap.stat;
+		ncore = ve_export_limit(exp, node->numcore,
+					exp->attr.max_cores);
+		for (core = 0; core < ncore; core++) {
+			for (m = 0; m < sizeof(mode) / sizeof(mode[0]); m++) {
+				switch (m) {
+				case 0:
+					cpu = st->user[core];
+					break;
+				case 1:
+					cpu = st->nice[core];
+					break;
+				case 2:
+					cpu = st->idle[core];
+					break;
+				case 3:
+					cpu = st->iowait[core];
+					break;
+				case 4:
+					cpu = st->sys[core];
+					break;
+				case 5:
+					cpu = st->hardirq[core];
+					break;
+				case 6:
+					cpu = st->softirq[core];
+					break;
+				default:
+					cpu = st->steal[core];
+					break;
+				}
+				/* CPU times are in microseconds */
+				fprintf(fp, "ve_cpu_seconds_total{node=\"%d\","
+					"core=\"%d\",mode=\"%s\"} %llu.%06llu\n",
+					node->nodeid, core, mode[m],
+					cpu / 1000000, cpu % 1000000);
+			}
+		}
+		if (ncore < node->numcore)
+			exp->dropped += (unsigned long)(node->numcore - ncore) *
+					(sizeof(mode) / sizeof(mode[0]) - 1);
+	}
+
+	ve_export_family(fp, "ve_context_switches", "counter",
+			"Context switches of VE node");
+	for (indx = 0; indx < exp->nnode; indx++)
+		if (exp->node[indx].snap.mask & VE_SNAP_STAT)
+			fprintf(fp, "ve_context_switches_total{node=\"%d\"} "
+				"%u\n", exp->node[indx].nodeid,
+				exp->node[indx].snap.stat.ctxt);
+	ve_export_family(fp, "ve_interrupts", "counter",
+			"Interrupts of VE node");
+	for (indx = 0; indx < exp->nnode; indx++)
+		if (exp->node[indx].snap.mask & VE_SNAP_STAT)
+			fprintf(fp, "ve_interrupts_total{node=\"%d\"} %u\n",
+				exp->node[indx].nodeid,
+				exp->node[indx].snap.stat.intr);
+	ve_export_family(fp, "ve_forks", "counter",
+			"Processes created on VE node");
+	for (indx = 0; indx < exp->nnode; indx++)
+		if (exp->node[indx].snap.mask & VE_SNAP_STAT)
+			fprintf(fp, "ve_forks_total{node=\"%d\"} %u\n",
+				exp->node[indx].nodeid,
+				exp->node[indx].snap.stat.processes);
+	ve_export_family(fp, "ve_procs_running", "gauge",
+			"Processes running on VE node");
+	for (indx = 0; indx < exp->nnode; indx++)
+		if (exp->node[indx].snap.mask & VE_SNAP_STAT)
+			fprintf(fp, "ve_procs_running{node=\"%d\"} %u\n",
+				exp->node[indx].nodeid,
+				exp->node[indx].snap.stat.running);
+	ve_export_family(fp, "ve_procs_blocked", "gauge",
+			"Processes blocked on VE node");
+	for (indx = 0; indx < exp->nnode; indx++)
+		if (exp->node[indx].snap.mask & VE_SNAP_STAT)
+			fprintf(fp, "ve_procs_blocked{node=\"%d\"} %u\n",
+				exp->node[indx].nodeid,
+				exp->node[indx].snap.stat.blocked);
+	ve_export_family(fp, "ve_boot_time_seconds", "gauge",
+			"Boot time of VE node since the epoch");
+	for (indx = 0; indx < exp->nnode; indx++)
+		if (exp->node[indx].snap.mask & VE_SNAP_STAT)
+			fprintf(fp, "ve_boot_time_seconds{node=\"%d\"} %lu\n",
+				exp->node[indx].nodeid,
+				exp->node[indx].snap.stat.btime);
+
+	ve_export_family(fp, "ve_load", "gauge",
+			"Load average of VE node over 1, 5 and 15 minutes");
+	for (indx = 0; indx < exp->nnode; indx++) {
+		node = &exp->node[indx];
+		if (!(node->snap.mask & VE_SNAP_LOADAVG))
+			continue;
+		fprintf(fp, "ve_load{node=\"%d\",period=\"1m\"} %g\n"
+			"ve_load{node=\"%d\",period=\"5m\"} %g\n"
+			"ve_load{node=\"%d\",period=\"15m\"} %g\n",
+			node->nodeid, node->snap.loadavg.av_1,
+			node->nodeid, node->snap.loadavg.av_5,
+			node->nodeid, node->snap.loadavg.av_15);
+	}
+	ve_export_family(fp, "ve_tasks", "gauge",
+			"Threads and processes on VE node");
+	for (indx = 0; indx < exp->nnode; indx++)
+		if (exp->node[indx].snap.mask & VE_SNAP_LOADAVG)
+			fprintf(fp, "ve_tasks{node=\"%d\"} %d\n",
+				exp->node[indx].nodeid,
+				exp->node[indx].snap.loadavg.total_proc);
+
+	ve_export_family(fp, "ve_numa_memory_bytes", "gauge",
+			"Memory of NUMA node of VE node");
+	for (indx = 0; indx < exp->nnode; indx++) {
+		node = &exp->node[indx];
+		if (!node->numa_ok)
+			continue;
+		for (m = 0; m < node->numa.tot_numa_nodes &&
+				m < VE_NUMA_NUM; m++)
+			fprintf(fp, "ve_numa_memory_bytes{node=\"%d\",numa=\"%d\","
+				"field=\"total\"} %llu\n"
+				"ve_numa_memory_bytes{node=\"%d\",numa=\"%d\","
+				"field=\"free\"} %llu\n",
+				node->nodeid, m, node->numa.mem_size[m],
+				node->nodeid, m, node->numa.mem_free[m]);
+	}
+	ve_export_family(fp, "ve_swapped_bytes", "gauge",
+			"Memory of VE node swapped out");
+	for (indx = 0; indx < exp->nnode; indx++)
+		if (exp->node[indx].swap_ok)
+			fprintf(fp, "ve_swapped_bytes{node=\"%d\"} %llu\n",
+				exp->node[indx].nodeid,
+				exp->node[indx].swap.node_swapped_sz);
+}
+
+/**
+ * @brief This function writes the sensor and process metrics of the
+ *	  exposition
+ */
+static void ve_export_render_sensor(struct ve_export *exp, FILE *fp)
+{
+	struct ve_export_node *node = NULL;
+	struct ve_top_proc *proc = NULL;
+	int indx = 0;
+	int cnt = 0;
+	int i = 0;
+
+	ve_export_family(fp, "ve_temperature_celsius", "gauge",
+			"Temperature of VE node sensor");
+	for (indx = 0; indx < exp->nnode; indx++) {
+		node = &exp->node[indx];
+		if (!node->temp_ok)
+			continue;
+		cnt = ve_export_limit(exp, node->temp.count < MAX_POWER_DEV ?
+				node->temp.count : MAX_POWER_DEV,
+				exp->attr.max_sensors);
+		for (i = 0; i < cnt; i++) {
+			fprintf(fp, "ve_temperature_celsius{node=\"%d\","
+				"sensor=\"", node->nodeid);
+			ve_export_label(fp, node->temp.device_name[i]);
+			fprintf(fp, "\"} %g\n", node->temp.ve_temp[i]);
+		}
+	}
+	ve_export_family(fp, "ve_fan_rpm", "gauge", "Speed of VE node fan");
+	for (indx = 0; indx < exp->nnode; indx++) {
+		node = &exp->node[indx];
+		if (!node->fan_ok)
+			continue;
+		cnt = ve_export_limit(exp, node->fan.count < MAX_POWER_DEV ?
+				node->fan.count : MAX_POWER_DEV,
+				exp->attr.max_sensors);
+		for (i = 0; i < cnt; i++) {
+			fprintf(fp, "ve_fan_rpm{node=\"%d\",sensor=\"",
+				node->nodeid);
+			ve_export_label(fp, node->fan.device_name[i]);
+			fprintf(fp, "\"} %g\n", node->fan.fan_speed[i]);
+		}
+	}
+	ve_export_family(fp, "ve_voltage_volts", "gauge",
+			"Voltage of VE node sensor");
+	for (indx = 0; indx < exp->nnode; indx++) {
+		node = &exp->node[indx];
+		if (!node->volt_ok)
+			continue;
+		cnt = ve_export_limit(exp, node->volt.count < MAX_POWER_DEV ?
+				node->volt.count : MAX_POWER_DEV,
+				exp->attr.max_sensors);
+		for (i = 0; i < cnt; i++) {
+			fprintf(fp, "ve_voltage_volts{node=\"%d\",sensor=\"",
+				node->nodeid);
+			ve_export_label(fp, node->volt.device_name[i]);
+			fprintf(fp, "\"} %g\n", node->volt.cpu_volt[i]);
+		}
+	}
+	if (0 > exp->attr.top)
+		return;
+
+	ve_export_family(fp, "ve_process_cpu_ratio", "gauge",
+			"CPU utilization of top VE processes");
+	for (indx = 0; indx < exp->nnode; indx++) {
+		node = &exp->node[indx];
+		proc = exp->proc + indx * exp->attr.top;
+		for (i = 0; i < node->nproc; i++) {
+			fprintf(fp, "ve_process_cpu_ratio{node=\"%d\",pid=\"%d\","
+				"comm=\"", node->nodeid, proc[i].pid);
+			ve_export_label(fp, proc[i].cmd);
+			fprintf(fp, "\"} %g\n", proc[i].cpu / 100);
+		}
+	}
+	ve_export_family(fp, "ve_process_resident_bytes", "gauge",
+			"Resident memory of top VE processes");
+	for (indx = 0; indx < exp->nnode; indx++) {
+		node = &exp->node[indx];
+		proc = exp->proc + indx * exp->attr.top;
+		for (i = 0; i < node->nproc; i++) {
+			fprintf(fp, "ve_process_resident_bytes{node=\"%d\","
+				"pid=\"%d\",comm=\"", node->nodeid,
+				proc[i].pid);
+			ve_export_label(fp, proc[i].cmd);
+			fprintf(fp, "\"} %ld\n", proc[i].rss * 1024);
+		}
+	}
+}
+
+/**
+ * @brief This function fetches the metrics and publishes a new exposition
+ *
+ * @param exp[in] Exporter
+ */
+static void ve_export_refresh(struct ve_export *exp)
+{
+	struct timespec start = {0};
+	struct timespec end = {0};
+	struct timespec now = {0};
+	unsigned int nnode = 0;
+	int nodeid[VE_MAX_NODE] = {0};
+	int indx = 0;
+	int old = 0;
+	char *buf = NULL;
+	size_t len = 0;
+	FILE *fp = NULL;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	exp->dropped = 0;
+	if (0 > ve_get_nos(&nnode, nodeid)) {
+		VE_RPMLIB_DEBUG("Failed to get online VE nodes: %s",
+				strerror(errno));
+		nnode = 0;
+	}
+	nnode = ve_export_limit(exp, nnode, exp->attr.max_nodes);
+	/* Keep the top engine of a node which stays in the same entry */
+	for (indx = 0; indx < VE_MAX_NODE; indx++) {
+		if (exp->node[indx].top_ok && (indx >= nnode ||
+				exp->node[indx].nodeid != nodeid[indx])) {
+			ve_top_free(&exp->node[indx].top);
+			exp->node[indx].top_ok = false;
+		}
+	}
+	for (indx = 0; indx < nnode; indx++) {
+		exp->node[indx].nodeid = nodeid[indx];
+		ve_export_fetch(exp, &exp->node[indx]);
+	}
+	exp->nnode = nnode;
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	exp->duration = (end.tv_sec - start.tv_sec) +
+		(double)(end.tv_nsec - start.tv_nsec) / 1000000000;
+
+	fp = open_memstream(&buf, &len);
+	if (!fp) {
+		VE_RPMLIB_ERR("Failed(%s) to render metrics", strerror(errno));
+		return;
+	}
+	ve_export_render_node(exp, fp);
+	ve_export_render_sensor(exp, fp);
+	clock_gettime(CLOCK_REALTIME, &now);
+	ve_export_family(fp, "ve_exporter_refresh_duration_seconds", "gauge",
+			"Time taken by the last refresh from VEOS");
+	fprintf(fp, "ve_exporter_refresh_duration_seconds %.6f\n",
+			exp->duration);
+	ve_export_family(fp, "ve_exporter_refresh_timestamp_seconds", "gauge",
+			"Time of the last refresh since the epoch");
+	fprintf(fp, "ve_exporter_refresh_timestamp_seconds %ld.%03ld\n",
+			(long)now.tv_sec, now.tv_nsec / 1000000);
+	ve_export_family(fp, "ve_exporter_dropped_series", "gauge",
+			"Series left out by the cardinality limits");
+	fprintf(fp, "ve_exporter_dropped_series %lu\n", exp->dropped);
+	fputs("# EOF\n", fp);
+	old = ferror(fp);
+	if (fclose(fp) || old) {
+		VE_RPMLIB_ERR("Failed to render metrics");
+		free(buf);
+		return;
+	}
+	if (0 > ve_export_publish(exp, buf, len))
+		free(buf);
+	VE_RPMLIB_DEBUG("Rendered %zu bytes of %d nodes in %.6f s", len, nnode,
+			exp->duration);
+}
+
+/**
+ * @brief Refresher thread of the exporter
+ *
+ * @param arg[in] Exporter
+ *
+ * @return NULL
+ */
+static void *ve_export_refresher(void *arg)
+{
+	struct ve_export *exp = arg;
+	struct timespec next = {0};
+	struct timespec now = {0};
+
+	VE_RPMLIB_TRACE("Entering");
+	clock_gettime(CLOCK_MONOTONIC, &next);
+	pthread_mutex_lock(&exp->lock);
+	while (!exp->stop) {
+		pthread_mutex_unlock(&exp->lock);
+		ve_export_refresh(exp);
+
+		next.tv_sec += exp->attr.interval / 1000;
+		next.tv_nsec += (exp->attr.interval % 1000) * 1000000;
+		if (next.tv_nsec >= 1000000000) {
+			next.tv_nsec -= 1000000000;
+			next.tv_sec++;
+		}
+		/* Skip the ticks missed while VEOS was slow */
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		if (now.tv_sec > next.tv_sec || (now.tv_sec == next.tv_sec &&
+					now.tv_nsec > next.tv_nsec))
+			next = now;
+		pthread_mutex_lock(&exp->lock);
+		while (!exp->stop && ETIMEDOUT != pthread_cond_timedwait(
+					&exp->cond, &exp->lock, &next))
+			;
+	}
+	pthread_mutex_unlock(&exp->lock);
+	VE_RPMLIB_TRACE("Exiting");
+	return NULL;
+}
+
+/**
+ * @brief This function writes a whole buffer to a client
+ *
+ * @return 0 on success and -1 on failure
+ */
+static int ve_export_send(int fd, const char *buf, size_t len)
+{
+	ssize_t ret = 0;
+
+	while (len) {
+		ret = send(fd, buf, len, MSG_NOSIGNAL);
+		if (0 > ret && EINTR == errno)
+			continue;
+		if (0 >= ret)
+			return -1;
+		buf += ret;
+		len -= ret;
+	}
+	return 0;
+}
+
+/**
+ * @brief This function answers one scrape
+ *
+ *	  The request is HTTP, so that Prometheus can scrape the TCP socket
+ *	  and curl --unix-socket the Unix one.
+ *
+ * @param exp[in] Exporter
+ * @param fd[in] Connected client
+ */
+static void ve_export_serve(struct ve_export *exp, int fd)
+{
+	struct timeval tv = {VE_EXPORT_TIMEOUT, 0};
+	struct ve_export_text *text = NULL;
+	char req[VE_EXPORT_REQ_LEN + 1] = {0};
+	char hdr[256] = {0};
+	size_t len = 0;
+	ssize_t ret = 0;
+	int hlen = 0;
+
+	setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+	setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+	while (len < VE_EXPORT_REQ_LEN && !strstr(req, "\r\n\r\n") &&
+			!strstr(req, "\n\n")) {
+		ret = recv(fd, req + len, VE_EXPORT_REQ_LEN - len, 0);
+		if (0 > ret && EINTR == errno)
+			continue;
+		if (0 >= ret)
+			break;
+		len += ret;
+		req[len] = '\0';
+	}
+	if (strncmp(req, "GET ", 4)) {
+		VE_RPMLIB_DEBUG("Rejected a request which is not GET");
+		hlen = snprintf(hdr, sizeof(hdr), "HTTP/1.0 405 Method Not "
+				"Allowed\r\nContent-Length: 0\r\n"
+				"Connection: close\r\n\r\n");
+		ve_export_send(fd, hdr, hlen);
+		return;
+	}
+	text = ve_export_get(exp);
+	hlen = snprintf(hdr, sizeof(hdr), "HTTP/1.0 200 OK\r\n"
+			"Content-Type: " VE_EXPORT_CONTENT_TYPE "\r\n"
+			"Content-Length: %zu\r\nConnection: close\r\n\r\n",
+			text->len);
+	if (0 > ve_export_send(fd, hdr, hlen) ||
+			0 > ve_export_send(fd, text->buf, text->len))
+		VE_RPMLIB_DEBUG("Failed(%s) to send metrics", strerror(errno));
+	ve_export_put(exp, text);
+}
+
+/**
+ * @brief Server thread of the exporter
+ *
+ *	  Scrapes are answered one at a time from the cached exposition, a
+ *	  client stalling longer than VE_EXPORT_TIMEOUT is dropped.
+ *
+ * @param arg[in] Exporter
+ *
+ * @return NULL
+ */
+static void *ve_export_server(void *arg)
+{
+	struct ve_export *exp = arg;
+	struct pollfd pfd[2];
+	int fd = -1;
+
+	VE_RPMLIB_TRACE("Entering");
+	pfd[0].fd = exp->sock;
+	pfd[0].events = POLLIN;
+	pfd[1].fd = exp->wake[0];
+	pfd[1].events = POLLIN;
+	for (;;) {
+		if (0 > poll(pfd, 2, -1)) {
+			if (EINTR == errno)
+				continue;
+			VE_RPMLIB_ERR("Failed(%s) to wait for scrapes",
+					strerror(errno));
+			break;
+		}
+		if (pfd[1].revents)
+			break;
+		if (!(pfd[0].revents & POLLIN))
+			continue;
+		fd = accept4(exp->sock, NULL, NULL, SOCK_CLOEXEC);
+		if (0 > fd) {
+			VE_RPMLIB_DEBUG("Failed(%s) to accept scrape",
+					strerror(errno));
+			continue;
+		}
+		ve_export_serve(exp, fd);
+		close(fd);
+	}
+	VE_RPMLIB_TRACE("Exiting");
+	return NULL;
+}
+
+/**
+ * @brief This function creates the listening socket
+ *
+ * @param exp[in/out] Exporter
+ *
+ * @return 0 on success and -1 on failure
+ */
+static int ve_export_listen(struct ve_export *exp)
+{
+	struct sockaddr_un sun = {0};
+	struct sockaddr_in sin = {0};
+	struct stat st = {0};
+	int one = 1;
+	int probe = -1;
+	bool bound = false;
+
+	if (exp->path) {
+		if (strlen(exp->path) >= sizeof(sun.sun_path)) {
+			VE_RPMLIB_ERR("Socket path too long: %s", exp->path);
+			errno = ENAMETOOLONG;
+			return -1;
+		}
+		sun.sun_family = AF_UNIX;
+		strncpy(sun.sun_path, exp->path, sizeof(sun.sun_path) - 1);
+		exp->sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+		probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+		if (0 > exp->sock || 0 > probe)
+			goto hndl_error;
+		/* A socket left by an exporter which died is replaced, a live
+		 * one is not */
+		if (!connect(probe, (struct sockaddr *)&sun, sizeof(sun))) {
+			errno = EADDRINUSE;
+			goto hndl_error;
+		}
+		/* Only a socket is replaced, never a file of another kind */
+		if (!lstat(exp->path, &st)) {
+			if (!S_ISSOCK(st.st_mode)) {
+				errno = EEXIST;
+				goto hndl_error;
+			}
+			unlink(exp->path);
+		}
+		if (0 > bind(exp->sock, (struct sockaddr *)&sun, sizeof(sun)))
+			goto hndl_error;
+		bound = true;
+	} else {
+		sin.sin_family = AF_INET;
+		sin.sin_port = htons(exp->attr.port);
+		sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		exp->sock = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+		if (0 > exp->sock)
+			goto hndl_error;
+		setsockopt(exp->sock, SOL_SOCKET, SO_REUSEADDR, &one,
+				sizeof(one));
+		if (0 > bind(exp->sock, (struct sockaddr *)&sin, sizeof(sin)))
+			goto hndl_error;
+	}
+	if (0 > listen(exp->sock, 16))
+		goto hndl_error;
+	if (0 <= probe)
+		close(probe);
+	return 0;
+hndl_error:
+	if (exp->path)
+		VE_RPMLIB_ERR("Failed(%s) to listen on %s", strerror(errno),
+				exp->path);
+	else
+		VE_RPMLIB_ERR("Failed(%s) to listen on 127.0.0.1:%d",
+				strerror(errno), exp->attr.port);
+	if (0 <= probe)
+		close(probe);
+	if (bound)
+		unlink(exp->path);
+	return -1;
+}
+
+/**
+ * @brief This function starts the OpenMetrics exporter
+ *
+ *	  Metrics are fetched from all online VE nodes every 'interval' and
+ *	  served over HTTP on a Unix socket or a loopback TCP port. Until
+ *	  the first refresh completes, scrapes get an empty exposition.
+ *
+ * @param attr[in] Attributes of the exporter
+ *
+ * @return Exporter on success and NULL on failure
+ */
+struct ve_export *ve_export_start(struct ve_export_attr *attr)
+{
+	struct ve_export *exp = NULL;
+	pthread_condattr_t cattr;
+	char *buf = NULL;
+	int ret = 0;
+
+	VE_RPMLIB_TRACE("Entering");
+	if (!attr || (!attr->path && (0 >= attr->port ||
+			65535 < attr->port)) || 0 > attr->interval ||
+			0 > attr->max_nodes || 0 > attr->max_cores ||
+			0 > attr->max_sensors || -1 > attr->top) {
+		VE_RPMLIB_ERR("Wrong argument received: attr = %p", attr);
+		errno = EINVAL;
+		goto hndl_return;
+	}
+	exp = calloc(1, sizeof(struct ve_export));
+	if (!exp) {
+		VE_RPMLIB_ERR("Memory allocation failed: %s",
+				strerror(errno));
+		goto hndl_return;
+	}
+	exp->sock = -1;
+	exp->wake[0] = exp->wake[1] = -1;
+	exp->attr = *attr;
+	if (!exp->attr.interval)
+		exp->attr.interval = VE_EXPORT_DEF_INTERVAL;
+	if (!exp->attr.top)
+		exp->attr.top = VE_EXPORT_DEF_TOP;
+	exp->attr.path = NULL;
+	if (attr->path)
+		exp->path = strdup(attr->path);
+	exp->node = calloc(VE_MAX_NODE, sizeof(struct ve_export_node));
+	if (0 < exp->attr.top)
+		exp->proc = calloc((size_t)VE_MAX_NODE * exp->attr.top,
+				sizeof(struct ve_top_proc));
+	buf = strdup("# EOF\n");
+	if ((attr->path && !exp->path) || !exp->node ||
+			(0 < exp->attr.top && !exp->proc) || !buf) {
+		VE_RPMLIB_ERR("Memory allocation failed: %s",
+				strerror(errno));
+		goto hndl_free;
+	}
+	pthread_mutex_init(&exp->lock, NULL);
+	if (0 > ve_export_publish(exp, buf, strlen(buf)))
+		goto hndl_destroy;
+	buf = NULL;
+	if (0 > pipe2(exp->wake, O_CLOEXEC)) {
+		VE_RPMLIB_ERR("Failed(%s) to create pipe", strerror(errno));
+		goto hndl_destroy;
+	}
+	if (0 > ve_export_listen(exp))
+		goto hndl_destroy;
+
+	pthread_condattr_init(&cattr);
+	pthread_condattr_setclock(&cattr, CLOCK_MONOTONIC);
+	pthread_cond_init(&exp->cond, &cattr);
+	pthread_condattr_destroy(&cattr);
+	ret = pthread_create(&exp->server, NULL, ve_export_server, exp);
+	if (ret) {
+		VE_RPMLIB_ERR("Failed to create server thread: %s",
+				strerror(ret));
+		pthread_cond_destroy(&exp->cond);
+		errno = ret;
+		goto hndl_destroy;
+	}
+	ret = pthread_create(&exp->refresher, NULL, ve_export_refresher, exp);
+	if (ret) {
+		VE_RPMLIB_ERR("Failed to create refresher thread: %s",
+				strerror(ret));
+		if (0 > write(exp->wake[1], "", 1))
+			VE_RPMLIB_DEBUG("Failed(%s) to wake server",
+					strerror(errno));
+		pthread_join(exp->server, NULL);
+		pthread_cond_destroy(&exp->cond);
+		errno = ret;
+		goto hndl_destroy;
+	}
+	VE_RPMLIB_DEBUG("Exporting metrics every %d ms", exp->attr.interval);
+	goto hndl_return;
+
+hndl_destroy:
+	ret = errno;
+	if (0 <= exp->sock)
+		close(exp->sock);
+	if (0 <= exp->wake[0]) {
+		close(exp->wake[0]);
+		close(exp->wake[1]);
+	}
+	if (exp->text) {
+		free(exp->text->buf);
+		free(exp->text);
+	}
+	pthread_mutex_destroy(&exp->lock);
+	errno = ret;
+hndl_free:
+	ret = errno;
+	free(buf);
+	free(exp->path);
+	free(exp->node);
+	free(exp->proc);
+	free(exp);
+	exp = NULL;
+	errno = ret;
+hndl_return:
+	VE_RPMLIB_TRACE("Exiting");
+	return exp;
+}
+
+/**
+ * @brief This function writes the latest exposition to a stream
+ *
+ *	  It serves the same text as a scrape, e.g. for a textfile
+ *	  collector.
+ *
+ * @param exp[in] Exporter
+ * @param fp[in] Stream to write to
+ *
+ * @return 0 on success and -1 on failure
+ */
+int ve_export_write(struct ve_export *exp, FILE *fp)
+{
+	int retval = 0;
+	struct ve_export_text *text = NULL;
+
+	if (!exp || !fp) {
+		VE_RPMLIB_ERR("Wrong argument received: exp = %p, fp = %p",
+				exp, fp);
+		errno = EINVAL;
+		return -1;
+	}
+	text = ve_export_get(exp);
+	if (text->len != fwrite(text->buf, 1, text->len, fp))
+		retval = -1;
+	ve_export_put(exp, text);
+	return retval;
+}
+
+/**
+ * @brief This function stops the exporter and releases it
+ *
+ * @param exp[in] Exporter
+ *
+ * @return 0 on success and -1 on failure
+ */
+int ve_export_stop(struct ve_export *exp)
+{
+	int indx = 0;
+
+	VE_RPMLIB_TRACE("Entering");
+	if (!exp) {
+		VE_RPMLIB_ERR("Wrong argument received: exp = %p", exp);
+		errno = EINVAL;
+		return -1;
+	}
+	pthread_mutex_lock(&exp->lock);
+	exp->stop = true;
+	pthread_cond_signal(&exp->cond);
+	pthread_mutex_unlock(&exp->lock);
+	if (0 > write(exp->wake[1], "", 1))
+		VE_RPMLIB_DEBUG("Failed(%s) to wake server", strerror(errno));
+	pthread_join(exp->refresher, NULL);
+	pthread_join(exp->server, NULL);
+	pthread_cond_destroy(&exp->cond);
+	close(exp->sock);
+	if (exp->path)
+		unlink(exp->path);
+	close(exp->wake[0]);
+	close(exp->wake[1]);
+	for (indx = 0; indx < VE_MAX_NODE; indx++)
+		if (exp->node[indx].top_ok)
+			ve_top_free(&exp->node[indx].top);
+	ve_export_put(exp, exp->text);
+	pthread_mutex_destroy(&exp->lock);
+	free(exp->path);
+	free(exp->node);
+	free(exp->proc);
+	free(exp);
+	VE_RPMLIB_TRACE("Exiting");
+	return 0;
+}
@@ -66,6 +66,19 @@
 					 */
 #define ELF_VE  251
 #define KB 1024
+#define VE_REGVALS_BATCH_ENT 128	/*!< Max nr of PIDs in one batch request */
+#define VE_REGVALS_BATCH_REGS 256	/*!< Max nr of registers in one batch
+					 * request */
+#define VE_SWAP_VL_CHUNK 96		/*!< Max nr of PIDs in one variable
+					 * length swap request */
+#define VE_CREATE_BATCH_ENT 16		/*!< Max nr of tasks in one batch
+					 * creation request */
+#define VE_AFFINITY_BATCH_ENT 128	/*!< Max nr of PIDs in one batch
+					 * affinity request */
+#define VE_PRLIMIT_BATCH_ENT 64		/*!< Max nr of entries in one batch
+					 * prlimit request */
+#define VE_LIMIT_OPT_CACHE 8		/*!< Max nr of VE_LIMIT_OPT values
+					 * kept parsed */
 
 /**
  * @brief RPM library specific structure to get the memory information of
@@ -202,6 +215,25 @@ struct velib_prlimit {
 					 */
 };
 
+/**
+ * @brief Structure to get/set the resource limits of several VE processes
+ *
+ * The same structure is used for the request and the reply.
+ */
+struct velib_prlimit_batch {
+	int nent;				/*!< Number of valid entries */
+	struct {
+		pid_t pid;			/*!< PID of VE process */
+		int resource;			/*!< Resource to get/set */
+		bool is_new_lim;		/*!< 'new_limit' is to be set */
+		int status;			/*!< 0 or negative errno, in
+						 * reply */
+		struct rlimit new_limit;	/*!< New soft and hard limits */
+		struct rlimit old_limit;	/*!< Previous soft and hard
+						 * limits, in reply */
+	} ent[VE_PRLIMIT_BATCH_ENT];
+};
+
 /**
  * @brief Structure to get/set CPU affinity
  */
@@ -230,6 +262,53 @@ struct velib_create_process {
 	int ppid; /* To store parent process id */
 };
 
+/**
+ * @brief Structure to create several processes in one request
+ *
+ * Only the first 'nent' entries are sent.
+ */
+struct velib_create_process_batch {
+	int vedl_fd;		/*!< FD from VE Driver, open in the caller */
+	struct rlimit ve_rlim[RLIM_NLIMITS]; /*!< Process limit of all tasks */
+	int nent;		/*!< Number of valid entries */
+	struct {
+		pid_t pid;		/*!< PID of process to create */
+		pid_t ppid;		/*!< Parent PID of the process */
+		int flag;		/*!< As per "enum create_task_flag" */
+		int numa_num;		/*!< NUMA node number */
+		int membind_flag;	/*!< Memory policy */
+		bool cpu_mask_flag;	/*!< 'set' is given */
+		cpu_set_t set;		/*!< CPU mask */
+	} ent[VE_CREATE_BATCH_ENT];
+};
+
+/**
+ * @brief Structure to get the result of a batch process creation
+ */
+struct velib_create_process_batch_res {
+	int nent;		/*!< Number of entries processed */
+	int retval[VE_CREATE_BATCH_ENT];	/*!<
+						 * PID created or negative
+						 * errno of each entry
+						 */
+};
+
+/**
+ * @brief Structure to get or set the CPU affinity of several VE processes
+ *
+ * The same structure is used for the request and the reply. Masks have
+ * one bit per VE core, VE_MAX_CORE_PER_NODE fitting in 64 bits, so that a
+ * chunk stays well below MAX_PROTO_MSG_SIZE.
+ */
+struct velib_affinity_batch {
+	int nent;			/*!< Number of valid entries */
+	struct {
+		pid_t pid;		/*!< PID of VE process */
+		int status;		/*!< 0 or negative errno, in reply */
+		uint64_t mask;		/*!< Affinity mask */
+	} ent[VE_AFFINITY_BATCH_ENT];
+};
+
 /**
  * @brief RPM library specific structure to get memory statistics of VE process
  */
@@ -305,6 +384,90 @@ struct ve_shm_info {
 	int nodeid;	/*!< VE Node ID */
 };
 
+/**
+ * @brief Structure to request the changes of VE process table from VEOS
+ */
+struct velib_proc_delta_req {
+	uint64_t generation;	/*!< Generation the client is synced to */
+	pid_t cursor;		/*!< Report tasks with PID greater than this */
+};
+
+/**
+ * @brief Structure to request the threads of VE thread group from VEOS
+ */
+struct velib_thread_info_req {
+	pid_t cursor;		/*!< Report threads with TID greater than this */
+};
+
+/**
+ * @brief Reply of VEOS decoded in place from its velib_connect envelope
+ */
+struct velib_reply {
+	int64_t retval;		/*!< Return value */
+	bool has_msg;		/*!< The reply carries a payload */
+	const uint8_t *msg;	/*!< Payload, inside the received buffer */
+	size_t len;		/*!< Length of the payload */
+};
+
+/**
+ * @brief Structure to request a swap operation on a chunk of VE processes
+ *
+ * Only the first 'num' PIDs are sent.
+ */
+struct velib_swap_vl_req {
+	size_t required_free_size;	/*!< Required-free-size, 0 for none */
+	int num;			/*!< Number of PIDs */
+	pid_t pid[VE_SWAP_VL_CHUNK];	/*!< VE process ID array */
+};
+
+/**
+ * @brief Structure to get the swap information of a chunk of VE processes
+ *
+ * Only the first 'num' entries are received.
+ */
+struct velib_swap_vl_res {
+	int num;			/*!< Number of valid entries */
+	union {
+		struct ve_swap_status_struct status[VE_SWAP_VL_CHUNK];
+		struct ve_swap_struct info[VE_SWAP_VL_CHUNK];
+	} ent;				/*!< Entries as per sub-command */
+};
+
+/**
+ * @brief Structure to request the registers of several VE processes from
+ *	  VEOS in one exchange
+ *
+ * Register IDs of the entries are stored back to back in 'regid' in the
+ * order of 'ent'.
+ */
+struct velib_regvals_batch_req {
+	int nent;		/*!< Number of valid entries */
+	struct {
+		pid_t pid;	/*!< PID of VE process */
+		int numregs;	/*!< Number of registers of this process */
+	} ent[VE_REGVALS_BATCH_ENT];
+	int regid[VE_REGVALS_BATCH_REGS];	/*!< Register IDs */
+};
+
+/**
+ * @brief Structure to get the registers of several VE processes from VEOS
+ *
+ * Register values are stored back to back in the order of the request.
+ * Values of an entry whose status is not zero are undefined.
+ */
+struct velib_regvals_batch_res {
+	int nent;		/*!< Number of entries processed */
+	int status[VE_REGVALS_BATCH_ENT];	/*!< 0 or negative errno */
+	uint64_t regval[VE_REGVALS_BATCH_REGS];	/*!< Register values */
+};
+
+/* Registers read into struct ve_pmc_sample, in the order of its members */
+#define VE_PMC_NREGS	(VE_PMC_NUM + 2)
+extern int ve_pmc_regid[VE_PMC_NREGS];
+
+/* Parses the list of cores of a NUMA node */
+int ve_place_parse(const char *, size_t, int, cpu_set_t *);
+
 /* Memory policies */
 enum mempolicy {
 	MPOL_DEFAULT,
@@ -330,6 +493,18 @@ enum ve_rlim {
 	VE_RLIM_CNT
 };
 
+/**
+ * @brief Resource limits parsed from VE_LIMIT_OPT
+ */
+struct ve_limit_opt {
+	char *env;				/*!< VE_LIMIT_OPT parsed */
+	int retval;				/*!< 0 or error of parsing */
+	bool cur_set[RLIM_NLIMITS];		/*!< Soft limit is given */
+	bool max_set[RLIM_NLIMITS];		/*!< Hard limit is given */
+	struct rlimit rlim[RLIM_NLIMITS];	/*!< Limits given */
+	struct ve_limit_opt *next;		/*!< Superseded table */
+};
+
 int get_ve_rlimit(struct rlimit *);
 int ve_sysfs_path_info(int, const char *);
 int ve_cache_info(int, char [][VE_BUF_LEN], int *);
@@ -343,4 +518,6 @@ int get_yaml_data(char [][MAX_DEVICE_LEN], struct ve_pwr_mgmt_info *,
 						int, char *, int, int);
 int get_ve_limit_opt(char *, struct rlimit *);
 int get_value(char *, unsigned long long *);
+void ve_pmc_accumulate(struct ve_pmc_counts *, const struct ve_pmc_sample *,
+						const struct ve_pmc_sample *);
 #endif
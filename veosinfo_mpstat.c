@@ -0,0 +1,264 @@
+/**
+ * Copyright (C) 2020 NEC Corporation
+ * This file is part of the VEOS information library.
+ *
+ * The VEOS information library is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either version
+ * 2.1 of the License, or (at your option) any later version.
+ *
+ * The VEOS information library is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with the VEOS information library; if not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+/**
+ * @file veosinfo_mpstat.c
+ * @brief Computes per-core utilization of VE node from a ring of CPU
+ * statistics samples
+ *
+ * @internal
+ * @author RPM command
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include "veosinfo.h"
+#include "veosinfo_log.h"
+#include "veosinfo_internal.h"
+
+#define VE_MPSTAT_SLOT_LEN	(VE_MPSTAT_FIELDS * VE_MAX_CORE_PER_NODE)
+
+/**
+ * @brief This function initializes the mpstat engine for given VE node
+ *
+ * @param mp[out] mpstat engine to initialize
+ * @param nodeid[in] VE node number
+ * @param nslot[in] Number of samples to keep, at least 2; 0 for
+ *		    VE_MPSTAT_DEF_SLOTS
+ *
+ * @return 0 on success and -1 on failure
+ */
+int ve_mpstat_init(struct ve_mpstat *mp, int nodeid, int nslot)
+{
+	int retval = -1;
+
+	VE_RPMLIB_TRACE("Entering");
+	if (!mp || 0 > nslot || 1 == nslot) {
+		VE_RPMLIB_ERR("Wrong argument received: mp = %p, nslot = %d",
+				mp, nslot);
+		errno = EINVAL;
+		goto hndl_return;
+	}
+	memset(mp, '\0', sizeof(struct ve_mpstat));
+	mp->nodeid = nodeid;
+	mp->nslot = nslot ? nslot : VE_MPSTAT_DEF_SLOTS;
+	mp->head = -1;
+	if (-1 == ve_core_info(nodeid, &mp->numcore)) {
+		VE_RPMLIB_ERR("Failed to get CPU cores: %s", strerror(errno));
+		goto hndl_return;
+	}
+	mp->cpu = calloc((size_t)mp->nslot * VE_MPSTAT_SLOT_LEN,
+			sizeof(double));
+	mp->ctxt = calloc(mp->nslot, sizeof(double));
+	mp->intr = calloc(mp->nslot, sizeof(double));
+	mp->stamp = calloc(mp->nslot, sizeof(struct timespec));
+	if (!mp->cpu || !mp->ctxt || !mp->intr || !mp->stamp) {
+		VE_RPMLIB_ERR("Memory allocation failed: %s",
+				strerror(errno));
+		ve_mpstat_free(mp);
+		goto hndl_return;
+	}
+	retval = 0;
+hndl_return:
+	VE_RPMLIB_TRACE("Exiting");
+	return retval;
+}
+
+/**
+ * @brief This function adds a sample taken by the caller to the ring
+ *
+ *	  The sample is stamped with the current time, so it should be
+ *	  added right after ve_stat_info() returned it.
+ *
+ * @param mp[in/out] mpstat engine
+ * @param stat[in] CPU statistics of the node
+ *
+ * @return 0 on success and -1 on failure
+ */
+int ve_mpstat_add(struct ve_mpstat *mp, struct ve_statinfo *stat)
+{
+	int core = 0;
+	double *slot = NULL;
+
+	if (!mp || !mp->cpu || !stat) {
+		VE_RPMLIB_ERR("Wrong argument received: mp = %p, stat = %p",
+				mp, stat);
+		errno = EINVAL;
+		return -1;
+	}
+	mp->head = (mp->head + 1) % mp->nslot;
+	if (mp->count < mp->nslot)
+		mp->count++;
+	clock_gettime(CLOCK_MONOTONIC, &mp->stamp[mp->head]);
+	mp->ctxt[mp->head] = stat->ctxt;
+	mp->intr[mp->head] = stat->intr;
+
+	/* Transpose into per-field rows, guest time is also counted in user
+	 * time so it is taken out as mpstat does */
+	slot = mp->cpu + (size_t)mp->head * VE_MPSTAT_SLOT_LEN;
+	for (core = 0; core < VE_MAX_CORE_PER_NODE; core++) {
+		slot[VE_MPSTAT_USER * VE_MAX_CORE_PER_NODE + core] =
+			(double)stat->user[core] - stat->guest[core];
+		slot[VE_MPSTAT_NICE * VE_MAX_CORE_PER_NODE + core] =
+			(double)stat->nice[core] - stat->guest_nice[core];
+		slot[VE_MPSTAT_IDLE * VE_MAX_CORE_PER_NODE + core] =
+			stat->idle[core];
+		slot[VE_MPSTAT_IOWAIT * VE_MAX_CORE_PER_NODE + core] =
+			stat->iowait[core];
+		slot[VE_MPSTAT_SYS * VE_MAX_CORE_PER_NODE + core] =
+			stat->sys[core];
+		slot[VE_MPSTAT_IRQ * VE_MAX_CORE_PER_NODE + core] =
+			stat->hardirq[core];
+		slot[VE_MPSTAT_SOFT * VE_MAX_CORE_PER_NODE + core] =
+			stat->softirq[core];
+		slot[VE_MPSTAT_STEAL * VE_MAX_CORE_PER_NODE + core] =
+			stat->steal[core];
+		slot[VE_MPSTAT_GUEST * VE_MAX_CORE_PER_NODE + core] =
+			stat->guest[core];
+		slot[VE_MPSTAT_GNICE * VE_MAX_CORE_PER_NODE + core] =
+			stat->guest_nice[core];
+	}
+	return 0;
+}
+
+/**
+ * @brief This function takes a sample of the node and adds it to the ring
+ *
+ * @param mp[in/out] mpstat engine
+ *
+ * @return 0 on success and -1 on failure
+ */
+int ve_mpstat_sample(struct ve_mpstat *mp)
+{
+	int retval = -1;
+	struct ve_statinfo stat = { {0} };
+
+	VE_RPMLIB_TRACE("Entering");
+	if (!mp) {
+		VE_RPMLIB_ERR("Wrong argument received: mp = %p", mp);
+		errno = EINVAL;
+		goto hndl_return;
+	}
+	if (0 > ve_stat_info(mp->nodeid, &stat)) {
+		VE_RPMLIB_ERR("Failed to get CPU statistics: %s",
+				strerror(errno));
+		goto hndl_return;
+	}
+	retval = ve_mpstat_add(mp, &stat);
+hndl_return:
+	VE_RPMLIB_TRACE("Exiting");
+	return retval;
+}
+
+/**
+ * @brief This function computes the utilization between the latest sample
+ *	  and the sample 'lag' samples before it.
+ *
+ *	  The loops run over fixed size rows of all cores without branches,
+ *	  so the compiler can vectorize them.
+ *
+ * @param mp[in] mpstat engine
+ * @param lag[in] Number of samples back, from 1 to 'count' - 1
+ * @param res[out] Utilization in percent per core and over all cores
+ *
+ * @return 0 on success and -1 on failure
+ */
+int ve_mpstat_compute(struct ve_mpstat *mp, int lag,
+			struct ve_mpstat_result *res)
+{
+	int field = 0;
+	int core = 0;
+	int old = 0;
+	double d = 0;
+	double sum = 0;
+	double all_total = 0;
+	const double *cur = NULL;
+	const double *prev = NULL;
+	double delta[VE_MPSTAT_FIELDS][VE_MAX_CORE_PER_NODE];
+	double total[VE_MAX_CORE_PER_NODE] = {0};
+	double scale[VE_MAX_CORE_PER_NODE];
+
+	if (!mp || !res || lag < 1 || lag >= mp->count) {
+		VE_RPMLIB_ERR("Wrong argument received: mp = %p, res = %p, "
+				"lag = %d", mp, res, lag);
+		errno = EINVAL;
+		return -1;
+	}
+	old = (mp->head - lag + mp->nslot) % mp->nslot;
+	cur = mp->cpu + (size_t)mp->head * VE_MPSTAT_SLOT_LEN;
+	prev = mp->cpu + (size_t)old * VE_MPSTAT_SLOT_LEN;
+	res->interval = (mp->stamp[mp->head].tv_sec - mp->stamp[old].tv_sec) +
+		(double)(mp->stamp[mp->head].tv_nsec -
+			mp->stamp[old].tv_nsec) / 1000000000;
+
+	/* Counters going back after a VEOS restart count as no time */
+	for (field = 0; field < VE_MPSTAT_FIELDS; field++) {
+		for (core = 0; core < VE_MAX_CORE_PER_NODE; core++) {
+			d = cur[field * VE_MAX_CORE_PER_NODE + core] -
+				prev[field * VE_MAX_CORE_PER_NODE + core];
+			delta[field][core] = d > 0 ? d : 0;
+			total[core] += delta[field][core];
+		}
+	}
+	for (core = 0; core < VE_MAX_CORE_PER_NODE; core++)
+		scale[core] = total[core] > 0 ? 100 / total[core] : 0;
+	for (field = 0; field < VE_MPSTAT_FIELDS; field++)
+		for (core = 0; core < VE_MAX_CORE_PER_NODE; core++)
+			res->core[field][core] =
+				delta[field][core] * scale[core];
+
+	for (core = 0; core < mp->numcore; core++)
+		all_total += total[core];
+	for (field = 0; field < VE_MPSTAT_FIELDS; field++) {
+		sum = 0;
+		for (core = 0; core < mp->numcore; core++)
+			sum += delta[field][core];
+		res->all[field] = all_total > 0 ? sum * 100 / all_total : 0;
+	}
+	res->ctxt = 0;
+	res->intr = 0;
+	if (res->interval > 0) {
+		if (mp->ctxt[mp->head] >= mp->ctxt[old])
+			res->ctxt = (mp->ctxt[mp->head] - mp->ctxt[old]) /
+					res->interval;
+		if (mp->intr[mp->head] >= mp->intr[old])
+			res->intr = (mp->intr[mp->head] - mp->intr[old]) /
+					res->interval;
+	}
+	return 0;
+}
+
+/**
+ * @brief This function releases the memory held by mpstat engine
+ *
+ * @param mp[in] mpstat engine
+ */
+void ve_mpstat_free(struct ve_mpstat *mp)
+{
+	if (!mp)
+		return;
+	free(mp->cpu);
+	free(mp->ctxt);
+	free(mp->intr);
+	free(mp->stamp);
+	memset(mp, '\0', sizeof(struct ve_mpstat));
+}
@@ -0,0 +1,1029 @@
+/**
+ * Copyright (C) 2020 NEC Corporation
+ * This file is part of the VEOS information library.
+ *
+ * The VEOS information library is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either version
+ * 2.1 of the License, or (at your option) any later version.
+ *
+ * The VEOS information library is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with the VEOS information library; if not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+/**
+ * @file veosinfo_place.c
+ * @brief Advises the NUMA node and cores on which to create a VE process,
+ * and ranks the online VE nodes for a job
+ *
+ * @internal
+ * @author RPM command
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sched.h>
+#include <time.h>
+#include <pthread.h>
+#include "veosinfo.h"
+#include "veosinfo_log.h"
+#include "veosinfo_internal.h"
+
+/* Share of the load of the other cores of a NUMA node added to the cost
+ * of each requested core, as they compete for the same memory bandwidth */
+#define VE_PLACE_NUMA_WEIGHT	0.5
+
+/* Default weights of the score of node ranker */
+#define VE_RANK_W_LOAD	1.0
+#define VE_RANK_W_MEM	0.5
+#define VE_RANK_W_NUMA	0.3
+#define VE_RANK_W_SWAP	0.2
+
+/**
+ * @brief State of one VE node kept by node ranker
+ */
+struct ve_rank_node {
+	int nodeid;			/*!< VE node number */
+	bool valid;			/*!< State has been fetched */
+	int numcore;			/*!< Number of cores */
+	double load;			/*!< Busy cores, from load and runnable */
+	unsigned long long mem_total;	/*!< Memory in bytes */
+	unsigned long long mem_free;	/*!< Free memory in bytes */
+	int nnuma;			/*!< Number of NUMA nodes */
+	int numa_cores[VE_NUMA_NUM];	/*!< Cores of each NUMA node */
+	unsigned long long numa_free[VE_NUMA_NUM];/*!< Free memory of each
+						   * NUMA node */
+	unsigned long long swapped;	/*!< Memory swapped out in bytes */
+	struct timespec stamp;		/*!< CLOCK_MONOTONIC of refresh */
+};
+
+/**
+ * @brief State of node ranker
+ */
+struct ve_rank {
+	int interval;				/*!< Milliseconds between refreshes */
+	pthread_t thread;			/*!< Refresher thread */
+	pthread_mutex_t lock;			/*!< Protects the members below */
+	pthread_cond_t cond;			/*!< Signals 'stop' */
+	bool stop;				/*!< Request the refresher to stop */
+	struct ve_rank_weights weights;		/*!< Weights of the score */
+	int nnode;				/*!< Number of online nodes */
+	struct ve_rank_node node[VE_MAX_NODE];	/*!< State of the nodes */
+	struct ve_rank_node work[VE_MAX_NODE];	/*!< Nodes being refreshed */
+};
+
+/**
+ * @brief This function parses the list of cores of a NUMA node
+ *
+ *	  The list is as in /sys, e.g. "0-3,8-11", a space also separates
+ *	  the entries.
+ *
+ * @param list[in] List of cores, not necessarily terminated
+ * @param len[in] Size of 'list'
+ * @param numcore[in] Number of cores of VE node
+ * @param set[out] Cores of the NUMA node
+ *
+ * @return Number of cores on success and -1 if the list is malformed
+ */
+int ve_place_parse(const char *list, size_t len, int numcore, cpu_set_t *set)
+{
+	char buf[MAX_CORE_IN_NUMA_NODE * 4 + 1] = {0};
+	char *tok = NULL;
+	char *save = NULL;
+	char *end = NULL;
+	long first = 0;
+	long last = 0;
+
+	if (len >= sizeof(buf))
+		len = sizeof(buf) - 1;
+	memcpy(buf, list, len);
+	buf[len] = '\0';
+	CPU_ZERO(set);
+	for (tok = strtok_r(buf, ", \n", &save); tok;
+			tok = strtok_r(NULL, ", \n", &save)) {
+		first = strtol(tok, &end, 10);
+		last = first;
+		if ('-' == *end)
+			last = strtol(end + 1, &end, 10);
+		if (end == tok || *end || 0 > first || first > last ||
+				last >= numcore)
+			return -1;
+		for (; first <= last; first++)
+			CPU_SET(first, set);
+	}
+	return CPU_COUNT(set);
+}
+
+/**
+ * @brief This function returns the increase of a counter, counting from
+ *	  zero if it went back because VEOS restarted
+ */
+static double ve_place_delta(unsigned long long cur, unsigned long long prev)
+{
+	return (double)(cur >= prev ? cur - prev : cur);
+}
+
+/**
+ * @brief This function computes the load of each core
+ *
+ *	  The load of a core is its busy share since the previous advice,
+ *	  or since boot for the first one, but at least the number of tasks
+ *	  running on it, so that a job created just before counts too.
+ *
+ * @param place[in/out] Placement advisor
+ * @param load[out] Load per core
+ *
+ * @return 0 on success and -1 on failure
+ */
+static int ve_place_load(struct ve_place *place, double *load)
+{
+	struct ve_statinfo *cur = NULL;
+	struct ve_statinfo *prev = &place->stat;
+	struct ve_proc_entry *ent = NULL;
+	int running[VE_MAX_CORE_PER_NODE] = {0};
+	double busy = 0;
+	double total = 0;
+	int core = 0;
+	int indx = 0;
+
+	cur = malloc(sizeof(struct ve_statinfo));
+	if (!cur) {
+		VE_RPMLIB_ERR("Memory allocation failed: %s",
+				strerror(errno));
+		return -1;
+	}
+	if (0 > ve_stat_info(place->nodeid, cur)) {
+		VE_RPMLIB_ERR("Failed to get CPU statistics: %s",
+				strerror(errno));
+		free(cur);
+		return -1;
+	}
+	if (!place->have_stat)
+		memset(prev, '\0', sizeof(struct ve_statinfo));
+	for (core = 0; core < place->numcore; core++) {
+		busy = ve_place_delta(cur->user[core], prev->user[core]) +
+			ve_place_delta(cur->nice[core], prev->nice[core]) +
+			ve_place_delta(cur->sys[core], prev->sys[core]) +
+			ve_place_delta(cur->hardirq[core], prev->hardirq[core]) +
+			ve_place_delta(cur->softirq[core], prev->softirq[core]) +
+			ve_place_delta(cur->steal[core], prev->steal[core]);
+		total = busy + ve_place_delta(cur->idle[core], prev->idle[core]) +
+			ve_place_delta(cur->iowait[core], prev->iowait[core]);
+		load[core] = total > 0 ? busy / total : 0;
+	}
+	memcpy(prev, cur, sizeof(struct ve_statinfo));
+	place->have_stat = true;
+	free(cur);
+
+	/* Tasks are only an adjustment, a VEOS without the process table
+	 * still gets advice from the statistics */
+	if (0 > ve_proc_table_update(place->nodeid, &place->table)) {
+		VE_RPMLIB_DEBUG("Failed to update process table: %s",
+				strerror(errno));
+		return 0;
+	}
+	for (indx = 0; indx < place->table.len; indx++) {
+		ent = &place->table.entry[indx];
+		if ('R' == ent->state && 0 <= ent->processor &&
+				ent->processor < place->numcore)
+			running[ent->processor]++;
+	}
+	for (core = 0; core < place->numcore; core++)
+		if (load[core] < running[core])
+			load[core] = running[core];
+	return 0;
+}
+
+/**
+ * @brief This function picks the least loaded cores of a set
+ *
+ * @param load[in] Load per core
+ * @param numcore[in] Number of cores of VE node
+ * @param from[in] Cores to pick from
+ * @param ncores[in] Number of cores to pick
+ * @param set[out] Picked cores
+ *
+ * @return Sum of the load of the picked cores
+ */
+static double ve_place_pick(const double *load, int numcore,
+			const cpu_set_t *from, int ncores, cpu_set_t *set)
+{
+	int order[VE_MAX_CORE_PER_NODE] = {0};
+	int n = 0;
+	int core = 0;
+	int i = 0;
+	int j = 0;
+	double sum = 0;
+
+	/* Insertion sort by load, cores of equal load keep their order */
+	for (core = 0; core < numcore; core++) {
+		if (!CPU_ISSET(core, from))
+			continue;
+		for (j = n; j > 0 && load[order[j - 1]] > load[core]; j--)
+			order[j] = order[j - 1];
+		order[j] = core;
+		n++;
+	}
+	CPU_ZERO(set);
+	for (i = 0; i < ncores && i < n; i++) {
+		CPU_SET(order[i], set);
+		sum += load[order[i]];
+	}
+	return sum;
+}
+
+/**
+ * @brief This function initializes the placement advisor for given VE node
+ *
+ * @param place[out] Placement advisor to initialize
+ * @param nodeid[in] VE node number
+ *
+ * @return 0 on success and -1 on failure
+ */
+int ve_place_init(struct ve_place *place, int nodeid)
+{
+	int retval = -1;
+
+	VE_RPMLIB_TRACE("Entering");
+	if (!place) {
+		VE_RPMLIB_ERR("Wrong argument received: place = %p", place);
+		errno = EINVAL;
+		goto hndl_return;
+	}
+	memset(place, '\0', sizeof(struct ve_place));
+	place->nodeid = nodeid;
+	if (0 > ve_core_info(nodeid, &place->numcore)) {
+		VE_RPMLIB_ERR("Failed to get CPU cores: %s", strerror(errno));
+		goto hndl_return;
+	}
+	retval = 0;
+hndl_return:
+	VE_RPMLIB_TRACE("Exiting");
+	return retval;
+}
+
+/**
+ * @brief This function advises the NUMA node and cores for a VE process
+ *
+ *	  Among the NUMA nodes having enough cores and free memory, the one
+ *	  whose least loaded cores plus the pressure of the rest of the node
+ *	  cost least is selected and memory is bound to it. When no NUMA
+ *	  node fits, the least loaded cores of the whole VE node are
+ *	  selected and memory is not bound.
+ *
+ * @param place[in/out] Placement advisor
+ * @param req[in] Requested resources
+ * @param res[out] Advised placement
+ *
+ * @return 0 on success and -1 on failure
+ */
+int ve_place_advise(struct ve_place *place, struct ve_place_req *req,
+			struct ve_place_result *res)
+{
+	int retval = -1;
+	int nnuma = 0;
+	int n = 0;
+	int core = 0;
+	int ncore_numa[VE_NUMA_NUM] = {0};
+	unsigned long long mem_free[VE_NUMA_NUM] = {0};
+	cpu_set_t numa_set[VE_NUMA_NUM];
+	cpu_set_t all;
+	cpu_set_t set;
+	double load[VE_MAX_CORE_PER_NODE] = {0};
+	double numa_load = 0;
+	double sum = 0;
+	double cost = 0;
+	double best = 0;
+	struct ve_numa_stat numa = {0};
+	struct ve_meminfo mem = {0};
+
+	VE_RPMLIB_TRACE("Entering");
+	if (!place || !req || !res || 0 >= req->ncores ||
+			req->ncores > place->numcore) {
+		VE_RPMLIB_ERR("Wrong argument received: place = %p, req = %p, "
+				"res = %p", place, req, res);
+		errno = EINVAL;
+		goto hndl_return;
+	}
+	memset(res, '\0', sizeof(struct ve_place_result));
+	CPU_ZERO(&all);
+	for (core = 0; core < place->numcore; core++)
+		CPU_SET(core, &all);
+
+	if (!ve_numa_info(place->nodeid, &numa) && 0 < numa.tot_numa_nodes) {
+		nnuma = numa.tot_numa_nodes < VE_NUMA_NUM ?
+				numa.tot_numa_nodes : VE_NUMA_NUM;
+		for (n = 0; n < nnuma; n++) {
+			ncore_numa[n] = ve_place_parse(numa.ve_core[n],
+					sizeof(numa.ve_core[n]), place->numcore,
+					&numa_set[n]);
+			mem_free[n] = numa.mem_free[n];
+		}
+		/* Without a usable list the cores are split evenly */
+		for (n = 0; n < nnuma; n++) {
+			if (0 < ncore_numa[n])
+				continue;
+			CPU_ZERO(&numa_set[n]);
+			for (core = 0; core < place->numcore; core++)
+				if (core * nnuma / place->numcore == n)
+					CPU_SET(core, &numa_set[n]);
+			ncore_numa[n] = CPU_COUNT(&numa_set[n]);
+		}
+	} else {
+		VE_RPMLIB_DEBUG("No NUMA information, node %d is one NUMA "
+				"node", place->nodeid);
+		if (0 > ve_mem_info(place->nodeid, &mem))
+			goto hndl_return;
+		nnuma = 1;
+		numa_set[0] = all;
+		ncore_numa[0] = place->numcore;
+		mem_free[0] = (unsigned long long)mem.kb_main_free * 1024;
+	}
+	if (0 > ve_place_load(place, load))
+		goto hndl_return;
+
+	res->numa_num = -1;
+	for (n = 0; n < nnuma; n++) {
+		if (ncore_numa[n] < req->ncores || mem_free[n] < req->mem)
+			continue;
+		numa_load = 0;
+		for (core = 0; core < place->numcore; core++)
+			if (CPU_ISSET(core, &numa_set[n]))
+				numa_load += load[core];
+		sum = ve_place_pick(load, place->numcore, &numa_set[n],
+					req->ncores, &set);
+		cost = sum;
+		if (ncore_numa[n] > req->ncores)
+			cost += VE_PLACE_NUMA_WEIGHT * req->ncores *
+				(numa_load - sum) /
+				(ncore_numa[n] - req->ncores);
+		VE_RPMLIB_DEBUG("NUMA node %d: cost %f, free memory %llu", n,
+				cost, mem_free[n]);
+		if (-1 == res->numa_num || cost < best || (cost == best &&
+				mem_free[n] > mem_free[res->numa_num])) {
+			best = cost;
+			res->numa_num = n;
+			res->set = set;
+			res->load = sum;
+		}
+	}
+	if (-1 != res->numa_num) {
+		res->fits = true;
+		res->membind_flag = 0;
+	} else {
+		/* Span the node, memory starts on the NUMA node with the
+		 * most free memory */
+		res->fits = false;
+		res->membind_flag = 1;
+		res->numa_num = 0;
+		for (n = 1; n < nnuma; n++)
+			if (mem_free[n] > mem_free[res->numa_num])
+				res->numa_num = n;
+		res->load = ve_place_pick(load, place->numcore, &all,
+					req->ncores, &res->set);
+	}
+	VE_RPMLIB_DEBUG("Advised NUMA node %d (%s) with %d cores of load %f",
+			res->numa_num, res->fits ? "bound" : "spanning",
+			CPU_COUNT(&res->set), res->load);
+	retval = 0;
+hndl_return:
+	VE_RPMLIB_TRACE("Exiting");
+	return retval;
+}
+
+/**
+ * @brief This function creates a VE process where the advisor advises
+ *
+ * @param place[in/out] Placement advisor
+ * @param pid[in] Create process of given PID at VE
+ * @param flag[in] Identifier as specified in "enum create_task_flag"
+ * @param req[in] Requested resources
+ * @param res[out] Placement used, NULL if not needed
+ *
+ * @return PID of created process on success and -1 on failure
+ */
+int ve_place_create(struct ve_place *place, int pid, int flag,
+			struct ve_place_req *req, struct ve_place_result *res)
+{
+	int retval = -1;
+	struct ve_place_result tmp;
+
+	VE_RPMLIB_TRACE("Entering");
+	if (!res)
+		res = &tmp;
+	if (0 > ve_place_advise(place, req, res))
+		goto hndl_return;
+	retval = ve_create_process(place->nodeid, pid, flag, res->numa_num,
+				res->membind_flag, &res->set);
+hndl_return:
+	VE_RPMLIB_TRACE("Exiting");
+	return retval;
+}
+
+/**
+ * @brief This function releases the memory held by placement advisor
+ *
+ * @param place[in] Placement advisor
+ */
+void ve_place_free(struct ve_place *place)
+{
+	if (!place)
+		return;
+	ve_proc_table_free(&place->table);
+	memset(place, '\0', sizeof(struct ve_place));
+}
+
+/**
+ * @brief This function orders the cores of a VE node for pinning
+ *
+ *	  Cores are taken by ascending physical ID within each NUMA node.
+ *	  VE_PIN_COMPACT takes the NUMA nodes one after another,
+ *	  VE_PIN_SCATTER takes one core of each NUMA node in turn and
+ *	  VE_PIN_NUMA_LOCAL takes the cores of NUMA node 'numa' only.
+ *	  A core listed by several NUMA nodes is taken once.
+ *
+ * @param nodeid[in] VE node number
+ * @param policy[in] Pinning policy
+ * @param numa[in] NUMA node for VE_PIN_NUMA_LOCAL
+ * @param order[out] Logical core numbers, VE_MAX_CORE_PER_NODE entries
+ *
+ * @return Number of cores on success and -1 on failure
+ */
+static int ve_pin_order(int nodeid, enum ve_pin_policy policy, int numa,
+			int *order)
+{
+	int phy[VE_MAX_CORE_PER_NODE] = {0};
+	int list[VE_NUMA_NUM][VE_MAX_CORE_PER_NODE];
+	int nlist[VE_NUMA_NUM] = {0};
+	cpu_set_t numa_set[VE_NUMA_NUM];
+	cpu_set_t seen;
+	struct ve_numa_stat stat = {0};
+	int numcore = 0;
+	int nnuma = 1;
+	int norder = 0;
+	int core = 0;
+	int pos = 0;
+	int tmp = 0;
+	int n = 0;
+
+	numcore = ve_phy_core_map(nodeid, phy);
+	if (0 >= numcore) {
+		VE_RPMLIB_ERR("Failed to get cores of node %d", nodeid);
+		return -1;
+	}
+	if (!ve_numa_info(nodeid, &stat) && 0 < stat.tot_numa_nodes) {
+		nnuma = stat.tot_numa_nodes < VE_NUMA_NUM ?
+				stat.tot_numa_nodes : VE_NUMA_NUM;
+		for (n = 0; n < nnuma; n++) {
+			if (0 < ve_place_parse(stat.ve_core[n],
+					sizeof(stat.ve_core[n]), numcore,
+					&numa_set[n]))
+				continue;
+			/* Without a usable list the cores are split evenly */
+			CPU_ZERO(&numa_set[n]);
+			for (core = 0; core < numcore; core++)
+				if (core * nnuma / numcore == n)
+					CPU_SET(core, &numa_set[n]);
+		}
+	} else {
+		CPU_ZERO(&numa_set[0]);
+		for (core = 0; core < numcore; core++)
+			CPU_SET(core, &numa_set[0]);
+	}
+	if (VE_PIN_NUMA_LOCAL == policy && (0 > numa || numa >= nnuma)) {
+		VE_RPMLIB_ERR("Node %d has no NUMA node %d", nodeid, numa);
+		errno = EINVAL;
+		return -1;
+	}
+
+	for (n = 0; n < nnuma; n++) {
+		for (core = 0; core < numcore; core++) {
+			if (!CPU_ISSET(core, &numa_set[n]))
+				continue;
+			/* Insert by physical ID */
+			for (pos = nlist[n]++; pos > 0 &&
+					phy[list[n][pos - 1]] > phy[core]; pos--)
+				list[n][pos] = list[n][pos - 1];
+			list[n][pos] = core;
+		}
+	}
+	CPU_ZERO(&seen);
+	switch (policy) {
+	case VE_PIN_NUMA_LOCAL:
+		memcpy(order, list[numa], sizeof(int) * nlist[numa]);
+		norder = nlist[numa];
+		break;
+	case VE_PIN_SCATTER:
+		for (pos = 0; norder < numcore && pos < numcore; pos++) {
+			for (n = 0; norder < numcore && n < nnuma; n++) {
+				if (pos >= nlist[n] || CPU_ISSET(list[n][pos],
+							&seen))
+					continue;
+				CPU_SET(list[n][pos], &seen);
+				order[norder++] = list[n][pos];
+			}
+		}
+		break;
+	default:
+		for (n = 0; norder < numcore && n < nnuma; n++) {
+			for (pos = 0; norder < numcore && pos < nlist[n];
+					pos++) {
+				if (CPU_ISSET(list[n][pos], &seen))
+					continue;
+				CPU_SET(list[n][pos], &seen);
+				order[norder++] = list[n][pos];
+			}
+		}
+		break;
+	}
+	for (pos = 0; pos < norder; pos++) {
+		tmp = order[pos];
+		VE_RPMLIB_DEBUG("Core %d: logical %d, physical %d", pos, tmp,
+				phy[tmp]);
+	}
+	return norder;
+}
+
+/**
+ * @brief This function finds the NUMA node a thread group leader runs on
+ *
+ * @param nodeid[in] VE node number
+ * @param threads[in] Threads of the thread group
+ *
+ * @return NUMA node, 0 when unknown
+ */
+static int ve_pin_leader_numa(int nodeid, struct ve_thread_info *threads)
+{
+	struct ve_numa_stat stat = {0};
+	cpu_set_t set;
+	int numcore = 0;
+	int indx = 0;
+	int n = 0;
+
+	if (0 > ve_core_info(nodeid, &numcore) ||
+			ve_numa_info(nodeid, &stat))
+		return 0;
+	for (indx = 0; indx < threads->len; indx++)
+		if (threads->thread[indx].tid == threads->tgid)
+			break;
+	if (indx == threads->len)
+		return 0;
+	for (n = 0; n < stat.tot_numa_nodes && n < VE_NUMA_NUM; n++)
+		if (0 < ve_place_parse(stat.ve_core[n], sizeof(stat.ve_core[n]),
+					numcore, &set) &&
+				CPU_ISSET(threads->thread[indx].processor, &set))
+			return n;
+	return 0;
+}
+
+/**
+ * @brief This function pins each thread of a VE thread group to one core
+ *
+ *	  Threads are taken by TID and given the cores ordered as per
+ *	  'policy', wrapping around when there are more threads than cores.
+ *	  All masks are set with ve_sched_setaffinity_batch(); a thread
+ *	  which exited meanwhile is skipped.
+ *
+ * @param nodeid[in] VE node number
+ * @param tgid[in] Thread Group ID of VE process
+ * @param policy[in] Pinning policy as per "enum ve_pin_policy"
+ * @param numa[in] NUMA node for VE_PIN_NUMA_LOCAL, -1 for the one the
+ *		   thread group leader runs on
+ *
+ * @return Number of threads pinned on success and -1 on failure
+ */
+int ve_pin_threads(int nodeid, pid_t tgid, enum ve_pin_policy policy,
+			int numa)
+{
+	int retval = -1;
+	int order[VE_MAX_CORE_PER_NODE] = {0};
+	int norder = 0;
+	int nreq = 0;
+	int indx = 0;
+	pid_t cursor = 0;
+	struct ve_affinity_req *req = NULL;
+	struct ve_affinity_req *tmp = NULL;
+	struct ve_thread_info *threads = NULL;
+
+	VE_RPMLIB_TRACE("Entering");
+	if (0 >= tgid || VE_PIN_COMPACT > policy ||
+			VE_PIN_NUMA_LOCAL < policy || -1 > numa) {
+		VE_RPMLIB_ERR("Wrong argument received: tgid = %d, "
+				"policy = %d, numa = %d", tgid, policy, numa);
+		errno = EINVAL;
+		goto hndl_return;
+	}
+	threads = malloc(sizeof(struct ve_thread_info));
+	if (!threads) {
+		VE_RPMLIB_ERR("Memory allocation failed: %s",
+				strerror(errno));
+		goto hndl_return;
+	}
+	do {
+		if (0 > ve_thread_info(nodeid, tgid, cursor, threads))
+			goto hndl_free;
+		if (threads->more && threads->cursor <= cursor) {
+			VE_RPMLIB_ERR("Thread cursor of %d did not advance: %d",
+					tgid, threads->cursor);
+			errno = EPROTO;
+			goto hndl_free;
+		}
+		if (VE_PIN_NUMA_LOCAL == policy && -1 == numa && !cursor)
+			numa = ve_pin_leader_numa(nodeid, threads);
+		tmp = realloc(req, sizeof(struct ve_affinity_req) *
+					(nreq + threads->len + 1));
+		if (!tmp) {
+			VE_RPMLIB_ERR("Memory allocation failed: %s",
+					strerror(errno));
+			goto hndl_free;
+		}
+		req = tmp;
+		for (indx = 0; indx < threads->len; indx++)
+			req[nreq++].pid = threads->thread[indx].tid;
+		cursor = threads->cursor;
+	} while (threads->more);
+
+	norder = ve_pin_order(nodeid, policy, numa, order);
+	if (0 >= norder)
+		goto hndl_free;
+	for (indx = 0; indx < nreq; indx++) {
+		CPU_ZERO(&req[indx].mask);
+		CPU_SET(order[indx % norder], &req[indx].mask);
+		req[indx].status = 0;
+	}
+	retval = 0;
+	if (nreq && 0 > ve_sched_setaffinity_batch(nodeid, nreq, req)) {
+		retval = -1;
+		goto hndl_free;
+	}
+	for (indx = 0; indx < nreq; indx++) {
+		if (req[indx].status)
+			VE_RPMLIB_DEBUG("Failed to pin thread %d: %s",
+					req[indx].pid,
+					strerror(-req[indx].status));
+		else
+			retval++;
+	}
+	VE_RPMLIB_DEBUG("Pinned %d of %d threads of %d on %d cores", retval,
+			nreq, tgid, norder);
+hndl_free:
+	free(req);
+	free(threads);
+hndl_return:
+	VE_RPMLIB_TRACE("Exiting");
+	return retval;
+}
+
+/**
+ * @brief Thread refreshing the state of one VE node
+ *
+ *	  A metric which cannot be fetched keeps its previous value.
+ *
+ * @param arg[in] struct ve_rank_node to refresh, 'nodeid' set
+ *
+ * @return NULL
+ */
+static void *ve_rank_fetch(void *arg)
+{
+	struct ve_rank_node *node = arg;
+	struct ve_loadavg loadavg = {0};
+	struct ve_meminfo mem = {0};
+	struct ve_numa_stat numa = {0};
+	struct ve_swap_node_info swap = {0};
+	cpu_set_t set;
+	int n = 0;
+
+	if (0 > ve_core_info(node->nodeid, &node->numcore) ||
+			0 > ve_loadavg_info(node->nodeid, &loadavg) ||
+			0 > ve_mem_info(node->nodeid, &mem)) {
+		VE_RPMLIB_DEBUG("Failed to refresh node %d: %s",
+				node->nodeid, strerror(errno));
+		return NULL;
+	}
+	node->load = loadavg.av_1 > loadavg.runnable ? loadavg.av_1 :
+			loadavg.runnable;
+	node->mem_total = (unsigned long long)mem.kb_main_total * 1024;
+	node->mem_free = (unsigned long long)mem.kb_main_free * 1024;
+	if (!ve_numa_info(node->nodeid, &numa) && 0 < numa.tot_numa_nodes) {
+		node->nnuma = numa.tot_numa_nodes < VE_NUMA_NUM ?
+				numa.tot_numa_nodes : VE_NUMA_NUM;
+		for (n = 0; n < node->nnuma; n++) {
+			node->numa_cores[n] = ve_place_parse(numa.ve_core[n],
+					sizeof(numa.ve_core[n]), node->numcore,
+					&set);
+			if (0 >= node->numa_cores[n])
+				node->numa_cores[n] = node->numcore /
+							node->nnuma;
+			node->numa_free[n] = numa.mem_free[n];
+		}
+	} else {
+		node->nnuma = 1;
+		node->numa_cores[0] = node->numcore;
+		node->numa_free[0] = node->mem_free;
+	}
+	if (!ve_swap_nodeinfo(node->nodeid, &swap))
+		node->swapped = swap.node_swapped_sz;
+	clock_gettime(CLOCK_MONOTONIC, &node->stamp);
+	node->valid = true;
+	return NULL;
+}
+
+/**
+ * @brief This function refreshes the state of all online VE nodes
+ *	  concurrently and publishes it
+ *
+ * @param rank[in] Node ranker
+ */
+static void ve_rank_refresh(struct ve_rank *rank)
+{
+	unsigned int nnode = 0;
+	int nodeid[VE_MAX_NODE] = {0};
+	bool started[VE_MAX_NODE] = {false};
+	pthread_t thread[VE_MAX_NODE];
+	int indx = 0;
+	int old = 0;
+
+	if (0 > ve_get_nos(&nnode, nodeid)) {
+		VE_RPMLIB_DEBUG("Failed to get online VE nodes: %s",
+				strerror(errno));
+		return;
+	}
+	/* Start from the last state so that a failed fetch keeps it */
+	pthread_mutex_lock(&rank->lock);
+	for (indx = 0; indx < nnode; indx++) {
+		memset(&rank->work[indx], '\0', sizeof(struct ve_rank_node));
+		for (old = 0; old < rank->nnode; old++) {
+			if (rank->node[old].nodeid == nodeid[indx]) {
+				rank->work[indx] = rank->node[old];
+				break;
+			}
+		}
+		rank->work[indx].nodeid = nodeid[indx];
+	}
+	pthread_mutex_unlock(&rank->lock);
+
+	for (indx = 0; indx < nnode; indx++)
+		started[indx] = !pthread_create(&thread[indx], NULL,
+					ve_rank_fetch, &rank->work[indx]);
+	for (indx = 0; indx < nnode; indx++)
+		if (!started[indx])
+			ve_rank_fetch(&rank->work[indx]);
+	for (indx = 0; indx < nnode; indx++)
+		if (started[indx])
+			pthread_join(thread[indx], NULL);
+
+	pthread_mutex_lock(&rank->lock);
+	memcpy(rank->node, rank->work, nnode * sizeof(struct ve_rank_node));
+	rank->nnode = nnode;
+	pthread_mutex_unlock(&rank->lock);
+}
+
+/**
+ * @brief Refresher thread of node ranker
+ *
+ * @param arg[in] Node ranker
+ *
+ * @return NULL
+ */
+static void *ve_rank_refresher(void *arg)
+{
+	struct ve_rank *rank = arg;
+	struct timespec next = {0};
+	struct timespec now = {0};
+
+	VE_RPMLIB_TRACE("Entering");
+	clock_gettime(CLOCK_MONOTONIC, &next);
+	pthread_mutex_lock(&rank->lock);
+	while (!rank->stop) {
+		next.tv_sec += rank->interval / 1000;
+		next.tv_nsec += (rank->interval % 1000) * 1000000;
+		if (next.tv_nsec >= 1000000000) {
+			next.tv_nsec -= 1000000000;
+			next.tv_sec++;
+		}
+		while (!rank->stop && ETIMEDOUT != pthread_cond_timedwait(
+					&rank->cond, &rank->lock, &next))
+			;
+		if (rank->stop)
+			break;
+		pthread_mutex_unlock(&rank->lock);
+		ve_rank_refresh(rank);
+		/* Skip the ticks missed while VEOS was slow */
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		if (now.tv_sec > next.tv_sec || (now.tv_sec == next.tv_sec &&
+					now.tv_nsec > next.tv_nsec))
+			next = now;
+		pthread_mutex_lock(&rank->lock);
+	}
+	pthread_mutex_unlock(&rank->lock);
+	VE_RPMLIB_TRACE("Exiting");
+	return NULL;
+}
+
+/**
+ * @brief This function sets the weights of the score, all 0 for defaults
+ *
+ * @param rank[in] Node ranker
+ * @param weights[in] Weights of the score
+ *
+ * @return 0 on success and -1 on failure
+ */
+int ve_rank_set_weights(struct ve_rank *rank, struct ve_rank_weights *weights)
+{
+	struct ve_rank_weights w = {VE_RANK_W_LOAD, VE_RANK_W_MEM,
+					VE_RANK_W_NUMA, VE_RANK_W_SWAP};
+
+	if (!rank || !weights) {
+		VE_RPMLIB_ERR("Wrong argument received: rank = %p, "
+				"weights = %p", rank, weights);
+		errno = EINVAL;
+		return -1;
+	}
+	if (weights->load || weights->mem || weights->numa || weights->swap)
+		w = *weights;
+	pthread_mutex_lock(&rank->lock);
+	rank->weights = w;
+	pthread_mutex_unlock(&rank->lock);
+	return 0;
+}
+
+/**
+ * @brief This function starts the node ranker
+ *
+ *	  The state of all online VE nodes is fetched once before returning
+ *	  and then refreshed every 'interval' by a background thread, which
+ *	  fetches the nodes concurrently.
+ *
+ * @param attr[in] Attributes of the ranker, NULL for defaults
+ *
+ * @return Node ranker on success and NULL on failure
+ */
+struct ve_rank *ve_rank_start(struct ve_rank_attr *attr)
+{
+	struct ve_rank *rank = NULL;
+	struct ve_rank_weights none = {0};
+	pthread_condattr_t cattr;
+	int ret = 0;
+
+	VE_RPMLIB_TRACE("Entering");
+	if (attr && 0 > attr->interval) {
+		VE_RPMLIB_ERR("Wrong argument received: interval = %d",
+				attr->interval);
+		errno = EINVAL;
+		goto hndl_return;
+	}
+	rank = calloc(1, sizeof(struct ve_rank));
+	if (!rank) {
+		VE_RPMLIB_ERR("Memory allocation failed: %s",
+				strerror(errno));
+		goto hndl_return;
+	}
+	rank->interval = (attr && attr->interval) ? attr->interval :
+				VE_RANK_DEF_INTERVAL;
+	pthread_mutex_init(&rank->lock, NULL);
+	ve_rank_set_weights(rank, attr ? &attr->weights : &none);
+	ve_rank_refresh(rank);
+
+	pthread_condattr_init(&cattr);
+	pthread_condattr_setclock(&cattr, CLOCK_MONOTONIC);
+	pthread_cond_init(&rank->cond, &cattr);
+	pthread_condattr_destroy(&cattr);
+	ret = pthread_create(&rank->thread, NULL, ve_rank_refresher, rank);
+	if (ret) {
+		VE_RPMLIB_ERR("Failed to create refresher thread: %s",
+				strerror(ret));
+		pthread_cond_destroy(&rank->cond);
+		pthread_mutex_destroy(&rank->lock);
+		free(rank);
+		rank = NULL;
+		errno = ret;
+		goto hndl_return;
+	}
+	VE_RPMLIB_DEBUG("Ranking %d nodes every %d ms", rank->nnode,
+			rank->interval);
+hndl_return:
+	VE_RPMLIB_TRACE("Exiting");
+	return rank;
+}
+
+/**
+ * @brief This function ranks the online VE nodes for a job
+ *
+ *	  Only the cached state is used, so the call takes microseconds.
+ *	  The score of a node is the weighted sum of the share of the job's
+ *	  cores which are idle, the share of memory left free by the job and
+ *	  whether the job fits in one NUMA node (if the job asks for it),
+ *	  minus the share of memory swapped out. Nodes with fewer cores
+ *	  than the job are left out, nodes short of memory come last.
+ *
+ * @param rank[in] Node ranker
+ * @param job[in] Profile of the job
+ * @param ent[out] Nodes, best first
+ * @param max[in] Number of entries of 'ent'
+ *
+ * @return Number of nodes ranked on success and -1 on failure
+ */
+int ve_rank_nodes(struct ve_rank *rank, struct ve_rank_job *job,
+			struct ve_rank_entry *ent, int max)
+{
+	struct ve_rank_node node[VE_MAX_NODE];
+	struct ve_rank_weights w = {0};
+	struct ve_rank_entry cur = {0};
+	struct timespec now = {0};
+	int nnode = 0;
+	int count = 0;
+	int indx = 0;
+	int n = 0;
+	int j = 0;
+	double avail = 0;
+	double term = 0;
+	bool numa = false;
+
+	if (!rank || !job || !ent || 0 >= job->ncores || 0 > max) {
+		VE_RPMLIB_ERR("Wrong argument received: rank = %p, job = %p, "
+				"ent = %p", rank, job, ent);
+		errno = EINVAL;
+		return -1;
+	}
+	pthread_mutex_lock(&rank->lock);
+	nnode = rank->nnode;
+	memcpy(node, rank->node, nnode * sizeof(struct ve_rank_node));
+	w = rank->weights;
+	pthread_mutex_unlock(&rank->lock);
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	for (indx = 0; indx < nnode; indx++) {
+		if (!node[indx].valid || node[indx].numcore < job->ncores)
+			continue;
+		cur.nodeid = node[indx].nodeid;
+		cur.fits = node[indx].mem_free >= job->mem;
+		cur.age = (now.tv_sec - node[indx].stamp.tv_sec) +
+			(double)(now.tv_nsec - node[indx].stamp.tv_nsec) /
+			1000000000;
+		avail = node[indx].numcore - node[indx].load;
+		term = avail > 0 ? avail / job->ncores : 0;
+		cur.score = w.load * (term < 1 ? term : 1);
+		if (cur.fits && node[indx].mem_total)
+			cur.score += w.mem * (double)(node[indx].mem_free -
+				job->mem) / node[indx].mem_total;
+		numa = false;
+		for (n = 0; job->numa && n < node[indx].nnuma; n++)
+			if (node[indx].numa_cores[n] >= job->ncores &&
+					node[indx].numa_free[n] >= job->mem)
+				numa = true;
+		if (numa)
+			cur.score += w.numa;
+		if (node[indx].mem_total)
+			cur.score -= w.swap * (double)node[indx].swapped /
+					node[indx].mem_total;
+
+		/* Insertion into the first 'max' entries, best first */
+		for (j = count < max ? count : max; j > 0 &&
+				(cur.fits > ent[j - 1].fits ||
+				 (cur.fits == ent[j - 1].fits &&
+				  cur.score > ent[j - 1].score)); j--)
+			if (j < max)
+				ent[j] = ent[j - 1];
+		if (j < max) {
+			ent[j] = cur;
+			if (count < max)
+				count++;
+		}
+	}
+	return count;
+}
+
+/**
+ * @brief This function stops the node ranker and releases it
+ *
+ * @param rank[in] Node ranker
+ *
+ * @return 0 on success and -1 on failure
+ */
+int ve_rank_stop(struct ve_rank *rank)
+{
+	VE_RPMLIB_TRACE("Entering");
+	if (!rank) {
+		VE_RPMLIB_ERR("Wrong argument received: rank = %p", rank);
+		errno = EINVAL;
+		return -1;
+	}
+	pthread_mutex_lock(&rank->lock);
+	rank->stop = true;
+	pthread_cond_signal(&rank->cond);
+	pthread_mutex_unlock(&rank->lock);
+	pthread_join(rank->thread, NULL);
+	pthread_cond_destroy(&rank->cond);
+	pthread_mutex_destroy(&rank->lock);
+	free(rank);
+	VE_RPMLIB_TRACE("Exiting");
+	return 0;
+}
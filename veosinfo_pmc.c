@@ -0,0 +1,706 @@
+/**
+ * Copyright (C) 2020 NEC Corporation
+ * This file is part of the VEOS information library.
+ *
+ * The VEOS information library is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either version
+ * 2.1 of the License, or (at your option) any later version.
+ *
+ * The VEOS information library is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with the VEOS information library; if not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+/**
+ * @file veosinfo_pmc.c
+ * @brief Reads the performance counters of VE processes and derives the
+ * metrics reported by PROGINF from them
+ *
+ * @internal
+ * @author RPM command
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include "veosinfo.h"
+#include "veosinfo_log.h"
+#include "veosinfo_internal.h"
+
+#define VE_USRCC_MASK	((1ULL << 56) - 1)	/*!< Width of USRCC */
+#define VE_PMC_MASK	((1ULL << 52) - 1)	/*!< Width of PMC */
+#define VE_PMC_MODE(pmmr, i) \
+	(((pmmr) >> (4 * (VE_PMC_NUM - 1 - (i)))) & (VE_PMC_MODES - 1))
+
+/* Events counted by PMC00-PMC15 in the default mode (PMMR field 0) */
+enum ve_pmc_event {
+	VE_PMC_EX = 0,		/*!< Execution count */
+	VE_PMC_VX,		/*!< Vector execution count */
+	VE_PMC_FPEC,		/*!< Floating point data element count */
+	VE_PMC_VE,		/*!< Vector elements count */
+	VE_PMC_VECC,		/*!< Vector execution clock count */
+	VE_PMC_L1MCC,		/*!< L1 cache miss clock count */
+	VE_PMC_VE2,		/*!< Vector elements count 2 */
+	VE_PMC_VAREC,		/*!< Vector arithmetic execution clock count */
+	VE_PMC_VLDEC,		/*!< Vector load execution clock count */
+	VE_PMC_PCCC,		/*!< Port conflict clock count */
+	VE_PMC_VLDCC,		/*!< Vector load delayed clock count */
+	VE_PMC_VLEC,		/*!< Vector load element count */
+	VE_PMC_VLCME,		/*!< Vector load cache miss element count */
+	VE_PMC_FMAEC,		/*!< Fused multiply add element count */
+	VE_PMC_PTCC,		/*!< Power throttling clock count */
+	VE_PMC_TTCC,		/*!< Thermal throttling clock count */
+};
+
+int ve_pmc_regid[VE_PMC_NREGS] = {
+	VE_REG_USRCC, VE_REG_PMMR,
+	VE_REG_PMC00, VE_REG_PMC00 + 1, VE_REG_PMC00 + 2, VE_REG_PMC00 + 3,
+	VE_REG_PMC00 + 4, VE_REG_PMC00 + 5, VE_REG_PMC00 + 6,
+	VE_REG_PMC00 + 7, VE_REG_PMC00 + 8, VE_REG_PMC00 + 9,
+	VE_REG_PMC00 + 10, VE_REG_PMC00 + 11, VE_REG_PMC00 + 12,
+	VE_REG_PMC00 + 13, VE_REG_PMC00 + 14, VE_REG_PMC15,
+};
+
+/**
+ * @brief This function accumulates the counter deltas between two reads of
+ *	  the same VE thread.
+ *
+ *	  A counter whose mode changed between the reads counted two events
+ *	  in an unknown proportion, so its delta is dropped and the clocks of
+ *	  the interval are not credited to any of its modes.
+ *
+ * @param counts[in/out] Accumulated deltas
+ * @param prev[in] Previous read
+ * @param cur[in] Current read
+ */
+void ve_pmc_accumulate(struct ve_pmc_counts *counts,
+			const struct ve_pmc_sample *prev,
+			const struct ve_pmc_sample *cur)
+{
+	int indx = 0;
+	uint64_t mode = 0;
+	uint64_t clocks = (cur->usrcc - prev->usrcc) & VE_USRCC_MASK;
+
+	counts->usrcc += clocks;
+	for (indx = 0; indx < VE_PMC_NUM; indx++) {
+		mode = VE_PMC_MODE(cur->pmmr, indx);
+		if (mode != VE_PMC_MODE(prev->pmmr, indx))
+			continue;
+		counts->count[indx][mode] +=
+			(cur->pmc[indx] - prev->pmc[indx]) & VE_PMC_MASK;
+		counts->clock[indx][mode] += clocks;
+	}
+}
+
+/**
+ * @brief This function compares threads by TID for qsort() and bsearch()
+ */
+static int ve_pmc_thread_cmp(const void *a, const void *b)
+{
+	const struct ve_pmc_thread *x = a;
+	const struct ve_pmc_thread *y = b;
+
+	return (x->tid > y->tid) - (x->tid < y->tid);
+}
+
+/**
+ * @brief This function initializes the performance counter reader
+ *
+ * @param pmc[out] Reader to initialize
+ * @param nodeid[in] VE node number
+ * @param pid[in] PID of VE process
+ * @param threads[in] Read every thread (true) or only the thread 'pid'
+ *		      (false)
+ *
+ * @return 0 on success and -1 on failure
+ */
+int ve_pmc_init(struct ve_pmc *pmc, int nodeid, pid_t pid, bool threads)
+{
+	int retval = -1;
+
+	VE_RPMLIB_TRACE("Entering");
+	if (!pmc || 0 >= pid) {
+		VE_RPMLIB_ERR("Wrong argument received: pmc = %p, pid = %d",
+				pmc, pid);
+		errno = EINVAL;
+		goto hndl_return;
+	}
+	memset(pmc, '\0', sizeof(struct ve_pmc));
+	pmc->nodeid = nodeid;
+	pmc->pid = pid;
+	pmc->threads = threads;
+	if (0 > ve_cpufreq_info(nodeid, &pmc->clock)) {
+		VE_RPMLIB_ERR("Failed to get CPU frequency: %s",
+				strerror(errno));
+		goto hndl_return;
+	}
+	retval = 0;
+hndl_return:
+	VE_RPMLIB_TRACE("Exiting");
+	return retval;
+}
+
+/**
+ * @brief This function gets the TIDs to read
+ *
+ * @param pmc[in] Performance counter reader
+ * @param tid[out] Allocated array of TIDs
+ *
+ * @return Number of TIDs on success and -1 on failure
+ */
+static int ve_pmc_tids(struct ve_pmc *pmc, pid_t **tid)
+{
+	int retval = -1;
+	int ntid = 0;
+	int size = 1;
+	int indx = 0;
+	pid_t cursor = 0;
+	pid_t *tmp = NULL;
+	struct ve_thread_info *threads = NULL;
+
+	*tid = malloc(sizeof(pid_t) * size);
+	if (!*tid)
+		goto hndl_err;
+	if (!pmc->threads) {
+		(*tid)[0] = pmc->pid;
+		return 1;
+	}
+	threads = malloc(sizeof(struct ve_thread_info));
+	if (!threads)
+		goto hndl_err;
+	do {
+		if (0 > ve_thread_info(pmc->nodeid, pmc->pid, cursor, threads))
+			goto hndl_free;
+		tmp = realloc(*tid, sizeof(pid_t) * (ntid + threads->len + 1));
+		if (!tmp)
+			goto hndl_err;
+		*tid = tmp;
+		for (indx = 0; indx < threads->len; indx++)
+			(*tid)[ntid++] = threads->thread[indx].tid;
+		cursor = threads->cursor;
+	} while (threads->more);
+	free(threads);
+	return ntid;
+
+hndl_err:
+	VE_RPMLIB_ERR("Memory allocation failed: %s", strerror(errno));
+hndl_free:
+	free(threads);
+	free(*tid);
+	*tid = NULL;
+	return retval;
+}
+
+/**
+ * @brief This function reads the performance counters and accumulates the
+ *	  deltas since the previous read.
+ *
+ *	  The first read of a thread only sets its starting point. Threads
+ *	  which exited since the previous read are forgotten.
+ *
+ * @param pmc[in/out] Performance counter reader
+ *
+ * @return 0 on success and -1 on failure
+ */
+int ve_pmc_read(struct ve_pmc *pmc)
+{
+	int retval = -1;
+	int ntid = 0;
+	int nthread = 0;
+	int indx = 0;
+	pid_t *tid = NULL;
+	struct ve_regvals_req *req = NULL;
+	struct ve_pmc_thread *thread = NULL;
+	struct ve_pmc_thread *old = NULL;
+
+	VE_RPMLIB_TRACE("Entering");
+	if (!pmc) {
+		VE_RPMLIB_ERR("Wrong argument received: pmc = %p", pmc);
+		errno = EINVAL;
+		goto hndl_return;
+	}
+	ntid = ve_pmc_tids(pmc, &tid);
+	if (0 > ntid)
+		goto hndl_return;
+	if (!ntid) {
+		VE_RPMLIB_DEBUG("No thread left in process %d", pmc->pid);
+		free(pmc->thread);
+		pmc->thread = NULL;
+		pmc->nthread = 0;
+		retval = 0;
+		goto hndl_free;
+	}
+	req = calloc(ntid, sizeof(struct ve_regvals_req));
+	thread = calloc(ntid, sizeof(struct ve_pmc_thread));
+	if (!req || !thread) {
+		VE_RPMLIB_ERR("Memory allocation failed: %s",
+				strerror(errno));
+		goto hndl_free;
+	}
+	/* Registers are read straight into the samples */
+	for (indx = 0; indx < ntid; indx++) {
+		req[indx].pid = tid[indx];
+		req[indx].numregs = VE_PMC_NREGS;
+		req[indx].regid = ve_pmc_regid;
+		req[indx].regval = (uint64_t *)&thread[indx].last;
+	}
+	if (0 > ve_get_regvals_batch(pmc->nodeid, ntid, req)) {
+		VE_RPMLIB_ERR("Failed to read performance counters: %s",
+				strerror(errno));
+		goto hndl_free;
+	}
+	for (indx = 0; indx < ntid; indx++) {
+		if (req[indx].status) {
+			VE_RPMLIB_DEBUG("Failed to read thread %d: %s",
+				tid[indx], strerror(-req[indx].status));
+			if (!pmc->threads) {
+				errno = -req[indx].status;
+				goto hndl_free;
+			}
+			continue;
+		}
+		thread[nthread].tid = tid[indx];
+		thread[nthread].last = thread[indx].last;
+		old = bsearch(&thread[nthread], pmc->thread, pmc->nthread,
+				sizeof(struct ve_pmc_thread),
+				ve_pmc_thread_cmp);
+		if (old)
+			ve_pmc_accumulate(&pmc->counts, &old->last,
+					&thread[nthread].last);
+		nthread++;
+	}
+	qsort(thread, nthread, sizeof(struct ve_pmc_thread),
+		ve_pmc_thread_cmp);
+	free(pmc->thread);
+	pmc->thread = thread;
+	pmc->nthread = nthread;
+	thread = NULL;
+	retval = 0;
+	VE_RPMLIB_DEBUG("Read performance counters of %d threads", nthread);
+hndl_free:
+	free(thread);
+	free(req);
+	free(tid);
+hndl_return:
+	VE_RPMLIB_TRACE("Exiting");
+	return retval;
+}
+
+/**
+ * @brief This function clears the accumulated deltas, the next read
+ *	  measures from the last one.
+ *
+ * @param pmc[in/out] Performance counter reader
+ */
+void ve_pmc_reset(struct ve_pmc *pmc)
+{
+	if (!pmc)
+		return;
+	memset(&pmc->counts, '\0', sizeof(struct ve_pmc_counts));
+}
+
+/**
+ * @brief This function estimates the events of a counter in the default
+ *	  mode over the whole measured time
+ *
+ * @param counts[in] Accumulated deltas
+ * @param event[in] Counter
+ * @param coverage[in/out] Smallest share of time in the default mode
+ *
+ * @return Estimated number of events
+ */
+static double ve_pmc_event(struct ve_pmc_counts *counts, int event,
+				double *coverage)
+{
+	double share = 0;
+
+	if (!counts->clock[event][0]) {
+		*coverage = 0;
+		return 0;
+	}
+	share = (double)counts->clock[event][0] / counts->usrcc;
+	if (share < *coverage)
+		*coverage = share;
+	return counts->count[event][0] / share;
+}
+
+/**
+ * @brief This function derives metrics from accumulated counter deltas
+ *	  with the formulas of PROGINF.
+ *
+ *	  Counters which spent only a part of the time in the default mode
+ *	  are scaled to the whole time; 'coverage' tells how much of the time
+ *	  was actually observed.
+ *
+ * @param counts[in] Accumulated deltas
+ * @param clock[in] Clock frequency in MHz
+ * @param metrics[out] Derived metrics
+ *
+ * @return 0 on success and -1 on failure
+ */
+int ve_pmc_metrics(struct ve_pmc_counts *counts, unsigned long clock,
+			struct ve_pmc_metrics *metrics)
+{
+	double hz = (double)clock * 1000000;
+	double ex = 0;
+	double vx = 0;
+	double ve = 0;
+	double fpec = 0;
+	double fmaec = 0;
+	double vlec = 0;
+	double vlcme = 0;
+
+	VE_RPMLIB_TRACE("Entering");
+	if (!counts || !metrics || !clock) {
+		VE_RPMLIB_ERR("Wrong argument received: counts = %p, "
+			"metrics = %p, clock = %lu", counts, metrics, clock);
+		errno = EINVAL;
+		return -1;
+	}
+	memset(metrics, '\0', sizeof(struct ve_pmc_metrics));
+	if (!counts->usrcc)
+		goto hndl_return;
+	metrics->coverage = 1;
+	metrics->user_time = counts->usrcc / hz;
+	ex = ve_pmc_event(counts, VE_PMC_EX, &metrics->coverage);
+	vx = ve_pmc_event(counts, VE_PMC_VX, &metrics->coverage);
+	ve = ve_pmc_event(counts, VE_PMC_VE, &metrics->coverage);
+	fpec = ve_pmc_event(counts, VE_PMC_FPEC, &metrics->coverage);
+	fmaec = ve_pmc_event(counts, VE_PMC_FMAEC, &metrics->coverage);
+	vlec = ve_pmc_event(counts, VE_PMC_VLEC, &metrics->coverage);
+	vlcme = ve_pmc_event(counts, VE_PMC_VLCME, &metrics->coverage);
+
+	metrics->mops = (ex - vx + ve + fmaec) / metrics->user_time / 1000000;
+	metrics->mflops = fpec / metrics->user_time / 1000000;
+	if (ex - vx + ve > 0)
+		metrics->vop_ratio = ve * 100 / (ex - vx + ve);
+	if (vx > 0)
+		metrics->avg_vlen = ve / vx;
+	if (vlec > 0)
+		metrics->vld_hit_ratio = (vlec - vlcme) * 100 / vlec;
+	metrics->vector_time = ve_pmc_event(counts, VE_PMC_VECC,
+					&metrics->coverage) / hz;
+	metrics->l1_miss_time = ve_pmc_event(counts, VE_PMC_L1MCC,
+					&metrics->coverage) / hz;
+	metrics->bank_conflict_time = ve_pmc_event(counts, VE_PMC_PCCC,
+					&metrics->coverage) / hz;
+hndl_return:
+	VE_RPMLIB_TRACE("Exiting");
+	return 0;
+}
+
+/**
+ * @brief This function releases the memory held by the reader
+ *
+ * @param pmc[in] Performance counter reader
+ */
+void ve_pmc_free(struct ve_pmc *pmc)
+{
+	if (!pmc)
+		return;
+	free(pmc->thread);
+	memset(pmc, '\0', sizeof(struct ve_pmc));
+}
+
+/**
+ * @brief This function initializes the node-wide performance counter
+ *	  collector
+ *
+ * @param pn[out] Collector to initialize
+ * @param nodeid[in] VE node number
+ * @param max_tasks[in] Max number of tasks read in one sample, 0 for
+ *			VE_PMC_NODE_DEF_TASKS
+ *
+ * @return 0 on success and -1 on failure
+ */
+int ve_pmc_node_init(struct ve_pmc_node *pn, int nodeid, int max_tasks)
+{
+	int retval = -1;
+
+	VE_RPMLIB_TRACE("Entering");
+	if (!pn || 0 > max_tasks) {
+		VE_RPMLIB_ERR("Wrong argument received: pn = %p, "
+				"max_tasks = %d", pn, max_tasks);
+		errno = EINVAL;
+		goto hndl_return;
+	}
+	memset(pn, '\0', sizeof(struct ve_pmc_node));
+	pn->nodeid = nodeid;
+	pn->max_tasks = max_tasks ? max_tasks : VE_PMC_NODE_DEF_TASKS;
+	if (-1 == ve_core_info(nodeid, &pn->numcore)) {
+		VE_RPMLIB_ERR("Failed to get CPU cores: %s", strerror(errno));
+		goto hndl_return;
+	}
+	if (0 > ve_cpufreq_info(nodeid, &pn->clock)) {
+		VE_RPMLIB_ERR("Failed to get CPU frequency: %s",
+				strerror(errno));
+		goto hndl_return;
+	}
+	retval = 0;
+hndl_return:
+	VE_RPMLIB_TRACE("Exiting");
+	return retval;
+}
+
+/**
+ * @brief This function converts the deltas of a task to rates over the
+ *	  time between its two reads
+ *
+ * @param counts[in] Deltas of the task
+ * @param clock[in] Clock frequency in MHz
+ * @param interval[in] Seconds between the reads
+ * @param rate[out] Rates, ratios excluded
+ */
+static void ve_pmc_node_rate(struct ve_pmc_counts *counts,
+			unsigned long clock, double interval,
+			struct ve_pmc_rate *rate)
+{
+	struct ve_pmc_metrics metrics = {0};
+	double coverage = 1;
+
+	memset(rate, '\0', sizeof(struct ve_pmc_rate));
+	ve_pmc_metrics(counts, clock, &metrics);
+	rate->busy = metrics.user_time / interval;
+	rate->mops = metrics.mops * rate->busy;
+	rate->mflops = metrics.mflops * rate->busy;
+	rate->conflict = metrics.bank_conflict_time / interval;
+	if (counts->usrcc)
+		rate->vld_bytes = ve_pmc_event(counts, VE_PMC_VLEC, &coverage) *
+					sizeof(uint64_t) / interval;
+}
+
+/**
+ * @brief This function adds the rates of a task to a core or the node
+ *
+ * @param sum[in/out] Rates of the core or node
+ * @param rate[in] Rates of the task
+ */
+static void ve_pmc_node_add(struct ve_pmc_rate *sum,
+			const struct ve_pmc_rate *rate)
+{
+	sum->tasks++;
+	sum->busy += rate->busy;
+	sum->mops += rate->mops;
+	sum->mflops += rate->mflops;
+	sum->vld_bytes += rate->vld_bytes;
+	sum->conflict += rate->conflict;
+}
+
+/**
+ * @brief This function sets the ratios of a core or the node from the
+ *	  deltas read in the last sample
+ *
+ * @param counts[in] Deltas read in the last sample
+ * @param clock[in] Clock frequency in MHz
+ * @param rate[in/out] Rates of the core or node
+ */
+static void ve_pmc_node_ratio(struct ve_pmc_counts *counts,
+			unsigned long clock, struct ve_pmc_rate *rate)
+{
+	struct ve_pmc_metrics metrics = {0};
+
+	ve_pmc_metrics(counts, clock, &metrics);
+	rate->vop_ratio = metrics.vop_ratio;
+	rate->avg_vlen = metrics.avg_vlen;
+}
+
+/**
+ * @brief This function takes over the tracked tasks to the current process
+ *	  table. A task whose start time changed is a new task with a reused
+ *	  PID and starts over.
+ *
+ * @param pn[in/out] Collector
+ *
+ * @return 0 on success and -1 on failure
+ */
+static int ve_pmc_node_tasks(struct ve_pmc_node *pn)
+{
+	int indx = 0;
+	int old = 0;
+	struct ve_proc_entry *ent = NULL;
+	struct ve_pmc_task *task = NULL;
+
+	task = calloc(pn->table.len ? pn->table.len : 1,
+			sizeof(struct ve_pmc_task));
+	if (!task) {
+		VE_RPMLIB_ERR("Memory allocation failed: %s",
+				strerror(errno));
+		return -1;
+	}
+	/* Both the table and the tasks are sorted by PID */
+	for (indx = 0; indx < pn->table.len; indx++) {
+		ent = &pn->table.entry[indx];
+		while (old < pn->ntask && pn->task[old].pid < ent->pid)
+			old++;
+		if (old < pn->ntask && pn->task[old].pid == ent->pid &&
+			pn->task[old].start_time == ent->start_time)
+			task[indx] = pn->task[old];
+		task[indx].pid = ent->pid;
+		task[indx].start_time = ent->start_time;
+		task[indx].processor = ent->processor;
+	}
+	free(pn->task);
+	pn->task = task;
+	pn->ntask = pn->table.len;
+	return 0;
+}
+
+/**
+ * @brief This function samples the performance counters of the tasks of
+ *	  the node and computes per-core and per-node rates since the
+ *	  previous sample.
+ *
+ *	  At most 'max_tasks' tasks are read in one sample. When the node
+ *	  runs more tasks, a window rotating over the process table is read.
+ *	  Each read task gets rates over the time since its own previous
+ *	  read, and the rates of a core or the node are the sums of the
+ *	  latest rates of its tasks, whether read in this sample or before.
+ *	  Ratios are computed from the tasks read in this sample. Tasks are
+ *	  accounted from their second read, and what a task counted after
+ *	  its last read before exiting is lost.
+ *
+ * @param pn[in/out] Collector
+ *
+ * @return 0 on success and -1 on failure
+ */
+int ve_pmc_node_sample(struct ve_pmc_node *pn)
+{
+	int retval = -1;
+	int nreq = 0;
+	int first = 0;
+	int indx = 0;
+	int core = 0;
+	struct ve_pmc_task *task = NULL;
+	struct ve_pmc_sample *sample = NULL;
+	struct ve_regvals_req *req = NULL;
+	struct ve_pmc_counts *counts = NULL;
+	struct ve_pmc_counts delta;
+	struct timespec now = {0};
+	double elapsed = 0;
+
+	VE_RPMLIB_TRACE("Entering");
+	if (!pn) {
+		VE_RPMLIB_ERR("Wrong argument received: pn = %p", pn);
+		errno = EINVAL;
+		goto hndl_return;
+	}
+	if (0 > ve_proc_table_update(pn->nodeid, &pn->table)) {
+		VE_RPMLIB_ERR("Failed to update process table: %s",
+				strerror(errno));
+		goto hndl_return;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	if (0 > ve_pmc_node_tasks(pn))
+		goto hndl_return;
+
+	nreq = pn->ntask < pn->max_tasks ? pn->ntask : pn->max_tasks;
+	if (nreq < pn->ntask) {
+		while (first < pn->ntask && pn->task[first].pid <= pn->cursor)
+			first++;
+		if (first == pn->ntask)
+			first = 0;
+	}
+	/* Counts of every core followed by the counts of the node */
+	counts = calloc(pn->numcore + 1, sizeof(struct ve_pmc_counts));
+	req = calloc(nreq ? nreq : 1, sizeof(struct ve_regvals_req));
+	sample = calloc(nreq ? nreq : 1, sizeof(struct ve_pmc_sample));
+	if (!counts || !req || !sample) {
+		VE_RPMLIB_ERR("Memory allocation failed: %s",
+				strerror(errno));
+		goto hndl_free;
+	}
+	for (indx = 0; indx < nreq; indx++) {
+		task = &pn->task[(first + indx) % pn->ntask];
+		req[indx].pid = task->pid;
+		req[indx].numregs = VE_PMC_NREGS;
+		req[indx].regid = ve_pmc_regid;
+		req[indx].regval = (uint64_t *)&sample[indx];
+	}
+	if (nreq && 0 > ve_get_regvals_batch(pn->nodeid, nreq, req)) {
+		VE_RPMLIB_ERR("Failed to read performance counters: %s",
+				strerror(errno));
+		goto hndl_free;
+	}
+
+	memset(pn->core, '\0', sizeof(pn->core));
+	memset(&pn->node, '\0', sizeof(pn->node));
+	pn->nread = 0;
+	for (indx = 0; indx < nreq; indx++) {
+		task = &pn->task[(first + indx) % pn->ntask];
+		if (req[indx].status)
+			continue;
+		pn->nread++;
+		elapsed = (now.tv_sec - task->stamp.tv_sec) +
+			(double)(now.tv_nsec - task->stamp.tv_nsec) / 1000000000;
+		if (task->valid && elapsed > 0) {
+			memset(&delta, '\0', sizeof(delta));
+			ve_pmc_accumulate(&delta, &task->last, &sample[indx]);
+			ve_pmc_node_rate(&delta, pn->clock, elapsed,
+					&task->rate);
+			task->rated = true;
+			core = task->processor;
+			if (core >= 0 && core < pn->numcore)
+				ve_pmc_accumulate(&counts[core], &task->last,
+						&sample[indx]);
+			ve_pmc_accumulate(&counts[pn->numcore], &task->last,
+					&sample[indx]);
+		}
+		task->last = sample[indx];
+		task->stamp = now;
+		task->valid = true;
+	}
+	if (nreq)
+		pn->cursor = pn->task[(first + nreq - 1) % pn->ntask].pid;
+
+	/* Tasks not read in this sample keep their latest rates */
+	for (indx = 0; indx < pn->ntask; indx++) {
+		task = &pn->task[indx];
+		if (!task->rated)
+			continue;
+		core = task->processor;
+		if (core >= 0 && core < pn->numcore)
+			ve_pmc_node_add(&pn->core[core], &task->rate);
+		ve_pmc_node_add(&pn->node, &task->rate);
+	}
+	for (core = 0; core < pn->numcore; core++)
+		ve_pmc_node_ratio(&counts[core], pn->clock, &pn->core[core]);
+	ve_pmc_node_ratio(&counts[pn->numcore], pn->clock, &pn->node);
+
+	pn->interval = 0;
+	if (pn->stamp.tv_sec || pn->stamp.tv_nsec)
+		pn->interval = (now.tv_sec - pn->stamp.tv_sec) +
+			(double)(now.tv_nsec - pn->stamp.tv_nsec) / 1000000000;
+	pn->stamp = now;
+	VE_RPMLIB_DEBUG("Read %d of %d tasks, node busy %.2f cores",
+			pn->nread, pn->ntask, pn->node.busy);
+	retval = 0;
+hndl_free:
+	free(counts);
+	free(req);
+	free(sample);
+hndl_return:
+	VE_RPMLIB_TRACE("Exiting");
+	return retval;
+}
+
+/**
+ * @brief This function releases the memory held by the collector
+ *
+ * @param pn[in] Collector
+ */
+void ve_pmc_node_free(struct ve_pmc_node *pn)
+{
+	if (!pn)
+		return;
+	ve_proc_table_free(&pn->table);
+	free(pn->task);
+	memset(pn, '\0', sizeof(struct ve_pmc_node));
+}
@@ -0,0 +1,619 @@
+/**
+ * Copyright (C) 2020 NEC Corporation
+ * This file is part of the VEOS information library.
+ *
+ * The VEOS information library is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either version
+ * 2.1 of the License, or (at your option) any later version.
+ *
+ * The VEOS information library is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with the VEOS information library; if not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+/**
+ * @file veosinfo_pool.c
+ * @brief Keeps host processes forked ahead of time ready for jobs
+ *
+ *	  Each slot is a host process forked ahead of time for one VE node.
+ *	  At launch the job is executed in the slot with VE_NODE_NUMBER set
+ *	  to the node, so the fork is out of the critical path. The job
+ *	  creates its VE task as usual when it starts; moving that out of
+ *	  the critical path needs support from VEOS and ve_exec.
+ *
+ * @internal
+ * @author RPM command
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include "veosinfo.h"
+#include "veosinfo_log.h"
+#include "veosinfo_internal.h"
+
+/* Largest command line a slot accepts, NUL separated */
+#define VE_TASK_POOL_ARG_MAX	32768
+/* Largest number of arguments a slot accepts */
+#define VE_TASK_POOL_ARGC_MAX	1024
+/* Largest number of environment variables a slot passes to its job */
+#define VE_TASK_POOL_ENV_MAX	4096
+/* Environment variable naming the VE node of a job */
+#define VE_TASK_POOL_NODE_ENV	"VE_NODE_NUMBER="
+
+extern char **environ;
+
+/**
+ * @brief Host process waiting for a job
+ */
+struct ve_task_slot {
+	pid_t pid;			/*!< Host process */
+	int fd;				/*!< Socket the job is sent on */
+	struct ve_task_slot *next;	/*!< Next slot of the node */
+};
+
+/**
+ * @brief Slots of one VE node
+ */
+struct ve_task_pool_node {
+	int nodeid;			/*!< VE node number */
+	char env[32];			/*!< VE_NODE_NUMBER of the jobs */
+	int nslot;			/*!< Number of slots */
+	struct ve_task_slot *slot;	/*!< Slots, oldest first */
+	struct timespec used;		/*!< CLOCK_MONOTONIC of last launch */
+};
+
+/**
+ * @brief State of task pool
+ */
+struct ve_task_pool {
+	int size;				/*!< Slots kept per node */
+	int idle;				/*!< Milliseconds before idle
+						 * slots are deleted, 0 never */
+	int interval;				/*!< Milliseconds between checks */
+	pthread_t thread;			/*!< Refiller thread */
+	pthread_mutex_t lock;			/*!< Protects the members below */
+	pthread_cond_t cond;			/*!< Signals 'stop' or a launch */
+	bool stop;				/*!< Request the refiller to stop */
+	int nnode;				/*!< Number of nodes */
+	struct ve_task_pool_node node[VE_MAX_NODE];/*!< Slots of the nodes */
+};
+
+/**
+ * @brief This function reads exactly 'len' bytes
+ *
+ * @return 0 on success and -1 on failure or end of file
+ */
+static int ve_task_pool_read(int fd, void *buf, size_t len)
+{
+	ssize_t ret = 0;
+
+	while (len) {
+		ret = read(fd, buf, len);
+		if (0 > ret && EINTR == errno)
+			continue;
+		if (0 >= ret)
+			return -1;
+		buf = (char *)buf + ret;
+		len -= ret;
+	}
+	return 0;
+}
+
+/**
+ * @brief This function closes the file descriptors from 'first' to 'last'
+ *	  in a forked host process
+ *
+ * @param first[in] First descriptor to close
+ * @param last[in] Last descriptor to close
+ */
+static void ve_task_pool_close(unsigned int first, unsigned int last)
+{
+	long max = 0;
+
+	if (first > last)
+		return;
+#ifdef SYS_close_range
+	if (!syscall(SYS_close_range, first, last, 0))
+		return;
+#endif
+	max = sysconf(_SC_OPEN_MAX);
+	if (0 > max || max > 65536)
+		max = 65536;
+	for (; first <= last && first < max; first++)
+		close(first);
+}
+
+/**
+ * @brief Body of a slot, run in the forked host process
+ *
+ *	  Only async-signal-safe calls are made, as the pool forks from a
+ *	  threaded process. The slot waits for the command line of its job
+ *	  and executes it in place with VE_NODE_NUMBER set to its node. It
+ *	  exits when the pool closes the socket without a job.
+ *
+ * @param fd[in] Socket the job is received on
+ * @param env[in] VE_NODE_NUMBER of the job
+ */
+static void ve_task_pool_child(int fd, char *env)
+{
+	char buf[VE_TASK_POOL_ARG_MAX];
+	char *argv[VE_TASK_POOL_ARGC_MAX + 1];
+	char *envp[VE_TASK_POOL_ENV_MAX + 2];
+	uint32_t len = 0;
+	int argc = 0;
+	int nenv = 0;
+	uint32_t pos = 0;
+	sigset_t set;
+	int indx = 0;
+
+	/* Keep the sockets of the other slots from holding them open */
+	ve_task_pool_close(3, fd - 1);
+	ve_task_pool_close(fd + 1, ~0U);
+	sigemptyset(&set);
+	sigprocmask(SIG_SETMASK, &set, NULL);
+
+	if (ve_task_pool_read(fd, &len, sizeof(len)) || !len ||
+			len > sizeof(buf) || ve_task_pool_read(fd, buf, len) ||
+			buf[len - 1])
+		_exit(127);
+	close(fd);
+	while (pos < len && argc < VE_TASK_POOL_ARGC_MAX) {
+		argv[argc++] = buf + pos;
+		pos += strlen(buf + pos) + 1;
+	}
+	argv[argc] = NULL;
+	for (indx = 0; environ[indx] && nenv < VE_TASK_POOL_ENV_MAX; indx++)
+		if (strncmp(environ[indx], VE_TASK_POOL_NODE_ENV,
+				sizeof(VE_TASK_POOL_NODE_ENV) - 1))
+			envp[nenv++] = environ[indx];
+	envp[nenv++] = env;
+	envp[nenv] = NULL;
+	execvpe(argv[0], argv, envp);
+	_exit(127);
+}
+
+/**
+ * @brief This function deletes a slot which was not used
+ *
+ * @param slot[in] Slot to delete
+ */
+static void ve_task_pool_delete(struct ve_task_slot *slot)
+{
+	close(slot->fd);
+	while (0 > waitpid(slot->pid, NULL, 0) && EINTR == errno)
+		;
+	free(slot);
+}
+
+/**
+ * @brief This function creates slots on one VE node
+ *
+ * @param node[in] VE node
+ * @param num[in] Number of slots to create
+ *
+ * @return Created slots, oldest first, NULL if none
+ */
+static struct ve_task_slot *ve_task_pool_create(
+				struct ve_task_pool_node *node, int num)
+{
+	struct ve_task_slot *head = NULL;
+	struct ve_task_slot **tail = &head;
+	struct ve_task_slot *slot = NULL;
+	int sv[2] = {-1, -1};
+	int indx = 0;
+
+	for (indx = 0; indx < num; indx++) {
+		if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sv)) {
+			VE_RPMLIB_ERR("Failed to create socket pair: %s",
+					strerror(errno));
+			break;
+		}
+		slot = calloc(1, sizeof(struct ve_task_slot));
+		if (!slot) {
+			VE_RPMLIB_ERR("Memory allocation failed: %s",
+					strerror(errno));
+			close(sv[0]);
+			close(sv[1]);
+			break;
+		}
+		slot->pid = fork();
+		if (!slot->pid) {
+			close(sv[0]);
+			ve_task_pool_child(sv[1], node->env);
+		}
+		close(sv[1]);
+		if (0 > slot->pid) {
+			VE_RPMLIB_ERR("Failed to fork: %s", strerror(errno));
+			close(sv[0]);
+			free(slot);
+			break;
+		}
+		slot->fd = sv[0];
+		*tail = slot;
+		tail = &slot->next;
+	}
+	return head;
+}
+
+/**
+ * @brief This function refills or drains the slots of every node
+ *
+ * @param pool[in] Task pool
+ */
+static void ve_task_pool_refill(struct ve_task_pool *pool)
+{
+	struct ve_task_pool_node *node = NULL;
+	struct ve_task_slot *list = NULL;
+	struct ve_task_slot *slot = NULL;
+	struct ve_task_slot **tail = NULL;
+	struct timespec now = {0};
+	long long idle = 0;
+	int nodeid = 0;
+	int indx = 0;
+	int num = 0;
+
+	for (indx = 0; indx < pool->nnode; indx++) {
+		node = &pool->node[indx];
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		pthread_mutex_lock(&pool->lock);
+		if (pool->stop) {
+			pthread_mutex_unlock(&pool->lock);
+			return;
+		}
+		nodeid = node->nodeid;
+		idle = (now.tv_sec - node->used.tv_sec) * 1000LL +
+			(now.tv_nsec - node->used.tv_nsec) / 1000000;
+		if (pool->idle && idle >= pool->idle) {
+			/* Nothing launched lately, let the slots go */
+			list = node->slot;
+			node->slot = NULL;
+			node->nslot = 0;
+			num = 0;
+		} else {
+			list = NULL;
+			num = pool->size - node->nslot;
+		}
+		pthread_mutex_unlock(&pool->lock);
+
+		while (list) {
+			slot = list;
+			list = slot->next;
+			ve_task_pool_delete(slot);
+		}
+		if (0 >= num)
+			continue;
+		list = ve_task_pool_create(node, num);
+		if (!list)
+			continue;
+		pthread_mutex_lock(&pool->lock);
+		for (tail = &node->slot; *tail; tail = &(*tail)->next)
+			;
+		*tail = list;
+		for (; list; list = list->next)
+			node->nslot++;
+		num = node->nslot;
+		pthread_mutex_unlock(&pool->lock);
+		VE_RPMLIB_DEBUG("Node %d has %d slots", nodeid, num);
+	}
+}
+
+/**
+ * @brief Refiller thread of task pool
+ *
+ * @param arg[in] Task pool
+ *
+ * @return NULL
+ */
+static void *ve_task_pool_refiller(void *arg)
+{
+	struct ve_task_pool *pool = arg;
+	struct timespec next = {0};
+
+	VE_RPMLIB_TRACE("Entering");
+	pthread_mutex_lock(&pool->lock);
+	while (!pool->stop) {
+		pthread_mutex_unlock(&pool->lock);
+		ve_task_pool_refill(pool);
+		clock_gettime(CLOCK_MONOTONIC, &next);
+		next.tv_sec += pool->interval / 1000;
+		next.tv_nsec += (pool->interval % 1000) * 1000000;
+		if (next.tv_nsec >= 1000000000) {
+			next.tv_nsec -= 1000000000;
+			next.tv_sec++;
+		}
+		pthread_mutex_lock(&pool->lock);
+		/* A launch signals so that its slot is replaced at once */
+		if (!pool->stop)
+			pthread_cond_timedwait(&pool->cond, &pool->lock, &next);
+	}
+	pthread_mutex_unlock(&pool->lock);
+	VE_RPMLIB_TRACE("Exiting");
+	return NULL;
+}
+
+/**
+ * @brief This function starts a pool of host processes ready for jobs
+ *
+ *	  Each slot is a host process forked for one VE node. A background
+ *	  thread keeps 'size' slots on every node and lets them exit once
+ *	  the node has seen no launch for 'idle' milliseconds. The pool is
+ *	  filled once before returning.
+ *
+ * @param attr[in] Attributes of the pool, NULL for defaults
+ *
+ * @return Task pool on success and NULL on failure
+ */
+struct ve_task_pool *ve_task_pool_start(struct ve_task_pool_attr *attr)
+{
+	struct ve_task_pool *pool = NULL;
+	unsigned int nnode = 0;
+	int nodeid[VE_MAX_NODE] = {0};
+	pthread_condattr_t cattr;
+	int indx = 0;
+	int ret = 0;
+
+	VE_RPMLIB_TRACE("Entering");
+	if (attr && (0 > attr->size || 0 > attr->idle ||
+				0 > attr->interval || 0 > attr->nnode ||
+				VE_MAX_NODE < attr->nnode ||
+				(attr->nnode && !attr->nodeid))) {
+		VE_RPMLIB_ERR("Wrong argument received: size = %d, idle = %d,"
+				" interval = %d, nnode = %d", attr->size,
+				attr->idle, attr->interval, attr->nnode);
+		errno = EINVAL;
+		goto hndl_return;
+	}
+	pool = calloc(1, sizeof(struct ve_task_pool));
+	if (!pool) {
+		VE_RPMLIB_ERR("Memory allocation failed: %s",
+				strerror(errno));
+		goto hndl_return;
+	}
+	if (attr && attr->nnode) {
+		pool->nnode = attr->nnode;
+		for (indx = 0; indx < attr->nnode; indx++)
+			pool->node[indx].nodeid = attr->nodeid[indx];
+	} else {
+		if (0 > ve_get_nos(&nnode, nodeid)) {
+			VE_RPMLIB_ERR("Failed to get online VE nodes: %s",
+					strerror(errno));
+			goto hndl_free;
+		}
+		pool->nnode = nnode;
+		for (indx = 0; indx < nnode; indx++)
+			pool->node[indx].nodeid = nodeid[indx];
+	}
+	pool->size = (attr && attr->size) ? attr->size :
+				VE_TASK_POOL_DEF_SIZE;
+	pool->idle = attr ? attr->idle : 0;
+	pool->interval = (attr && attr->interval) ? attr->interval :
+				VE_TASK_POOL_DEF_INTERVAL;
+	for (indx = 0; indx < pool->nnode; indx++) {
+		snprintf(pool->node[indx].env, sizeof(pool->node[indx].env),
+				"%s%d", VE_TASK_POOL_NODE_ENV,
+				pool->node[indx].nodeid);
+		clock_gettime(CLOCK_MONOTONIC, &pool->node[indx].used);
+	}
+	pthread_mutex_init(&pool->lock, NULL);
+	pthread_condattr_init(&cattr);
+	pthread_condattr_setclock(&cattr, CLOCK_MONOTONIC);
+	pthread_cond_init(&pool->cond, &cattr);
+	pthread_condattr_destroy(&cattr);
+	ve_task_pool_refill(pool);
+
+	ret = pthread_create(&pool->thread, NULL, ve_task_pool_refiller, pool);
+	if (ret) {
+		VE_RPMLIB_ERR("Failed to create refiller thread: %s",
+				strerror(ret));
+		pool->stop = true;
+		ve_task_pool_stop(pool);
+		pool = NULL;
+		errno = ret;
+		goto hndl_return;
+	}
+	VE_RPMLIB_DEBUG("Keeping %d slots on %d nodes", pool->size,
+			pool->nnode);
+	goto hndl_return;
+hndl_free:
+	free(pool);
+	pool = NULL;
+hndl_return:
+	VE_RPMLIB_TRACE("Exiting");
+	return pool;
+}
+
+/**
+ * @brief This function launches a job in a slot of given VE node
+ *
+ *	  The job replaces the host process of the slot through execvpe(),
+ *	  inheriting the environment and standard streams the pool had when
+ *	  the slot was created, with VE_NODE_NUMBER set to 'nodeid'. The job
+ *	  creates its VE task itself. When the node has no slot
+ *	  left, one is created on the spot. The job is a child of the
+ *	  calling process; reap it with ve_task_pool_wait().
+ *
+ * @param pool[in] Task pool
+ * @param nodeid[in] VE node number
+ * @param argv[in] Command line of the job, NULL terminated
+ *
+ * @return PID of the job on success and -1 on failure
+ */
+pid_t ve_task_pool_launch(struct ve_task_pool *pool, int nodeid,
+				char *const argv[])
+{
+	struct ve_task_pool_node *node = NULL;
+	struct ve_task_slot *slot = NULL;
+	char buf[sizeof(uint32_t) + VE_TASK_POOL_ARG_MAX];
+	uint32_t len = 0;
+	size_t arg = 0;
+	ssize_t ret = 0;
+	size_t off = 0;
+	pid_t pid = -1;
+	int indx = 0;
+
+	VE_RPMLIB_TRACE("Entering");
+	if (!pool || !argv || !argv[0]) {
+		VE_RPMLIB_ERR("Wrong argument received: pool = %p, argv = %p",
+				pool, argv);
+		errno = EINVAL;
+		goto hndl_return;
+	}
+	for (indx = 0; argv[indx]; indx++) {
+		arg = strlen(argv[indx]) + 1;
+		if (VE_TASK_POOL_ARGC_MAX <= indx ||
+				VE_TASK_POOL_ARG_MAX - len < arg) {
+			VE_RPMLIB_ERR("Command line too long");
+			errno = E2BIG;
+			goto hndl_return;
+		}
+		memcpy(buf + sizeof(len) + len, argv[indx], arg);
+		len += arg;
+	}
+	memcpy(buf, &len, sizeof(len));
+
+	for (indx = 0; indx < pool->nnode; indx++)
+		if (pool->node[indx].nodeid == nodeid)
+			break;
+	if (indx == pool->nnode) {
+		VE_RPMLIB_ERR("Node %d is not pooled", nodeid);
+		errno = ENODEV;
+		goto hndl_return;
+	}
+	node = &pool->node[indx];
+
+	while (-1 == pid) {
+		pthread_mutex_lock(&pool->lock);
+		clock_gettime(CLOCK_MONOTONIC, &node->used);
+		slot = node->slot;
+		if (slot) {
+			node->slot = slot->next;
+			node->nslot--;
+		}
+		pthread_cond_signal(&pool->cond);
+		pthread_mutex_unlock(&pool->lock);
+		if (!slot) {
+			slot = ve_task_pool_create(node, 1);
+			if (!slot) {
+				errno = EAGAIN;
+				goto hndl_return;
+			}
+		}
+		for (off = 0; off < sizeof(len) + len; off += ret) {
+			ret = send(slot->fd, buf + off, sizeof(len) + len - off,
+					MSG_NOSIGNAL);
+			if (0 > ret && EINTR == errno)
+				ret = 0;
+			else if (0 > ret)
+				break;
+		}
+		if (0 > ret) {
+			/* The slot died, try the next one */
+			VE_RPMLIB_DEBUG("Slot %d is gone: %s", slot->pid,
+					strerror(errno));
+			ve_task_pool_delete(slot);
+			continue;
+		}
+		pid = slot->pid;
+		close(slot->fd);
+		free(slot);
+	}
+	VE_RPMLIB_DEBUG("Launched %s as %d on node %d", argv[0], pid, nodeid);
+hndl_return:
+	VE_RPMLIB_TRACE("Exiting");
+	return pid;
+}
+
+/**
+ * @brief This function waits for a job launched by the pool to exit
+ *
+ * @param pool[in] Task pool
+ * @param nodeid[in] VE node number the job was launched on
+ * @param pid[in] PID of the job
+ * @param status[out] Status as per waitpid(), NULL if not needed
+ *
+ * @return 0 on success and -1 on failure
+ */
+int ve_task_pool_wait(struct ve_task_pool *pool, int nodeid, pid_t pid,
+			int *status)
+{
+	int retval = -1;
+
+	VE_RPMLIB_TRACE("Entering");
+	if (!pool || 0 >= pid) {
+		VE_RPMLIB_ERR("Wrong argument received: pool = %p, pid = %d",
+				pool, pid);
+		errno = EINVAL;
+		goto hndl_return;
+	}
+	while (0 > (retval = waitpid(pid, status, 0)) && EINTR == errno)
+		;
+	if (0 > retval) {
+		VE_RPMLIB_ERR("Failed to wait for %d: %s", pid,
+				strerror(errno));
+		goto hndl_return;
+	}
+	retval = 0;
+	VE_RPMLIB_DEBUG("Job %d on node %d exited", pid, nodeid);
+hndl_return:
+	VE_RPMLIB_TRACE("Exiting");
+	return retval;
+}
+
+/**
+ * @brief This function stops task pool and deletes the slots left
+ *
+ *	  Jobs already launched are not affected.
+ *
+ * @param pool[in] Task pool
+ *
+ * @return 0 on success and -1 on failure
+ */
+int ve_task_pool_stop(struct ve_task_pool *pool)
+{
+	struct ve_task_slot *slot = NULL;
+	bool started = false;
+	int indx = 0;
+
+	VE_RPMLIB_TRACE("Entering");
+	if (!pool) {
+		VE_RPMLIB_ERR("Wrong argument received: pool = %p", pool);
+		errno = EINVAL;
+		return -1;
+	}
+	pthread_mutex_lock(&pool->lock);
+	started = !pool->stop;
+	pool->stop = true;
+	pthread_cond_signal(&pool->cond);
+	pthread_mutex_unlock(&pool->lock);
+	if (started)
+		pthread_join(pool->thread, NULL);
+	for (indx = 0; indx < pool->nnode; indx++) {
+		while (pool->node[indx].slot) {
+			slot = pool->node[indx].slot;
+			pool->node[indx].slot = slot->next;
+			ve_task_pool_delete(slot);
+		}
+	}
+	pthread_cond_destroy(&pool->cond);
+	pthread_mutex_destroy(&pool->lock);
+	free(pool);
+	VE_RPMLIB_TRACE("Exiting");
+	return 0;
+}
@@ -0,0 +1,787 @@
+/**
+ * Copyright (C) 2020 NEC Corporation
+ * This file is part of the VEOS information library.
+ *
+ * The VEOS information library is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either version
+ * 2.1 of the License, or (at your option) any later version.
+ *
+ * The VEOS information library is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with the VEOS information library; if not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+/**
+ * @file veosinfo_prof.c
+ * @brief Statistical profiler which periodically samples the instruction
+ * counter of the threads of a running VE process
+ *
+ * @internal
+ * @author RPM command
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <elf.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include "veosinfo.h"
+#include "veosinfo_log.h"
+#include "veosinfo_internal.h"
+
+#define NSEC_PER_SEC 1000000000ULL
+#define VE_PROF_MAX_INTERVAL NSEC_PER_SEC	/*!< Longest back-off interval */
+
+/**
+ * @brief Bucket of the histogram of instruction counters
+ *
+ * 'ic' is claimed once with compare-and-swap and never changes afterwards,
+ * so the sampler and readers access the histogram without a lock.
+ */
+struct ve_prof_bucket {
+	uint64_t ic;		/*!< Sampled address, 0 for empty bucket */
+	uint64_t count;		/*!< Number of samples of this address */
+};
+
+/**
+ * @brief Function symbol of the profiled VE executable
+ */
+struct ve_prof_sym {
+	uint64_t addr;		/*!< Start address */
+	uint64_t size;		/*!< Size in bytes */
+	const char *name;	/*!< Name in the string table of the mapping */
+};
+
+/**
+ * @brief Aggregated samples of a symbol or unknown address for output
+ */
+struct ve_prof_line {
+	uint64_t addr;		/*!< Address or start of symbol */
+	uint64_t count;		/*!< Number of samples */
+	const char *name;	/*!< Symbol name, NULL if unknown */
+};
+
+/**
+ * @brief State of the profiler
+ */
+struct ve_prof {
+	int nodeid;			/*!< VE node number */
+	pid_t pid;			/*!< PID of the profiled VE process */
+	struct ve_prof_attr attr;	/*!< Attributes with defaults applied */
+	char comm[FILENAME + 1];	/*!< Root frame of folded output */
+	struct ve_prof_bucket *hist;	/*!< Histogram of addresses */
+	uint64_t mask;			/*!< Number of buckets - 1 */
+	struct ve_prof_sym *sym;	/*!< Function symbols sorted by address */
+	int nsym;			/*!< Number of symbols */
+	void *map;			/*!< Mapping of the executable */
+	size_t map_len;			/*!< Length of the mapping */
+	pthread_t thread;		/*!< Sampler thread */
+	bool joined;			/*!< Sampler thread has been joined */
+	int stop;			/*!< Request the sampler to stop */
+	int running;			/*!< Sampler is running */
+	uint64_t ticks;			/*!< Statistics updated by sampler */
+	uint64_t samples;
+	uint64_t idle;
+	uint64_t dropped;
+	uint64_t errors;
+	uint64_t distinct;
+	uint64_t interval;		/*!< Current interval in nanoseconds */
+	uint64_t overhead;		/*!< Overhead in parts per million */
+	struct timespec start;		/*!< Time the sampler started */
+	struct timespec end;		/*!< Time the sampler stopped */
+};
+
+/**
+ * @brief This function returns the nanoseconds between two instants
+ */
+static uint64_t ve_prof_ns(const struct timespec *from,
+			const struct timespec *to)
+{
+	return (to->tv_sec - from->tv_sec) * NSEC_PER_SEC +
+		to->tv_nsec - from->tv_nsec;
+}
+
+/**
+ * @brief This function records one sample in the histogram
+ *
+ * @param prof[in] Profiler
+ * @param ic[in] Sampled instruction counter
+ */
+static void ve_prof_hist_add(struct ve_prof *prof, uint64_t ic)
+{
+	uint64_t indx = 0;
+	uint64_t probe = 0;
+	uint64_t key = 0;
+
+	if (!ic) {
+		__atomic_fetch_add(&prof->dropped, 1, __ATOMIC_RELAXED);
+		return;
+	}
+	/* VE instructions are 8 bytes aligned, drop the low bits before
+	 * Fibonacci hashing */
+	indx = ((ic >> 3) * 0x9E3779B97F4A7C15ULL) >> 32;
+	for (probe = 0; probe <= prof->mask; probe++) {
+		indx &= prof->mask;
+		key = __atomic_load_n(&prof->hist[indx].ic, __ATOMIC_ACQUIRE);
+		if (!key) {
+			if (__atomic_compare_exchange_n(&prof->hist[indx].ic,
+					&key, ic, false, __ATOMIC_ACQ_REL,
+					__ATOMIC_ACQUIRE))
+				__atomic_fetch_add(&prof->distinct, 1,
+						__ATOMIC_RELAXED);
+			/* On failure 'key' holds the address which won */
+			key = __atomic_load_n(&prof->hist[indx].ic,
+					__ATOMIC_ACQUIRE);
+		}
+		if (key == ic) {
+			__atomic_fetch_add(&prof->hist[indx].count, 1,
+					__ATOMIC_RELAXED);
+			return;
+		}
+		indx++;
+	}
+	__atomic_fetch_add(&prof->dropped, 1, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief This function compares symbols by address for qsort()
+ */
+static int ve_prof_sym_cmp(const void *a, const void *b)
+{
+	const struct ve_prof_sym *x = a;
+	const struct ve_prof_sym *y = b;
+
+	if (x->addr != y->addr)
+		return x->addr < y->addr ? -1 : 1;
+	/* Prefer the symbol with a size among aliases */
+	return x->size < y->size ? 1 : (x->size > y->size ? -1 : 0);
+}
+
+/**
+ * @brief This function loads the function symbols of VE executable
+ *
+ * @param prof[in/out] Profiler
+ * @param exe[in] Path of VE executable
+ *
+ * @return 0 on success and -1 on failure
+ */
+static int ve_prof_load_syms(struct ve_prof *prof, const char *exe)
+{
+	int retval = -1;
+	int fd = -1;
+	int indx = 0;
+	int nsym = 0;
+	uint64_t cnt = 0;
+	uint64_t i = 0;
+	struct stat st = {0};
+	Elf64_Ehdr *ehdr = NULL;
+	Elf64_Shdr *shdr = NULL;
+	Elf64_Shdr *symsh = NULL;
+	Elf64_Shdr *strsh = NULL;
+	Elf64_Sym *esym = NULL;
+	char *base = NULL;
+
+	VE_RPMLIB_TRACE("Entering");
+	fd = open(exe, O_RDONLY | O_CLOEXEC);
+	if (0 > fd) {
+		VE_RPMLIB_ERR("Failed(%s) to open ELF file: %s",
+				strerror(errno), exe);
+		goto hndl_return;
+	}
+	if (0 > fstat(fd, &st)) {
+		VE_RPMLIB_ERR("Failed(%s) to stat ELF file", strerror(errno));
+		goto hndl_close;
+	}
+	if ((size_t)st.st_size < sizeof(Elf64_Ehdr)) {
+		errno = ENOEXEC;
+		goto hndl_noexec;
+	}
+	prof->map_len = st.st_size;
+	prof->map = mmap(NULL, prof->map_len, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (MAP_FAILED == prof->map) {
+		prof->map = NULL;
+		VE_RPMLIB_ERR("Failed(%s) to map ELF file", strerror(errno));
+		goto hndl_close;
+	}
+	base = prof->map;
+	ehdr = prof->map;
+	/* Check the format of given executable */
+	if (memcmp(ehdr->e_ident, ELFMAG, SELFMAG) ||
+			ehdr->e_ident[EI_CLASS] != ELFCLASS64 ||
+			ELF_VE != ehdr->e_machine ||
+			ehdr->e_shentsize != sizeof(Elf64_Shdr) ||
+			ehdr->e_shoff > prof->map_len ||
+			ehdr->e_shnum > (prof->map_len - ehdr->e_shoff) /
+						sizeof(Elf64_Shdr)) {
+		errno = ENOEXEC;
+		goto hndl_noexec;
+	}
+	shdr = (Elf64_Shdr *)(base + ehdr->e_shoff);
+	for (indx = 0; indx < ehdr->e_shnum; indx++) {
+		if (SHT_SYMTAB == shdr[indx].sh_type)
+			symsh = &shdr[indx];
+		else if (SHT_DYNSYM == shdr[indx].sh_type && !symsh)
+			symsh = &shdr[indx];
+	}
+	if (!symsh || symsh->sh_link >= ehdr->e_shnum) {
+		VE_RPMLIB_DEBUG("No symbol table in %s", exe);
+		retval = 0;
+		goto hndl_close;
+	}
+	strsh = &shdr[symsh->sh_link];
+	if (symsh->sh_offset > prof->map_len ||
+			symsh->sh_size > prof->map_len - symsh->sh_offset ||
+			strsh->sh_offset > prof->map_len ||
+			strsh->sh_size > prof->map_len - strsh->sh_offset) {
+		errno = ENOEXEC;
+		goto hndl_noexec;
+	}
+	esym = (Elf64_Sym *)(base + symsh->sh_offset);
+	cnt = symsh->sh_size / sizeof(Elf64_Sym);
+	prof->sym = calloc(cnt ? cnt : 1, sizeof(struct ve_prof_sym));
+	if (!prof->sym) {
+		VE_RPMLIB_ERR("Memory allocation failed: %s",
+				strerror(errno));
+		goto hndl_close;
+	}
+	for (i = 0; i < cnt; i++) {
+		if (ELF64_ST_TYPE(esym[i].st_info) != STT_FUNC ||
+				!esym[i].st_value ||
+				esym[i].st_name >= strsh->sh_size)
+			continue;
+		prof->sym[nsym].addr = esym[i].st_value;
+		prof->sym[nsym].size = esym[i].st_size;
+		prof->sym[nsym].name = base + strsh->sh_offset +
+					esym[i].st_name;
+		nsym++;
+	}
+	qsort(prof->sym, nsym, sizeof(struct ve_prof_sym), ve_prof_sym_cmp);
+	/* Drop aliases and give symbols without size the room up to the
+	 * next symbol */
+	prof->nsym = 0;
+	for (indx = 0; indx < nsym; indx++) {
+		if (prof->nsym &&
+			prof->sym[prof->nsym - 1].addr == prof->sym[indx].addr)
+			continue;
+		prof->sym[prof->nsym++] = prof->sym[indx];
+	}
+	for (indx = 0; indx < prof->nsym - 1; indx++) {
+		if (!prof->sym[indx].size)
+			prof->sym[indx].size = prof->sym[indx + 1].addr -
+						prof->sym[indx].addr;
+	}
+	VE_RPMLIB_DEBUG("Loaded %d function symbols from %s",
+			prof->nsym, exe);
+	retval = 0;
+	goto hndl_close;
+
+hndl_noexec:
+	VE_RPMLIB_ERR("This is not VE ELF file: %s", exe);
+hndl_close:
+	close(fd);
+hndl_return:
+	VE_RPMLIB_TRACE("Exiting");
+	return retval;
+}
+
+/**
+ * @brief This function looks up the symbol containing given address
+ *
+ * @param prof[in] Profiler
+ * @param addr[in] Address
+ *
+ * @return Symbol on success and NULL if the address is not known
+ */
+static struct ve_prof_sym *ve_prof_sym_find(struct ve_prof *prof,
+					uint64_t addr)
+{
+	int lo = 0;
+	int hi = prof->nsym - 1;
+	int mid = 0;
+
+	while (lo <= hi) {
+		mid = lo + (hi - lo) / 2;
+		if (prof->sym[mid].addr > addr)
+			hi = mid - 1;
+		else
+			lo = mid + 1;
+	}
+	/* 'hi' is the last symbol starting at or before 'addr' */
+	if (hi < 0 || !prof->sym[hi].size ||
+			addr - prof->sym[hi].addr >= prof->sym[hi].size)
+		return NULL;
+	return &prof->sym[hi];
+}
+
+/**
+ * @brief This function takes one sample of the running threads
+ *
+ * @param prof[in] Profiler
+ * @param threads[in] Buffer to enumerate threads
+ * @param req[in/out] Buffer of register requests, may be reallocated
+ * @param val[in/out] Buffer of register values, may be reallocated
+ * @param size[in/out] Number of entries in 'req' and 'val'
+ *
+ * @return 0 on success, 1 if the process exited and -1 on failure
+ */
+static int ve_prof_tick(struct ve_prof *prof, struct ve_thread_info *threads,
+			struct ve_regvals_req **req, uint64_t **val, int *size)
+{
+	int retval = -1;
+	int indx = 0;
+	int nreq = 0;
+	pid_t cursor = 0;
+	void *tmp = NULL;
+	static int regid = VE_REG_IC;
+
+	do {
+		retval = ve_thread_info(prof->nodeid, prof->pid, cursor,
+					threads);
+		if (-ESRCH == retval)
+			return 1;
+		if (0 > retval)
+			return -1;
+		for (indx = 0; indx < threads->len; indx++) {
+			if (!prof->attr.all_threads &&
+					'R' != threads->thread[indx].state)
+				continue;
+			if (nreq == *size) {
+				tmp = realloc(*req, sizeof(**req) * *size * 2);
+				if (!tmp)
+					return -1;
+				*req = tmp;
+				tmp = realloc(*val, sizeof(**val) * *size * 2);
+				if (!tmp)
+					return -1;
+				*val = tmp;
+				*size *= 2;
+			}
+			(*req)[nreq].pid = threads->thread[indx].tid;
+			(*req)[nreq].numregs = 1;
+			(*req)[nreq].regid = &regid;
+			nreq++;
+		}
+		cursor = threads->cursor;
+	} while (threads->more);
+
+	if (!nreq) {
+		__atomic_fetch_add(&prof->idle, 1, __ATOMIC_RELAXED);
+		return 0;
+	}
+	/* Buffers may have moved while growing */
+	for (indx = 0; indx < nreq; indx++)
+		(*req)[indx].regval = &(*val)[indx];
+	if (0 > ve_get_regvals_batch(prof->nodeid, nreq, *req))
+		return -1;
+	for (indx = 0; indx < nreq; indx++) {
+		if ((*req)[indx].status)
+			continue;
+		ve_prof_hist_add(prof, (*val)[indx]);
+		__atomic_fetch_add(&prof->samples, 1, __ATOMIC_RELAXED);
+	}
+	return 0;
+}
+
+/**
+ * @brief Sampler thread of the profiler
+ *
+ *	  The time spent in each tick is measured against the interval. When
+ *	  a tick costs more than the configured share of the interval, the
+ *	  interval is doubled, and it is halved back towards the requested
+ *	  rate once ticks cost well below the limit.
+ *
+ * @param arg[in] Profiler
+ *
+ * @return NULL
+ */
+static void *ve_prof_sampler(void *arg)
+{
+	struct ve_prof *prof = arg;
+	struct ve_thread_info *threads = NULL;
+	struct ve_regvals_req *req = NULL;
+	uint64_t *val = NULL;
+	int size = VE_THREAD_INFO_MAX;
+	int ret = 0;
+	uint64_t nominal = NSEC_PER_SEC / prof->attr.rate;
+	uint64_t interval = nominal;
+	uint64_t busy = 0;
+	double overhead = 0;
+	double demand = 0;
+	double limit = prof->attr.max_overhead / 100;
+	struct timespec next = {0};
+	struct timespec begin = {0};
+	struct timespec prev = {0};
+	struct timespec now = {0};
+
+	VE_RPMLIB_TRACE("Entering");
+	threads = malloc(sizeof(struct ve_thread_info));
+	req = calloc(size, sizeof(struct ve_regvals_req));
+	val = calloc(size, sizeof(uint64_t));
+	if (!threads || !req || !val) {
+		VE_RPMLIB_ERR("Memory allocation failed: %s",
+				strerror(errno));
+		goto hndl_return;
+	}
+	next = prof->start;
+	while (!__atomic_load_n(&prof->stop, __ATOMIC_ACQUIRE)) {
+		clock_gettime(CLOCK_MONOTONIC, &begin);
+		ret = ve_prof_tick(prof, threads, &req, &val, &size);
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		__atomic_fetch_add(&prof->ticks, 1, __ATOMIC_RELAXED);
+		if (1 == ret) {
+			VE_RPMLIB_DEBUG("VE process %d exited", prof->pid);
+			break;
+		}
+		if (0 > ret)
+			__atomic_fetch_add(&prof->errors, 1, __ATOMIC_RELAXED);
+
+		/* Report the share of wall clock time spent in sampling, and
+		 * adapt the interval to what the last tick would have cost */
+		busy = ve_prof_ns(&begin, &now);
+		if (prev.tv_sec || prev.tv_nsec)
+			overhead = 0.875 * overhead + 0.125 * ((double)busy /
+					ve_prof_ns(&prev, &now));
+		prev = begin;
+		demand = (double)busy / interval;
+		if (limit > 0 && demand > limit &&
+				interval < VE_PROF_MAX_INTERVAL) {
+			interval *= 2;
+			VE_RPMLIB_DEBUG("Sampling backs off to %llu ns",
+					(unsigned long long)interval);
+		} else if (interval > nominal && demand < limit / 4) {
+			interval /= 2;
+			if (interval < nominal)
+				interval = nominal;
+		}
+		__atomic_store_n(&prof->interval, interval, __ATOMIC_RELAXED);
+		__atomic_store_n(&prof->overhead,
+				(uint64_t)(overhead * 1000000), __ATOMIC_RELAXED);
+
+		next.tv_nsec += interval;
+		while (next.tv_nsec >= (long)NSEC_PER_SEC) {
+			next.tv_nsec -= NSEC_PER_SEC;
+			next.tv_sec++;
+		}
+		/* Do not try to catch up ticks missed while VEOS was slow */
+		if (ve_prof_ns(&now, &next) > interval)
+			next = now;
+		clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+	}
+hndl_return:
+	clock_gettime(CLOCK_MONOTONIC, &prof->end);
+	__atomic_store_n(&prof->running, 0, __ATOMIC_RELEASE);
+	free(threads);
+	free(req);
+	free(val);
+	VE_RPMLIB_TRACE("Exiting");
+	return NULL;
+}
+
+/**
+ * @brief This function starts profiling of a running VE process
+ *
+ * @param nodeid[in] VE node number
+ * @param pid[in] PID of VE process
+ * @param exe[in] Path of VE executable to symbolize addresses, NULL to
+ *		  report raw addresses
+ * @param attr[in] Attributes of profiler, NULL for defaults
+ *
+ * @return Profiler on success and NULL on failure
+ */
+struct ve_prof *ve_prof_start(int nodeid, pid_t pid, const char *exe,
+				struct ve_prof_attr *attr)
+{
+	struct ve_prof *prof = NULL;
+	const char *comm = NULL;
+	uint64_t nbucket = 1;
+	int ret = -1;
+
+	VE_RPMLIB_TRACE("Entering");
+	if (0 >= pid || (attr && (attr->rate > VE_PROF_MAX_RATE ||
+					attr->max_overhead < 0))) {
+		VE_RPMLIB_ERR("Wrong argument received: pid = %d, attr = %p",
+				pid, attr);
+		errno = EINVAL;
+		goto hndl_return;
+	}
+	prof = calloc(1, sizeof(struct ve_prof));
+	if (!prof) {
+		VE_RPMLIB_ERR("Memory allocation failed: %s",
+				strerror(errno));
+		goto hndl_return;
+	}
+	prof->nodeid = nodeid;
+	prof->pid = pid;
+	prof->joined = true;
+	if (attr)
+		prof->attr = *attr;
+	if (!prof->attr.rate)
+		prof->attr.rate = VE_PROF_DEF_RATE;
+	if (!prof->attr.hist_size)
+		prof->attr.hist_size = VE_PROF_DEF_HIST;
+	/* Keep the table at most half full for short probe sequences */
+	while (nbucket < 2ULL * prof->attr.hist_size)
+		nbucket <<= 1;
+	prof->mask = nbucket - 1;
+	prof->hist = calloc(nbucket, sizeof(struct ve_prof_bucket));
+	if (!prof->hist) {
+		VE_RPMLIB_ERR("Memory allocation failed: %s",
+				strerror(errno));
+		goto hndl_free;
+	}
+	if (exe) {
+		if (0 > ve_prof_load_syms(prof, exe))
+			goto hndl_free;
+		comm = strrchr(exe, '/');
+		comm = comm ? comm + 1 : exe;
+		snprintf(prof->comm, sizeof(prof->comm), "%s", comm);
+	} else {
+		snprintf(prof->comm, sizeof(prof->comm), "%d", pid);
+	}
+
+	prof->interval = NSEC_PER_SEC / prof->attr.rate;
+	prof->running = 1;
+	clock_gettime(CLOCK_MONOTONIC, &prof->start);
+	ret = pthread_create(&prof->thread, NULL, ve_prof_sampler, prof);
+	if (ret) {
+		VE_RPMLIB_ERR("Failed to create sampler thread: %s",
+				strerror(ret));
+		errno = ret;
+		goto hndl_free;
+	}
+	prof->joined = false;
+	VE_RPMLIB_DEBUG("Profiling VE process %d at %u Hz",
+			pid, prof->attr.rate);
+	goto hndl_return;
+
+hndl_free:
+	ret = errno;
+	ve_prof_free(prof);
+	prof = NULL;
+	errno = ret;
+hndl_return:
+	VE_RPMLIB_TRACE("Exiting");
+	return prof;
+}
+
+/**
+ * @brief This function stops the sampler of profiler
+ *
+ *	  Collected samples stay available for ve_prof_write().
+ *
+ * @param prof[in] Profiler
+ *
+ * @return 0 on success and -1 on failure
+ */
+int ve_prof_stop(struct ve_prof *prof)
+{
+	VE_RPMLIB_TRACE("Entering");
+	if (!prof) {
+		VE_RPMLIB_ERR("Wrong argument received: prof = %p", prof);
+		errno = EINVAL;
+		return -1;
+	}
+	if (!prof->joined) {
+		__atomic_store_n(&prof->stop, 1, __ATOMIC_RELEASE);
+		pthread_join(prof->thread, NULL);
+		prof->joined = true;
+	}
+	VE_RPMLIB_TRACE("Exiting");
+	return 0;
+}
+
+/**
+ * @brief This function gets the statistics of profiler
+ *
+ *	  It can be called while the sampler is running.
+ *
+ * @param prof[in] Profiler
+ * @param stat[out] Statistics of profiler
+ *
+ * @return 0 on success and -1 on failure
+ */
+int ve_prof_stats(struct ve_prof *prof, struct ve_prof_stat *stat)
+{
+	struct timespec now = {0};
+
+	if (!prof || !stat) {
+		VE_RPMLIB_ERR("Wrong argument received: prof = %p, stat = %p",
+				prof, stat);
+		errno = EINVAL;
+		return -1;
+	}
+	stat->running = __atomic_load_n(&prof->running, __ATOMIC_ACQUIRE);
+	if (stat->running)
+		clock_gettime(CLOCK_MONOTONIC, &now);
+	else
+		now = prof->end;
+	stat->ticks = __atomic_load_n(&prof->ticks, __ATOMIC_RELAXED);
+	stat->samples = __atomic_load_n(&prof->samples, __ATOMIC_RELAXED);
+	stat->idle = __atomic_load_n(&prof->idle, __ATOMIC_RELAXED);
+	stat->dropped = __atomic_load_n(&prof->dropped, __ATOMIC_RELAXED);
+	stat->errors = __atomic_load_n(&prof->errors, __ATOMIC_RELAXED);
+	stat->distinct = __atomic_load_n(&prof->distinct, __ATOMIC_RELAXED);
+	stat->rate = (double)NSEC_PER_SEC /
+			__atomic_load_n(&prof->interval, __ATOMIC_RELAXED);
+	stat->overhead = __atomic_load_n(&prof->overhead, __ATOMIC_RELAXED) /
+				10000.0;
+	stat->elapsed = (double)ve_prof_ns(&prof->start, &now) / NSEC_PER_SEC;
+	return 0;
+}
+
+/**
+ * @brief This function compares output lines by address for qsort()
+ */
+static int ve_prof_line_addr_cmp(const void *a, const void *b)
+{
+	const struct ve_prof_line *x = a;
+	const struct ve_prof_line *y = b;
+
+	return x->addr < y->addr ? -1 : (x->addr > y->addr);
+}
+
+/**
+ * @brief This function compares output lines by samples for qsort()
+ */
+static int ve_prof_line_count_cmp(const void *a, const void *b)
+{
+	const struct ve_prof_line *x = a;
+	const struct ve_prof_line *y = b;
+
+	if (x->count != y->count)
+		return x->count < y->count ? 1 : -1;
+	return ve_prof_line_addr_cmp(a, b);
+}
+
+/**
+ * @brief This function writes the profile collected so far
+ *
+ *	  Only the instruction counter is sampled, so each folded stack
+ *	  consists of the process and the function which was executing.
+ *
+ * @param prof[in] Profiler
+ * @param fp[in] Stream to write to
+ * @param format[in] VE_PROF_FLAT or VE_PROF_FOLDED
+ *
+ * @return 0 on success and -1 on failure
+ */
+int ve_prof_write(struct ve_prof *prof, FILE *fp, int format)
+{
+	int retval = -1;
+	int nline = 0;
+	int out = 0;
+	int indx = 0;
+	uint64_t bucket = 0;
+	uint64_t ic = 0;
+	uint64_t total = 0;
+	struct ve_prof_line *line = NULL;
+	struct ve_prof_sym *sym = NULL;
+	struct ve_prof_stat stat = {0};
+
+	VE_RPMLIB_TRACE("Entering");
+	if (!prof || !fp ||
+		(VE_PROF_FLAT != format && VE_PROF_FOLDED != format)) {
+		VE_RPMLIB_ERR("Wrong argument received: prof = %p, fp = %p, "
+				"format = %d", prof, fp, format);
+		errno = EINVAL;
+		goto hndl_return;
+	}
+	line = calloc(prof->mask + 1, sizeof(struct ve_prof_line));
+	if (!line) {
+		VE_RPMLIB_ERR("Memory allocation failed: %s",
+				strerror(errno));
+		goto hndl_return;
+	}
+	/* Snapshot the histogram, buckets may still be filled meanwhile */
+	for (bucket = 0; bucket <= prof->mask; bucket++) {
+		ic = __atomic_load_n(&prof->hist[bucket].ic, __ATOMIC_ACQUIRE);
+		if (!ic)
+			continue;
+		line[nline].addr = ic;
+		line[nline].count = __atomic_load_n(&prof->hist[bucket].count,
+						__ATOMIC_RELAXED);
+		if (line[nline].count)
+			nline++;
+	}
+	/* Merge addresses of the same function */
+	qsort(line, nline, sizeof(struct ve_prof_line), ve_prof_line_addr_cmp);
+	for (indx = 0; indx < nline; indx++) {
+		total += line[indx].count;
+		sym = ve_prof_sym_find(prof, line[indx].addr);
+		if (sym && out && line[out - 1].name == sym->name) {
+			line[out - 1].count += line[indx].count;
+			continue;
+		}
+		line[out].count = line[indx].count;
+		line[out].addr = sym ? sym->addr : line[indx].addr;
+		line[out].name = sym ? sym->name : NULL;
+		out++;
+	}
+	qsort(line, out, sizeof(struct ve_prof_line), ve_prof_line_count_cmp);
+
+	if (VE_PROF_FLAT == format) {
+		ve_prof_stats(prof, &stat);
+		fprintf(fp, "# pid %d, %llu samples in %.3f s, %.1f Hz, "
+			"overhead %.2f%%, dropped %llu\n", prof->pid,
+			(unsigned long long)total, stat.elapsed, stat.rate,
+			stat.overhead, (unsigned long long)stat.dropped);
+		fprintf(fp, "# %%samples    samples  function\n");
+	}
+	for (indx = 0; indx < out; indx++) {
+		if (VE_PROF_FOLDED == format)
+			fprintf(fp, "%s;", prof->comm);
+		else
+			fprintf(fp, "%10.2f %10llu  ",
+				100.0 * line[indx].count / total,
+				(unsigned long long)line[indx].count);
+		if (line[indx].name)
+			fprintf(fp, "%s", line[indx].name);
+		else
+			fprintf(fp, "[0x%llx]",
+				(unsigned long long)line[indx].addr);
+		if (VE_PROF_FOLDED == format)
+			fprintf(fp, " %llu",
+				(unsigned long long)line[indx].count);
+		fputc('\n', fp);
+	}
+	if (ferror(fp)) {
+		VE_RPMLIB_ERR("Failed to write profile");
+		errno = EIO;
+		goto hndl_free;
+	}
+	retval = 0;
+hndl_free:
+	free(line);
+hndl_return:
+	VE_RPMLIB_TRACE("Exiting");
+	return retval;
+}
+
+/**
+ * @brief This function stops the profiler and releases its memory
+ *
+ * @param prof[in] Profiler
+ */
+void ve_prof_free(struct ve_prof *prof)
+{
+	if (!prof)
+		return;
+	ve_prof_stop(prof);
+	if (prof->map)
+		munmap(prof->map, prof->map_len);
+	free(prof->sym);
+	free(prof->hist);
+	free(prof);
+}
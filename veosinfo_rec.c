@@ -0,0 +1,659 @@
+/**
+ * Copyright (C) 2020 NEC Corporation
+ * This file is part of the VEOS information library.
+ *
+ * The VEOS information library is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either version
+ * 2.1 of the License, or (at your option) any later version.
+ *
+ * The VEOS information library is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with the VEOS information library; if not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+/**
+ * @file veosinfo_rec.c
+ * @brief Records node metrics periodically into a memory-mapped ring file
+ * which other processes can read without asking VEOS
+ *
+ * @internal
+ * @author RPM command
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include "veosinfo.h"
+#include "veosinfo_log.h"
+#include "veosinfo_internal.h"
+
+#define VE_REC_HDR_LEN	4096	/*!< Length of file header */
+#define VE_REC_ALIGN(x)	(((x) + 7) & ~(size_t)7)
+#define VE_REC_RETRY	16	/*!< Attempts to read a record being written */
+
+/**
+ * @brief State of the recorder
+ */
+struct ve_rec {
+	int nodeid;			/*!< VE node number */
+	int fd;				/*!< Recorder file */
+	struct ve_rec_reader map;	/*!< Mapping of the file */
+	struct ve_rec_hdr *buf;		/*!< Record being sampled */
+	struct ve_pwr_temp *temp;	/*!< Buffers of sensor reads */
+	struct ve_pwr_fan *fan;
+	struct ve_pwr_voltage *volt;
+	pthread_t thread;		/*!< Sampler thread */
+	pthread_mutex_t lock;		/*!< Protects 'stop' */
+	pthread_cond_t cond;		/*!< Signals 'stop' */
+	bool stop;			/*!< Request the sampler to stop */
+};
+
+/**
+ * @brief This function returns the size of a metric in a record
+ *
+ * @param bit[in] VE_REC_* metric
+ *
+ * @return Size in bytes
+ */
+static size_t ve_rec_size(int bit)
+{
+	switch (bit) {
+	case VE_REC_MEM:
+		return sizeof(struct ve_meminfo);
+	case VE_REC_STAT:
+		return sizeof(struct ve_statinfo);
+	case VE_REC_LOADAVG:
+		return sizeof(struct ve_loadavg);
+	case VE_REC_NUMA:
+		return sizeof(struct ve_numa_stat);
+	case VE_REC_SWAP:
+		return sizeof(struct ve_swap_node_info);
+	case VE_REC_SENSOR:
+		return sizeof(struct ve_rec_sensor);
+	}
+	return 0;
+}
+
+/**
+ * @brief This function returns the offset of a metric in a record
+ *
+ * @param mask[in] VE_REC_* metrics of the file
+ * @param bit[in] VE_REC_* metric, or VE_REC_ALL + 1 for the record size
+ *
+ * @return Offset in bytes from the record header
+ */
+static size_t ve_rec_offset(int mask, int bit)
+{
+	size_t offset = VE_REC_ALIGN(sizeof(struct ve_rec_hdr));
+	int cur = 0;
+
+	for (cur = 1; cur < bit && cur <= VE_REC_ALL; cur <<= 1)
+		if (mask & cur)
+			offset += VE_REC_ALIGN(ve_rec_size(cur));
+	return offset;
+}
+
+/**
+ * @brief This function returns the record in given slot of the file
+ */
+static struct ve_rec_hdr *ve_rec_slot(struct ve_rec_reader *reader,
+					uint64_t index)
+{
+	return (struct ve_rec_hdr *)((char *)reader->map + VE_REC_HDR_LEN +
+		(index % reader->file->nslot) * reader->file->record_size);
+}
+
+/**
+ * @brief This function returns a metric of a record
+ *
+ * @param reader[in] Reader attached to the file
+ * @param rec[in] Record read by ve_rec_read()
+ * @param bit[in] VE_REC_* metric
+ *
+ * @return Pointer to the metric on success and NULL if the record does not
+ *	   have it
+ */
+void *ve_rec_field(struct ve_rec_reader *reader, struct ve_rec_hdr *rec,
+			int bit)
+{
+	if (!reader || !reader->file || !rec || !(rec->mask & bit) ||
+			(bit & (bit - 1)))
+		return NULL;
+	return (char *)rec + ve_rec_offset(reader->file->mask, bit);
+}
+
+/**
+ * @brief This function fetches the metrics into the record buffer
+ *
+ * @param rec[in] Recorder
+ * @param mask[in] VE_REC_* metrics to fetch
+ */
+static void ve_rec_fetch(struct ve_rec *rec, int mask)
+{
+	struct ve_rec_reader *reader = &rec->map;
+	struct ve_rec_hdr *buf = rec->buf;
+	struct ve_rec_sensor *sensor = NULL;
+	struct timespec now = {0};
+	int indx = 0;
+
+	memset(buf, '\0', reader->file->record_size);
+	clock_gettime(CLOCK_REALTIME, &now);
+	buf->time = (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+	buf->mask = mask;
+	if ((mask & VE_REC_MEM) && 0 > ve_mem_info(rec->nodeid,
+			(struct ve_meminfo *)((char *)buf +
+				ve_rec_offset(mask, VE_REC_MEM))))
+		buf->mask &= ~VE_REC_MEM;
+	if ((mask & VE_REC_STAT) && 0 > ve_stat_info(rec->nodeid,
+			(struct ve_statinfo *)((char *)buf +
+				ve_rec_offset(mask, VE_REC_STAT))))
+		buf->mask &= ~VE_REC_STAT;
+	if ((mask & VE_REC_LOADAVG) && 0 > ve_loadavg_info(rec->nodeid,
+			(struct ve_loadavg *)((char *)buf +
+				ve_rec_offset(mask, VE_REC_LOADAVG))))
+		buf->mask &= ~VE_REC_LOADAVG;
+	if ((mask & VE_REC_NUMA) && 0 > ve_numa_info(rec->nodeid,
+			(struct ve_numa_stat *)((char *)buf +
+				ve_rec_offset(mask, VE_REC_NUMA))))
+		buf->mask &= ~VE_REC_NUMA;
+	if ((mask & VE_REC_SWAP) && 0 > ve_swap_nodeinfo(rec->nodeid,
+			(struct ve_swap_node_info *)((char *)buf +
+				ve_rec_offset(mask, VE_REC_SWAP))))
+		buf->mask &= ~VE_REC_SWAP;
+	if (mask & VE_REC_SENSOR) {
+		sensor = (struct ve_rec_sensor *)((char *)buf +
+				ve_rec_offset(mask, VE_REC_SENSOR));
+		if (0 > ve_read_temp(rec->nodeid, rec->temp) ||
+				0 > ve_read_fan(rec->nodeid, rec->fan) ||
+				0 > ve_read_voltage(rec->nodeid, rec->volt)) {
+			buf->mask &= ~VE_REC_SENSOR;
+		} else {
+			sensor->ntemp = rec->temp->count < VE_REC_MAX_SENSOR ?
+					rec->temp->count : VE_REC_MAX_SENSOR;
+			sensor->nfan = rec->fan->count < VE_REC_MAX_SENSOR ?
+					rec->fan->count : VE_REC_MAX_SENSOR;
+			sensor->nvolt = rec->volt->count < VE_REC_MAX_SENSOR ?
+					rec->volt->count : VE_REC_MAX_SENSOR;
+			for (indx = 0; indx < sensor->ntemp; indx++)
+				sensor->temp[indx] = rec->temp->ve_temp[indx];
+			for (indx = 0; indx < sensor->nfan; indx++)
+				sensor->fan[indx] = rec->fan->fan_speed[indx];
+			for (indx = 0; indx < sensor->nvolt; indx++)
+				sensor->volt[indx] = rec->volt->cpu_volt[indx];
+		}
+	}
+	if (buf->mask != (uint32_t)mask)
+		VE_RPMLIB_DEBUG("Recorded 0x%x of 0x%x", buf->mask, mask);
+}
+
+/**
+ * @brief This function publishes the sampled record into the ring
+ *
+ *	  The slot is written under its sequence counter so that readers
+ *	  detect a record being overwritten and retry.
+ *
+ * @param rec[in] Recorder
+ */
+static void ve_rec_publish(struct ve_rec *rec)
+{
+	struct ve_rec_file *file = rec->map.file;
+	uint64_t index = __atomic_load_n(&file->next, __ATOMIC_RELAXED);
+	struct ve_rec_hdr *slot = ve_rec_slot(&rec->map, index);
+	uint32_t seq = __atomic_load_n(&slot->seq, __ATOMIC_RELAXED) | 1;
+
+	__atomic_store_n(&slot->seq, seq, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	rec->buf->index = index;
+	memcpy((char *)slot + sizeof(slot->seq),
+		(char *)rec->buf + sizeof(slot->seq),
+		file->record_size - sizeof(slot->seq));
+	__atomic_store_n(&slot->seq, seq + 1, __ATOMIC_RELEASE);
+	__atomic_store_n(&file->next, index + 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief Sampler thread of the recorder
+ *
+ * @param arg[in] Recorder
+ *
+ * @return NULL
+ */
+static void *ve_rec_sampler(void *arg)
+{
+	struct ve_rec *rec = arg;
+	struct ve_rec_file *file = rec->map.file;
+	struct timespec next = {0};
+	struct timespec now = {0};
+
+	VE_RPMLIB_TRACE("Entering");
+	clock_gettime(CLOCK_MONOTONIC, &next);
+	pthread_mutex_lock(&rec->lock);
+	while (!rec->stop) {
+		pthread_mutex_unlock(&rec->lock);
+		ve_rec_fetch(rec, file->mask);
+		ve_rec_publish(rec);
+
+		next.tv_sec += file->interval / 1000;
+		next.tv_nsec += (file->interval % 1000) * 1000000;
+		if (next.tv_nsec >= 1000000000) {
+			next.tv_nsec -= 1000000000;
+			next.tv_sec++;
+		}
+		/* Skip the ticks missed while VEOS was slow */
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		if (now.tv_sec > next.tv_sec || (now.tv_sec == next.tv_sec &&
+					now.tv_nsec > next.tv_nsec))
+			next = now;
+		pthread_mutex_lock(&rec->lock);
+		while (!rec->stop && ETIMEDOUT != pthread_cond_timedwait(
+					&rec->cond, &rec->lock, &next))
+			;
+	}
+	pthread_mutex_unlock(&rec->lock);
+	VE_RPMLIB_TRACE("Exiting");
+	return NULL;
+}
+
+/**
+ * @brief This function maps a recorder file
+ *
+ * @param fd[in] Recorder file
+ * @param len[in] Length of the file
+ * @param prot[in] Protection of the mapping
+ * @param reader[out] Mapping of the file
+ *
+ * @return 0 on success and -1 on failure
+ */
+static int ve_rec_map(int fd, size_t len, int prot,
+			struct ve_rec_reader *reader)
+{
+	reader->map = mmap(NULL, len, prot, MAP_SHARED, fd, 0);
+	if (MAP_FAILED == reader->map) {
+		VE_RPMLIB_ERR("Failed(%s) to map recorder file",
+				strerror(errno));
+		reader->map = NULL;
+		return -1;
+	}
+	reader->len = len;
+	reader->file = reader->map;
+	return 0;
+}
+
+/**
+ * @brief This function creates an empty recorder file and renames it over
+ *	  'path'
+ *
+ * @param path[in] Path of the recorder file
+ * @param len[in] Length of the file
+ *
+ * @return File descriptor, locked, on success and -1 on failure
+ */
+static int ve_rec_create(const char *path, size_t len)
+{
+	char *tmp = NULL;
+	int fd = -1;
+	int err = 0;
+
+	if (0 > asprintf(&tmp, "%s.XXXXXX", path)) {
+		VE_RPMLIB_ERR("Memory allocation failed: %s",
+				strerror(errno));
+		return -1;
+	}
+	fd = mkostemp(tmp, O_CLOEXEC);
+	if (0 > fd) {
+		VE_RPMLIB_ERR("Failed(%s) to create recorder file: %s",
+				strerror(errno), tmp);
+		free(tmp);
+		return -1;
+	}
+	if (0 > fchmod(fd, 0644) || 0 > flock(fd, LOCK_EX | LOCK_NB) ||
+			0 > ftruncate(fd, len) || 0 > rename(tmp, path)) {
+		err = errno;
+		VE_RPMLIB_ERR("Failed(%s) to create recorder file: %s",
+				strerror(err), path);
+		unlink(tmp);
+		close(fd);
+		fd = -1;
+		errno = err;
+	}
+	free(tmp);
+	return fd;
+}
+
+/**
+ * @brief This function starts recording the metrics of VE node into a ring
+ *	  file
+ *
+ *	  An existing file of the same node and layout is continued, so the
+ *	  history survives a restart of the recorder. A file of another
+ *	  layout is replaced by a new one renamed over it, so readers which
+ *	  still map the old file are not affected.
+ *
+ * @param nodeid[in] VE node number
+ * @param path[in] Path of the recorder file
+ * @param attr[in] Attributes of recorder, NULL for defaults
+ *
+ * @return Recorder on success and NULL on failure
+ */
+struct ve_rec *ve_rec_start(int nodeid, const char *path,
+				struct ve_rec_attr *attr)
+{
+	struct ve_rec *rec = NULL;
+	struct ve_rec_file want = { {0} };
+	struct ve_rec_file have = { {0} };
+	struct ve_rec_file *file = NULL;
+	struct stat st = {0};
+	bool init = false;
+	pthread_condattr_t cattr;
+	size_t len = 0;
+	int ret = 0;
+
+	VE_RPMLIB_TRACE("Entering");
+	if (!path || (attr && (attr->mask & ~VE_REC_ALL))) {
+		VE_RPMLIB_ERR("Wrong argument received: path = %p, attr = %p",
+				path, attr);
+		errno = EINVAL;
+		goto hndl_return;
+	}
+	memcpy(want.magic, VE_REC_MAGIC, sizeof(VE_REC_MAGIC));
+	want.version = VE_REC_VERSION;
+	want.nodeid = nodeid;
+	want.mask = (attr && attr->mask) ? attr->mask : VE_REC_ALL;
+	want.interval = (attr && attr->interval) ? attr->interval :
+				VE_REC_DEF_INTERVAL;
+	want.nslot = (attr && attr->nslot) ? attr->nslot : VE_REC_DEF_SLOTS;
+	want.record_size = ve_rec_offset(want.mask, VE_REC_ALL + 1);
+	len = VE_REC_HDR_LEN + (size_t)want.nslot * want.record_size;
+
+	rec = calloc(1, sizeof(struct ve_rec));
+	if (!rec) {
+		VE_RPMLIB_ERR("Memory allocation failed: %s",
+				strerror(errno));
+		goto hndl_return;
+	}
+	rec->nodeid = nodeid;
+	rec->fd = -1;
+	rec->buf = calloc(1, want.record_size);
+	if (want.mask & VE_REC_SENSOR) {
+		rec->temp = malloc(sizeof(struct ve_pwr_temp));
+		rec->fan = malloc(sizeof(struct ve_pwr_fan));
+		rec->volt = malloc(sizeof(struct ve_pwr_voltage));
+	}
+	if (!rec->buf || ((want.mask & VE_REC_SENSOR) &&
+				(!rec->temp || !rec->fan || !rec->volt))) {
+		VE_RPMLIB_ERR("Memory allocation failed: %s",
+				strerror(errno));
+		goto hndl_free;
+	}
+
+	rec->fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+	if (0 > rec->fd || 0 > fstat(rec->fd, &st)) {
+		VE_RPMLIB_ERR("Failed(%s) to open recorder file: %s",
+				strerror(errno), path);
+		goto hndl_free;
+	}
+	/* One recorder per file, the lock is dropped when the file closes */
+	if (0 > flock(rec->fd, LOCK_EX | LOCK_NB)) {
+		VE_RPMLIB_ERR("Recorder file is in use: %s", path);
+		errno = EBUSY;
+		goto hndl_free;
+	}
+	if (!st.st_size) {
+		if (0 > ftruncate(rec->fd, len)) {
+			VE_RPMLIB_ERR("Failed(%s) to size recorder file: %s",
+					strerror(errno), path);
+			goto hndl_free;
+		}
+		init = true;
+	} else if ((size_t)st.st_size != len ||
+			sizeof(struct ve_rec_file) != pread(rec->fd, &have,
+				sizeof(struct ve_rec_file), 0) ||
+			memcmp(&have, &want, offsetof(struct ve_rec_file,
+							next))) {
+		/* Readers may have the file mapped, resizing it under them
+		 * would fault their accesses */
+		VE_RPMLIB_DEBUG("Replacing recorder file %s of other layout",
+				path);
+		close(rec->fd);
+		rec->fd = ve_rec_create(path, len);
+		if (0 > rec->fd)
+			goto hndl_free;
+		init = true;
+	}
+	if (0 > ve_rec_map(rec->fd, len, PROT_READ | PROT_WRITE, &rec->map))
+		goto hndl_free;
+	file = rec->map.file;
+	want.next = file->next;
+	if (init) {
+		VE_RPMLIB_DEBUG("Initializing recorder file %s", path);
+		want.next = 0;
+		memcpy(file, &want, sizeof(struct ve_rec_file));
+	}
+
+	pthread_mutex_init(&rec->lock, NULL);
+	pthread_condattr_init(&cattr);
+	pthread_condattr_setclock(&cattr, CLOCK_MONOTONIC);
+	pthread_cond_init(&rec->cond, &cattr);
+	pthread_condattr_destroy(&cattr);
+	ret = pthread_create(&rec->thread, NULL, ve_rec_sampler, rec);
+	if (ret) {
+		VE_RPMLIB_ERR("Failed to create sampler thread: %s",
+				strerror(ret));
+		pthread_cond_destroy(&rec->cond);
+		pthread_mutex_destroy(&rec->lock);
+		errno = ret;
+		goto hndl_free;
+	}
+	VE_RPMLIB_DEBUG("Recording node %d into %s from record %llu", nodeid,
+			path, (unsigned long long)file->next);
+	goto hndl_return;
+
+hndl_free:
+	ret = errno;
+	if (rec->map.map)
+		munmap(rec->map.map, rec->map.len);
+	if (0 <= rec->fd)
+		close(rec->fd);
+	free(rec->buf);
+	free(rec->temp);
+	free(rec->fan);
+	free(rec->volt);
+	free(rec);
+	rec = NULL;
+	errno = ret;
+hndl_return:
+	VE_RPMLIB_TRACE("Exiting");
+	return rec;
+}
+
+/**
+ * @brief This function stops the recorder and releases it
+ *
+ *	  The file stays and can still be read.
+ *
+ * @param rec[in] Recorder
+ *
+ * @return 0 on success and -1 on failure
+ */
+int ve_rec_stop(struct ve_rec *rec)
+{
+	VE_RPMLIB_TRACE("Entering");
+	if (!rec) {
+		VE_RPMLIB_ERR("Wrong argument received: rec = %p", rec);
+		errno = EINVAL;
+		return -1;
+	}
+	pthread_mutex_lock(&rec->lock);
+	rec->stop = true;
+	pthread_cond_signal(&rec->cond);
+	pthread_mutex_unlock(&rec->lock);
+	pthread_join(rec->thread, NULL);
+	pthread_cond_destroy(&rec->cond);
+	pthread_mutex_destroy(&rec->lock);
+	munmap(rec->map.map, rec->map.len);
+	close(rec->fd);
+	free(rec->buf);
+	free(rec->temp);
+	free(rec->fan);
+	free(rec->volt);
+	free(rec);
+	VE_RPMLIB_TRACE("Exiting");
+	return 0;
+}
+
+/**
+ * @brief This function attaches a reader to a recorder file
+ *
+ * @param path[in] Path of the recorder file
+ * @param reader[out] Reader to attach
+ *
+ * @return 0 on success and -1 on failure
+ */
+int ve_rec_open(const char *path, struct ve_rec_reader *reader)
+{
+	int retval = -1;
+	int fd = -1;
+	struct stat st = {0};
+	struct ve_rec_file *file = NULL;
+
+	VE_RPMLIB_TRACE("Entering");
+	if (!path || !reader) {
+		VE_RPMLIB_ERR("Wrong argument received: path = %p, "
+				"reader = %p", path, reader);
+		errno = EINVAL;
+		goto hndl_return;
+	}
+	memset(reader, '\0', sizeof(struct ve_rec_reader));
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (0 > fd || 0 > fstat(fd, &st)) {
+		VE_RPMLIB_ERR("Failed(%s) to open recorder file: %s",
+				strerror(errno), path);
+		goto hndl_close;
+	}
+	if ((size_t)st.st_size < VE_REC_HDR_LEN) {
+		errno = EBADF;
+		goto hndl_invalid;
+	}
+	if (0 > ve_rec_map(fd, st.st_size, PROT_READ, reader))
+		goto hndl_close;
+	file = reader->file;
+	if (memcmp(file->magic, VE_REC_MAGIC, sizeof(VE_REC_MAGIC)) ||
+		VE_REC_VERSION != file->version || !file->nslot ||
+		file->record_size != ve_rec_offset(file->mask,
+						VE_REC_ALL + 1) ||
+		(size_t)st.st_size != VE_REC_HDR_LEN +
+				(size_t)file->nslot * file->record_size) {
+		munmap(reader->map, reader->len);
+		memset(reader, '\0', sizeof(struct ve_rec_reader));
+		errno = EBADF;
+		goto hndl_invalid;
+	}
+	retval = 0;
+	goto hndl_close;
+
+hndl_invalid:
+	VE_RPMLIB_ERR("Not a recorder file: %s", path);
+hndl_close:
+	if (0 <= fd)
+		close(fd);
+hndl_return:
+	VE_RPMLIB_TRACE("Exiting");
+	return retval;
+}
+
+/**
+ * @brief This function gets the indexes of the records available
+ *
+ * @param reader[in] Reader attached to the file
+ * @param first[out] Index of the oldest record kept
+ * @param next[out] Index of the record to be written next
+ *
+ * @return 0 on success and -1 on failure
+ */
+int ve_rec_range(struct ve_rec_reader *reader, uint64_t *first,
+			uint64_t *next)
+{
+	uint64_t cur = 0;
+
+	if (!reader || !reader->file || !first || !next) {
+		VE_RPMLIB_ERR("Wrong argument received: reader = %p", reader);
+		errno = EINVAL;
+		return -1;
+	}
+	cur = __atomic_load_n(&reader->file->next, __ATOMIC_ACQUIRE);
+	*next = cur;
+	*first = cur > reader->file->nslot ? cur - reader->file->nslot : 0;
+	return 0;
+}
+
+/**
+ * @brief This function copies a consistent record out of the file
+ *
+ * @param reader[in] Reader attached to the file
+ * @param index[in] Index of the record
+ * @param rec[out] Buffer of 'record_size' bytes of the file
+ *
+ * @return 0 on success and -1 on failure, errno is ENOENT if the record
+ *	   was not written yet or was overwritten
+ */
+int ve_rec_read(struct ve_rec_reader *reader, uint64_t index,
+			struct ve_rec_hdr *rec)
+{
+	int retry = 0;
+	uint32_t seq = 0;
+	struct ve_rec_hdr *slot = NULL;
+
+	if (!reader || !reader->file || !rec) {
+		VE_RPMLIB_ERR("Wrong argument received: reader = %p, rec = %p",
+				reader, rec);
+		errno = EINVAL;
+		return -1;
+	}
+	slot = ve_rec_slot(reader, index);
+	for (retry = 0; retry < VE_REC_RETRY; retry++) {
+		seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+		if (seq & 1) {
+			sched_yield();
+			continue;
+		}
+		memcpy(rec, slot, reader->file->record_size);
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if (seq != __atomic_load_n(&slot->seq, __ATOMIC_RELAXED))
+			continue;
+		if (!seq || rec->index != index) {
+			errno = ENOENT;
+			return -1;
+		}
+		return 0;
+	}
+	errno = EAGAIN;
+	return -1;
+}
+
+/**
+ * @brief This function detaches the reader from the file
+ *
+ * @param reader[in] Reader attached to the file
+ */
+void ve_rec_close(struct ve_rec_reader *reader)
+{
+	if (!reader || !reader->map)
+		return;
+	munmap(reader->map, reader->len);
+	memset(reader, '\0', sizeof(struct ve_rec_reader));
+}
@@ -0,0 +1,202 @@
+/**
+ * Copyright (C) 2020 NEC Corporation
+ * This file is part of the VEOS information library.
+ *
+ * The VEOS information library is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either version
+ * 2.1 of the License, or (at your option) any later version.
+ *
+ * The VEOS information library is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with the VEOS information library; if not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+/**
+ * @file veosinfo_snap.c
+ * @brief Takes snapshots of the metrics of all online VE nodes in parallel
+ *
+ * @internal
+ * @author RPM command
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include "veosinfo.h"
+#include "veosinfo_log.h"
+#include "veosinfo_internal.h"
+
+/**
+ * @brief This function returns the seconds between two instants
+ */
+static double ve_snap_elapsed(const struct timespec *from,
+				const struct timespec *to)
+{
+	return (to->tv_sec - from->tv_sec) +
+		(double)(to->tv_nsec - from->tv_nsec) / 1000000000;
+}
+
+/**
+ * @brief This function fetches the metrics of one VE node
+ *
+ *	  Each metric is fetched even if a previous one failed; 'mask' of
+ *	  the snapshot tells which ones are valid.
+ *
+ * @param nodeid[in] VE node number
+ * @param mask[in] VE_SNAP_* metrics to fetch
+ * @param snap[out] Snapshot of the node
+ *
+ * @return 0 if all metrics were fetched and -1 otherwise
+ */
+int ve_node_snapshot(int nodeid, int mask, struct ve_node_snap *snap)
+{
+	struct timespec start = {0};
+	struct timespec end = {0};
+
+	VE_RPMLIB_TRACE("Entering");
+	if (!snap) {
+		VE_RPMLIB_ERR("Wrong argument received: snap = %p", snap);
+		errno = EINVAL;
+		return -1;
+	}
+	memset(snap, '\0', sizeof(struct ve_node_snap));
+	snap->nodeid = nodeid;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	if (mask & VE_SNAP_MEM) {
+		if (0 > ve_mem_info(nodeid, &snap->mem)) {
+			if (!snap->error)
+				snap->error = errno;
+		} else {
+			snap->mask |= VE_SNAP_MEM;
+		}
+	}
+	if (mask & VE_SNAP_STAT) {
+		if (0 > ve_stat_info(nodeid, &snap->stat)) {
+			if (!snap->error)
+				snap->error = errno;
+		} else {
+			snap->mask |= VE_SNAP_STAT;
+		}
+	}
+	if (mask & VE_SNAP_LOADAVG) {
+		if (0 > ve_loadavg_info(nodeid, &snap->loadavg)) {
+			if (!snap->error)
+				snap->error = errno;
+		} else {
+			snap->mask |= VE_SNAP_LOADAVG;
+		}
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	snap->latency = ve_snap_elapsed(&start, &end);
+	VE_RPMLIB_DEBUG("Node %d fetched 0x%x of 0x%x in %.6f s",
+			nodeid, snap->mask, mask, snap->latency);
+	VE_RPMLIB_TRACE("Exiting");
+	if (snap->mask != mask) {
+		errno = snap->error ? snap->error : EIO;
+		return -1;
+	}
+	return 0;
+}
+
+/**
+ * @brief Work of a thread fetching one VE node
+ */
+struct ve_snap_work {
+	int mask;			/*!< VE_SNAP_* metrics to fetch */
+	struct ve_node_snap *snap;	/*!< Snapshot to fill */
+};
+
+/**
+ * @brief Thread fetching one VE node
+ *
+ * @param arg[in] struct ve_snap_work of the node
+ *
+ * @return NULL
+ */
+static void *ve_snap_worker(void *arg)
+{
+	struct ve_snap_work *work = arg;
+
+	ve_node_snapshot(work->snap->nodeid, work->mask, work->snap);
+	return NULL;
+}
+
+/**
+ * @brief This function takes a snapshot of all online VE nodes
+ *
+ *	  Every node is fetched by its own thread, so the wall clock time is
+ *	  about the latency of the slowest node rather than the sum. A node
+ *	  which fails does not fail the snapshot; check 'mask' and 'error'
+ *	  of each node.
+ *
+ * @param mask[in] VE_SNAP_* metrics to fetch
+ * @param snap[out] Snapshot of the nodes
+ *
+ * @return 0 on success and -1 on failure
+ */
+int ve_cluster_snapshot(int mask, struct ve_cluster_snap *snap)
+{
+	int retval = -1;
+	int indx = 0;
+	int ret = 0;
+	unsigned int nnode = 0;
+	int nodeid[VE_MAX_NODE] = {0};
+	bool started[VE_MAX_NODE] = {false};
+	pthread_t thread[VE_MAX_NODE];
+	struct ve_snap_work work[VE_MAX_NODE];
+	struct timespec start = {0};
+	struct timespec end = {0};
+
+	VE_RPMLIB_TRACE("Entering");
+	if (!snap || !mask || (mask & ~VE_SNAP_ALL)) {
+		VE_RPMLIB_ERR("Wrong argument received: snap = %p, mask = 0x%x",
+				snap, mask);
+		errno = EINVAL;
+		goto hndl_return;
+	}
+	memset(snap, '\0', sizeof(struct ve_cluster_snap));
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	if (0 > ve_get_nos(&nnode, nodeid)) {
+		VE_RPMLIB_ERR("Failed to get online VE nodes: %s",
+				strerror(errno));
+		goto hndl_return;
+	}
+	snap->nnode = nnode;
+	for (indx = 0; indx < snap->nnode; indx++) {
+		snap->node[indx].nodeid = nodeid[indx];
+		work[indx].mask = mask;
+		work[indx].snap = &snap->node[indx];
+		ret = pthread_create(&thread[indx], NULL, ve_snap_worker,
+					&work[indx]);
+		if (ret) {
+			VE_RPMLIB_DEBUG("Failed to create thread for node %d: "
+					"%s", nodeid[indx], strerror(ret));
+			continue;
+		}
+		started[indx] = true;
+	}
+	/* Nodes without a thread are fetched here while others run */
+	for (indx = 0; indx < snap->nnode; indx++)
+		if (!started[indx])
+			ve_snap_worker(&work[indx]);
+	for (indx = 0; indx < snap->nnode; indx++)
+		if (started[indx])
+			pthread_join(thread[indx], NULL);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	snap->elapsed = ve_snap_elapsed(&start, &end);
+	VE_RPMLIB_DEBUG("Snapshot of %d nodes in %.6f s",
+			snap->nnode, snap->elapsed);
+	retval = 0;
+hndl_return:
+	VE_RPMLIB_TRACE("Exiting");
+	return retval;
+}
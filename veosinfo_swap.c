@@ -0,0 +1,938 @@
+/**
+ * Copyright (C) 2020 NEC Corporation
+ * This file is part of the VEOS information library.
+ *
+ * The VEOS information library is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either version
+ * 2.1 of the License, or (at your option) any later version.
+ *
+ * The VEOS information library is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with the VEOS information library; if not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+/**
+ * @file veosinfo_swap.c
+ * @brief Swaps VE processes out or in without blocking the caller
+ *
+ *	  A worker thread hands the PIDs to VEOS chunk by chunk and then
+ *	  polls the swap information of the processes until the operation
+ *	  completes, the polls keep failing or the timeout of the caller
+ *	  expires. Each poll is published as progress, which the caller
+ *	  learns about from an eventfd, a callback or both.
+ *
+ *	  The swap planner chooses the processes to swap out to free an
+ *	  amount of memory at the lowest cost.
+ *
+ * @internal
+ * @author RPM command
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <time.h>
+#include <float.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
+#include "veosinfo.h"
+#include "veosinfo_log.h"
+#include "veosinfo_internal.h"
+
+#define VE_SWAP_PLAN_UNITS	512	/*!< Resolution of the memory needed */
+#define VE_SWAP_POLL_RETRY	5	/*!< Max nr of failed polls in a row */
+
+/* Default weights of the cost of swap planner */
+#define VE_SWAP_PLAN_W_SIZE	1.0
+#define VE_SWAP_PLAN_W_PRIORITY	0.5
+#define VE_SWAP_PLAN_W_AGE	0.2
+#define VE_SWAP_PLAN_W_NUMA	0.5
+
+/**
+ * @brief Process which swap planner can choose
+ */
+struct ve_swap_cand {
+	pid_t pid;			/*!< VE process ID */
+	unsigned long long size;	/*!< Memory freed by swapping out */
+	int weight;			/*!< 'size' in units of the knapsack */
+	double cost;			/*!< Cost of swapping out */
+};
+
+/**
+ * @brief State of asynchronous swap operation
+ */
+struct ve_swap_async {
+	int nodeid;			/*!< VE node ID */
+	bool out;			/*!< Swap out, else swap in */
+	size_t required_free_size;	/*!< Required-free-size, 0 for none */
+	struct ve_swap_async_attr attr;	/*!< Attributes, defaults applied */
+	int num;			/*!< Number of PIDs */
+	pid_t *pids;			/*!< VE process ID array */
+	unsigned long long *base;	/*!< Swapped size of each PID at start */
+	struct ve_swap_struct *poll;	/*!< Entries of the running poll */
+	int efd;			/*!< eventfd signalled on progress */
+	pthread_t worker;		/*!< Worker thread */
+	pthread_mutex_t lock;		/*!< Protects the members below */
+	pthread_cond_t cond;		/*!< Signals 'cancel' and 'finished' */
+	bool cancel;			/*!< Request the worker to cancel */
+	bool finished;			/*!< The worker has stopped */
+	struct ve_swap_progress prog;	/*!< Latest progress */
+	struct ve_swap_struct *ent;	/*!< Entries of the latest poll */
+};
+
+/**
+ * @brief This function publishes the progress and notifies the caller
+ *
+ * @param swap[in] Asynchronous swap operation
+ * @param prog[in] Progress to publish
+ * @param ent[in] Entries of the poll, NULL to keep the previous ones
+ */
+static void ve_swap_async_publish(struct ve_swap_async *swap,
+				struct ve_swap_progress *prog,
+				struct ve_swap_struct *ent)
+{
+	uint64_t one = 1;
+
+	pthread_mutex_lock(&swap->lock);
+	if (ent)
+		memcpy(swap->ent, ent, sizeof(struct ve_swap_struct) *
+				prog->len);
+	else
+		prog->len = swap->prog.len;
+	swap->prog = *prog;
+	if (VE_SWAP_RUNNING != prog->state) {
+		swap->finished = true;
+		pthread_cond_broadcast(&swap->cond);
+	}
+	pthread_mutex_unlock(&swap->lock);
+
+	if (sizeof(one) != write(swap->efd, &one, sizeof(one)))
+		VE_RPMLIB_DEBUG("Failed(%s) to signal eventfd",
+				strerror(errno));
+	if (swap->attr.cb)
+		swap->attr.cb(swap, prog, swap->attr.arg);
+}
+
+/**
+ * @brief This function waits for the poll interval or a cancellation
+ *
+ * @param swap[in] Asynchronous swap operation
+ * @param next[in/out] CLOCK_MONOTONIC time of the next poll
+ *
+ * @return true if the operation is cancelled
+ */
+static bool ve_swap_async_sleep(struct ve_swap_async *swap,
+				struct timespec *next)
+{
+	bool cancel = false;
+
+	next->tv_sec += swap->attr.interval / 1000;
+	next->tv_nsec += (swap->attr.interval % 1000) * 1000000;
+	if (next->tv_nsec >= 1000000000) {
+		next->tv_nsec -= 1000000000;
+		next->tv_sec++;
+	}
+	pthread_mutex_lock(&swap->lock);
+	while (!swap->cancel && ETIMEDOUT != pthread_cond_timedwait(
+				&swap->cond, &swap->lock, next))
+		;
+	cancel = swap->cancel;
+	pthread_mutex_unlock(&swap->lock);
+	return cancel;
+}
+
+/**
+ * @brief This function polls the swap information of the PIDs handed to
+ *	  VEOS and computes the progress
+ *
+ * @param swap[in] Asynchronous swap operation
+ * @param submitted[in] Number of PIDs handed to VEOS
+ * @param prog[out] Progress
+ *
+ *	  A process is settled once all its memory is swapped or once it
+ *	  has exited. Swap out also settles a process which VEOS reports
+ *	  swapped out with memory left that it cannot swap.
+ *
+ * @return 1 if the operation has completed, 0 if it is still in
+ *	   progress and -1 on failure
+ */
+static int ve_swap_async_poll(struct ve_swap_async *swap, int submitted,
+				struct ve_swap_progress *prog)
+{
+	struct ve_meminfo mem = {0};
+	struct ve_swap_struct *ent = NULL;
+	bool complete = true;
+	int indx = 0;
+	int pid = 0;
+	int len = 0;
+
+	if (0 > ve_swap_info_vl(swap->nodeid, submitted, swap->pids,
+				swap->poll, &len)) {
+		VE_RPMLIB_DEBUG("Failed(%s) to poll swap information",
+				strerror(errno));
+		return -1;
+	}
+	prog->len = len;
+	prog->done = 0;
+	prog->total = 0;
+	/* Entries are in the order of the PIDs, exited processes missing */
+	for (indx = 0; indx < len; indx++) {
+		ent = &swap->poll[indx];
+		while (pid < submitted && swap->pids[pid] != ent->pid)
+			pid++;
+		if (swap->out) {
+			prog->done += ent->swapped_sz;
+			prog->total += ent->swappable_sz;
+		} else if (pid < submitted) {
+			prog->total += swap->base[pid];
+			if (swap->base[pid] > ent->swapped_sz)
+				prog->done += swap->base[pid] -
+						ent->swapped_sz;
+		}
+		if (VE_PROC_ZOMBIE == ent->proc_state ||
+				VE_PROC_INVAL == ent->proc_state)
+			continue;
+		if (swap->out && ent->swapped_sz < ent->swappable_sz &&
+				VE_PROC_SWAPPED_OUT != ent->proc_substate)
+			complete = false;
+		if (!swap->out && ent->swapped_sz)
+			complete = false;
+	}
+	/* VEOS stops swapping out once the required size is free */
+	if (!complete && swap->out && swap->required_free_size &&
+			!ve_mem_info(swap->nodeid, &mem) &&
+			mem.kb_main_free * KB >= swap->required_free_size)
+		complete = true;
+	return complete ? 1 : 0;
+}
+
+/**
+ * @brief Worker thread of asynchronous swap operation
+ *
+ * @param arg[in] Asynchronous swap operation
+ *
+ * @return NULL
+ */
+static void *ve_swap_async_worker(void *arg)
+{
+	struct ve_swap_async *swap = arg;
+	struct ve_swap_progress prog = {0};
+	struct timespec next = {0};
+	struct timespec deadline = {0};
+	int submitted = 0;
+	int fails = 0;
+	int chunk = 0;
+	int retval = 0;
+	int indx = 0;
+	int pid = 0;
+	int len = 0;
+
+	VE_RPMLIB_TRACE("Entering");
+	prog.state = VE_SWAP_RUNNING;
+	prog.num = swap->num;
+	clock_gettime(CLOCK_MONOTONIC, &deadline);
+	deadline.tv_sec += swap->attr.timeout / 1000;
+	deadline.tv_nsec += (swap->attr.timeout % 1000) * 1000000;
+	if (deadline.tv_nsec >= 1000000000) {
+		deadline.tv_nsec -= 1000000000;
+		deadline.tv_sec++;
+	}
+
+	/* Swap in reports the size swapped back against the size at start */
+	if (!swap->out) {
+		retval = ve_swap_info_vl(swap->nodeid, swap->num, swap->pids,
+					swap->poll, &len);
+		if (0 > retval)
+			goto hndl_fail;
+		for (indx = 0; indx < len; indx++) {
+			while (pid < swap->num &&
+					swap->pids[pid] != swap->poll[indx].pid)
+				pid++;
+			if (pid < swap->num)
+				swap->base[pid] = swap->poll[indx].swapped_sz;
+		}
+	}
+
+	while (submitted < swap->num) {
+		pthread_mutex_lock(&swap->lock);
+		prog.state = swap->cancel ? VE_SWAP_CANCELLED :
+						VE_SWAP_RUNNING;
+		pthread_mutex_unlock(&swap->lock);
+		if (VE_SWAP_CANCELLED == prog.state)
+			goto hndl_cancel;
+		chunk = swap->num - submitted < VE_SWAP_VL_CHUNK ?
+				swap->num - submitted : VE_SWAP_VL_CHUNK;
+		if (swap->out)
+			retval = ve_swap_out_vl(swap->nodeid, chunk,
+					&swap->pids[submitted],
+					swap->required_free_size);
+		else
+			retval = ve_swap_in_vl(swap->nodeid, chunk,
+					&swap->pids[submitted]);
+		if (0 > retval)
+			goto hndl_fail;
+		submitted += chunk;
+		prog.submitted = submitted;
+		ve_swap_async_publish(swap, &prog, NULL);
+	}
+	VE_RPMLIB_DEBUG("Handed %d processes to VEOS", submitted);
+
+	clock_gettime(CLOCK_MONOTONIC, &next);
+	for (;;) {
+		retval = ve_swap_async_poll(swap, submitted, &prog);
+		if (0 < retval) {
+			prog.state = VE_SWAP_DONE;
+			break;
+		}
+		if (0 > retval) {
+			if (++fails >= VE_SWAP_POLL_RETRY)
+				goto hndl_fail;
+		} else {
+			fails = 0;
+			ve_swap_async_publish(swap, &prog, swap->poll);
+		}
+		if (ve_swap_async_sleep(swap, &next))
+			goto hndl_cancel;
+		if (swap->attr.timeout && (next.tv_sec > deadline.tv_sec ||
+				(next.tv_sec == deadline.tv_sec &&
+				 next.tv_nsec >= deadline.tv_nsec))) {
+			errno = ETIMEDOUT;
+			goto hndl_fail;
+		}
+	}
+	ve_swap_async_publish(swap, &prog, swap->poll);
+	goto hndl_return;
+
+hndl_cancel:
+	/* Processes already swapped out are brought back */
+	prog.state = VE_SWAP_CANCELLED;
+	if (swap->out && submitted &&
+			0 > ve_swap_in_vl(swap->nodeid, submitted, swap->pids)) {
+		VE_RPMLIB_ERR("Failed(%s) to swap in cancelled processes",
+				strerror(errno));
+		prog.error = errno;
+	}
+	ve_swap_async_publish(swap, &prog, NULL);
+	goto hndl_return;
+hndl_fail:
+	prog.state = VE_SWAP_FAILED;
+	prog.error = errno;
+	VE_RPMLIB_ERR("Swap %s failed: %s", swap->out ? "out" : "in",
+			strerror(prog.error));
+	ve_swap_async_publish(swap, &prog, NULL);
+hndl_return:
+	VE_RPMLIB_TRACE("Exiting");
+	return NULL;
+}
+
+/**
+ * @brief This function starts an asynchronous swap operation
+ *
+ * @param nodeid[in] VE node ID
+ * @param out[in] Swap out, else swap in
+ * @param num[in] Number of PIDs
+ * @param pids[in] VE process ID array
+ * @param required_free_size[in] Required-free-size, 0 for none
+ * @param attr[in] Attributes, NULL for defaults
+ *
+ * @return Asynchronous swap operation on success and NULL on failure
+ */
+static struct ve_swap_async *ve_swap_async_start(int nodeid, bool out,
+			int num, const pid_t *pids, size_t required_free_size,
+			struct ve_swap_async_attr *attr)
+{
+	struct ve_swap_async *swap = NULL;
+	pthread_condattr_t cattr;
+	int ret = 0;
+
+	VE_RPMLIB_TRACE("Entering");
+	if (!pids || 0 >= num || (attr && (0 > attr->interval ||
+					0 > attr->timeout))) {
+		VE_RPMLIB_ERR("Wrong argument received: pids = %p, num = %d",
+				pids, num);
+		errno = EINVAL;
+		goto hndl_return;
+	}
+	swap = calloc(1, sizeof(struct ve_swap_async));
+	if (!swap) {
+		VE_RPMLIB_ERR("Memory allocation failed: %s",
+				strerror(errno));
+		goto hndl_return;
+	}
+	swap->nodeid = nodeid;
+	swap->out = out;
+	swap->required_free_size = required_free_size;
+	if (attr)
+		swap->attr = *attr;
+	if (!swap->attr.interval)
+		swap->attr.interval = VE_SWAP_DEF_INTERVAL;
+	swap->num = num;
+	swap->pids = malloc(sizeof(pid_t) * num);
+	swap->base = calloc(num, sizeof(unsigned long long));
+	swap->poll = calloc(num, sizeof(struct ve_swap_struct));
+	swap->ent = calloc(num, sizeof(struct ve_swap_struct));
+	if (!swap->pids || !swap->base || !swap->poll || !swap->ent) {
+		VE_RPMLIB_ERR("Memory allocation failed: %s",
+				strerror(errno));
+		goto hndl_free;
+	}
+	memcpy(swap->pids, pids, sizeof(pid_t) * num);
+	swap->prog.state = VE_SWAP_RUNNING;
+	swap->prog.num = num;
+	swap->efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (0 > swap->efd) {
+		VE_RPMLIB_ERR("Failed(%s) to create eventfd", strerror(errno));
+		goto hndl_free;
+	}
+
+	pthread_mutex_init(&swap->lock, NULL);
+	pthread_condattr_init(&cattr);
+	pthread_condattr_setclock(&cattr, CLOCK_MONOTONIC);
+	pthread_cond_init(&swap->cond, &cattr);
+	pthread_condattr_destroy(&cattr);
+	ret = pthread_create(&swap->worker, NULL, ve_swap_async_worker, swap);
+	if (ret) {
+		VE_RPMLIB_ERR("Failed to create worker thread: %s",
+				strerror(ret));
+		pthread_cond_destroy(&swap->cond);
+		pthread_mutex_destroy(&swap->lock);
+		close(swap->efd);
+		errno = ret;
+		goto hndl_free;
+	}
+	VE_RPMLIB_DEBUG("Swapping %s %d processes", out ? "out" : "in", num);
+	goto hndl_return;
+
+hndl_free:
+	free(swap->pids);
+	free(swap->base);
+	free(swap->poll);
+	free(swap->ent);
+	free(swap);
+	swap = NULL;
+hndl_return:
+	VE_RPMLIB_TRACE("Exiting");
+	return swap;
+}
+
+/**
+ * @brief This function starts to swap out VE processes and returns
+ *	  without waiting for VEOS.
+ *
+ *	  Progress is the sum of swapped memory against the sum of
+ *	  swappable memory of the processes.
+ *
+ * @param nodeid[in] VE node ID
+ * @param num[in] Number of PIDs
+ * @param pids[in] VE process ID array
+ * @param required_free_size[in] Required-free-size, 0 for none
+ * @param attr[in] Attributes, NULL for defaults
+ *
+ * @return Asynchronous swap operation on success and NULL on failure
+ */
+struct ve_swap_async *ve_swap_out_async(int nodeid, int num,
+			const pid_t *pids, size_t required_free_size,
+			struct ve_swap_async_attr *attr)
+{
+	return ve_swap_async_start(nodeid, true, num, pids,
+				required_free_size, attr);
+}
+
+/**
+ * @brief This function starts to swap in VE processes and returns
+ *	  without waiting for VEOS.
+ *
+ *	  Progress is the memory swapped back in against the swapped
+ *	  memory of the processes when the operation started.
+ *
+ * @param nodeid[in] VE node ID
+ * @param num[in] Number of PIDs
+ * @param pids[in] VE process ID array
+ * @param attr[in] Attributes, NULL for defaults
+ *
+ * @return Asynchronous swap operation on success and NULL on failure
+ */
+struct ve_swap_async *ve_swap_in_async(int nodeid, int num,
+			const pid_t *pids, struct ve_swap_async_attr *attr)
+{
+	return ve_swap_async_start(nodeid, false, num, pids, 0, attr);
+}
+
+/**
+ * @brief This function gets the eventfd of an asynchronous swap operation
+ *
+ *	  The eventfd becomes readable each time progress is published.
+ *	  It is non-blocking and is read by the caller to clear it.
+ *
+ * @param swap[in] Asynchronous swap operation
+ *
+ * @return eventfd on success and -1 on failure
+ */
+int ve_swap_async_fd(struct ve_swap_async *swap)
+{
+	if (!swap) {
+		VE_RPMLIB_ERR("Wrong argument received: swap = %p", swap);
+		errno = EINVAL;
+		return -1;
+	}
+	return swap->efd;
+}
+
+/**
+ * @brief This function gets the latest progress of an asynchronous swap
+ *	  operation
+ *
+ * @param swap[in] Asynchronous swap operation
+ * @param prog[out] Latest progress
+ * @param ent[out] Swap information of the processes in the latest poll,
+ *		   NULL if not needed
+ * @param max[in] Number of entries of 'ent'
+ *
+ * @return Number of entries stored in 'ent' on success and -1 on failure
+ */
+int ve_swap_async_progress(struct ve_swap_async *swap,
+			struct ve_swap_progress *prog,
+			struct ve_swap_struct *ent, int max)
+{
+	int len = 0;
+
+	if (!swap || !prog || (ent && 0 > max)) {
+		VE_RPMLIB_ERR("Wrong argument received: swap = %p, prog = %p",
+				swap, prog);
+		errno = EINVAL;
+		return -1;
+	}
+	pthread_mutex_lock(&swap->lock);
+	*prog = swap->prog;
+	if (ent) {
+		len = prog->len < max ? prog->len : max;
+		memcpy(ent, swap->ent, sizeof(struct ve_swap_struct) * len);
+	}
+	pthread_mutex_unlock(&swap->lock);
+	return len;
+}
+
+/**
+ * @brief This function cancels an asynchronous swap operation
+ *
+ *	  PIDs not yet handed to VEOS are left alone. On swap out, the
+ *	  processes already handed to VEOS are swapped back in.
+ *	  The operation completes with VE_SWAP_CANCELLED.
+ *
+ * @param swap[in] Asynchronous swap operation
+ *
+ * @return 0 on success and -1 on failure
+ */
+int ve_swap_async_cancel(struct ve_swap_async *swap)
+{
+	if (!swap) {
+		VE_RPMLIB_ERR("Wrong argument received: swap = %p", swap);
+		errno = EINVAL;
+		return -1;
+	}
+	pthread_mutex_lock(&swap->lock);
+	swap->cancel = true;
+	pthread_cond_broadcast(&swap->cond);
+	pthread_mutex_unlock(&swap->lock);
+	return 0;
+}
+
+/**
+ * @brief This function waits for an asynchronous swap operation to
+ *	  complete
+ *
+ * @param swap[in] Asynchronous swap operation
+ * @param prog[out] Final progress, NULL if not needed
+ *
+ * @return 0 if the operation is done and -1 otherwise
+ */
+int ve_swap_async_wait(struct ve_swap_async *swap,
+			struct ve_swap_progress *prog)
+{
+	int retval = -1;
+
+	VE_RPMLIB_TRACE("Entering");
+	if (!swap) {
+		VE_RPMLIB_ERR("Wrong argument received: swap = %p", swap);
+		errno = EINVAL;
+		goto hndl_return;
+	}
+	pthread_mutex_lock(&swap->lock);
+	while (!swap->finished)
+		pthread_cond_wait(&swap->cond, &swap->lock);
+	if (prog)
+		*prog = swap->prog;
+	if (VE_SWAP_DONE == swap->prog.state)
+		retval = 0;
+	else if (VE_SWAP_CANCELLED == swap->prog.state)
+		errno = ECANCELED;
+	else
+		errno = swap->prog.error;
+	pthread_mutex_unlock(&swap->lock);
+hndl_return:
+	VE_RPMLIB_TRACE("Exiting");
+	return retval;
+}
+
+/**
+ * @brief This function releases an asynchronous swap operation,
+ *	  cancelling it if it is still running
+ *
+ * @param swap[in] Asynchronous swap operation
+ *
+ * @return 0 on success and -1 on failure
+ */
+int ve_swap_async_free(struct ve_swap_async *swap)
+{
+	VE_RPMLIB_TRACE("Entering");
+	if (!swap) {
+		VE_RPMLIB_ERR("Wrong argument received: swap = %p", swap);
+		errno = EINVAL;
+		return -1;
+	}
+	ve_swap_async_cancel(swap);
+	pthread_join(swap->worker, NULL);
+	pthread_cond_destroy(&swap->cond);
+	pthread_mutex_destroy(&swap->lock);
+	close(swap->efd);
+	free(swap->pids);
+	free(swap->base);
+	free(swap->poll);
+	free(swap->ent);
+	free(swap);
+	VE_RPMLIB_TRACE("Exiting");
+	return 0;
+}
+
+/**
+ * @brief This function computes the cost of swapping out each candidate
+ *
+ * @param nodeid[in] VE node ID
+ * @param attr[in] Attributes of swap planner, defaults applied
+ * @param cand[in/out] Candidates, 'pid' and 'size' set
+ * @param ncand[in] Number of candidates
+ * @param table[in] Process table of VE node
+ * @param need[in] Memory to free in bytes
+ */
+static void ve_swap_plan_cost(int nodeid, struct ve_swap_plan_attr *attr,
+			struct ve_swap_cand *cand, int ncand,
+			struct ve_proc_table *table, unsigned long long need)
+{
+	struct ve_swap_plan_weights *w = &attr->weights;
+	struct ve_numa_stat numa = {0};
+	struct ve_proc_entry *ent = NULL;
+	unsigned long first = ~0UL;
+	unsigned long last = 0;
+	bool have_set = false;
+	cpu_set_t set;
+	int numcore = 0;
+	int indx = 0;
+
+	if (0 <= attr->numa && w->numa && !ve_core_info(nodeid, &numcore) &&
+			!ve_numa_info(nodeid, &numa) &&
+			attr->numa < numa.tot_numa_nodes &&
+			attr->numa < VE_NUMA_NUM)
+		have_set = 0 < ve_place_parse(numa.ve_core[attr->numa],
+				sizeof(numa.ve_core[attr->numa]), numcore,
+				&set);
+	for (indx = 0; indx < ncand; indx++) {
+		ent = ve_proc_table_find(table, cand[indx].pid);
+		if (!ent)
+			continue;
+		if (ent->start_time < first)
+			first = ent->start_time;
+		if (ent->start_time > last)
+			last = ent->start_time;
+	}
+
+	for (indx = 0; indx < ncand; indx++) {
+		cand[indx].cost = w->size * cand[indx].size / need;
+		ent = ve_proc_table_find(table, cand[indx].pid);
+		if (!ent) {
+			/* Unknown to the table, assume a default process */
+			cand[indx].cost += w->priority * 0.5;
+			continue;
+		}
+		cand[indx].cost += w->priority * (19 - ent->nice) / 39.0;
+		if (last > first)
+			cand[indx].cost += w->age * (double)(last -
+					ent->start_time) / (last - first);
+		if (have_set && (0 > ent->processor ||
+					!CPU_ISSET(ent->processor, &set)))
+			cand[indx].cost += w->numa;
+	}
+}
+
+/**
+ * @brief This function chooses the candidates of lowest total cost which
+ *	  free at least 'need' bytes, as a 0-1 knapsack
+ *
+ *	  Sizes are rounded down to units of 'need' / VE_SWAP_PLAN_UNITS,
+ *	  candidates smaller than a unit counting as one. When rounding
+ *	  leaves the chosen set short of 'need', the cheapest candidates
+ *	  left are added until it is not. If all the candidates together
+ *	  free less, all are chosen.
+ *
+ * @param cand[in] Candidates
+ * @param ncand[in] Number of candidates
+ * @param need[in] Memory to free in bytes
+ * @param plan[out] Plan to fill
+ *
+ * @return 0 on success and -1 on failure
+ */
+static int ve_swap_plan_pick(struct ve_swap_cand *cand, int ncand,
+			unsigned long long need, struct ve_swap_plan *plan)
+{
+	unsigned long long unit = (need + VE_SWAP_PLAN_UNITS - 1) /
+					VE_SWAP_PLAN_UNITS;
+	int cap = (need + unit - 1) / unit;
+	double *best = NULL;
+	short *from = NULL;
+	bool *chosen = NULL;
+	int retval = -1;
+	int next = 0;
+	int indx = 0;
+	int c = 0;
+	int t = 0;
+
+	plan->pid = malloc(sizeof(pid_t) * (ncand ? ncand : 1));
+	best = malloc(sizeof(double) * (cap + 1));
+	from = malloc(sizeof(short) * (size_t)(cap + 1) * (ncand ? ncand : 1));
+	chosen = calloc(ncand ? ncand : 1, sizeof(bool));
+	if (!plan->pid || !best || !from || !chosen) {
+		VE_RPMLIB_ERR("Memory allocation failed: %s",
+				strerror(errno));
+		goto hndl_return;
+	}
+
+	/* best[c] is the lowest cost freeing at least c units */
+	best[0] = 0;
+	for (c = 1; c <= cap; c++)
+		best[c] = DBL_MAX;
+	for (indx = 0; indx < ncand; indx++) {
+		cand[indx].weight = cand[indx].size / unit < cap ?
+					cand[indx].size / unit : cap;
+		if (!cand[indx].weight)
+			cand[indx].weight = 1;
+		memset(&from[(size_t)indx * (cap + 1)], 0xff,
+				sizeof(short) * (cap + 1));
+		/* Targets are above sources, so each candidate is used once */
+		for (c = cap; c >= 0; c--) {
+			if (DBL_MAX == best[c])
+				continue;
+			t = c + cand[indx].weight < cap ?
+				c + cand[indx].weight : cap;
+			if (best[c] + cand[indx].cost < best[t]) {
+				best[t] = best[c] + cand[indx].cost;
+				from[(size_t)indx * (cap + 1) + t] = c;
+			}
+		}
+	}
+
+	if (DBL_MAX != best[cap]) {
+		for (t = cap, indx = ncand - 1; indx >= 0 && t; indx--) {
+			c = from[(size_t)indx * (cap + 1) + t];
+			if (0 > c)
+				continue;
+			chosen[indx] = true;
+			plan->freed += cand[indx].size;
+			t = c;
+		}
+	}
+	/* Rounding may leave the knapsack short, fill up cheapest first */
+	while (plan->freed < need) {
+		for (next = -1, indx = 0; indx < ncand; indx++)
+			if (!chosen[indx] && (0 > next ||
+					cand[indx].cost < cand[next].cost))
+				next = indx;
+		if (0 > next) {
+			VE_RPMLIB_DEBUG("Candidates free less than %llu bytes",
+					need);
+			break;
+		}
+		chosen[next] = true;
+		plan->freed += cand[next].size;
+	}
+	for (indx = 0; indx < ncand; indx++) {
+		if (!chosen[indx])
+			continue;
+		plan->pid[plan->len++] = cand[indx].pid;
+		plan->cost += cand[indx].cost;
+	}
+	retval = 0;
+hndl_return:
+	free(best);
+	free(from);
+	free(chosen);
+	return retval;
+}
+
+/**
+ * @brief This function chooses the VE processes to swap out so that the
+ *	  free memory of VE node reaches a required size at the lowest cost
+ *
+ *	  The memory a process frees is its swappable size not yet swapped
+ *	  out. Processes which have exited or are being swapped, or which
+ *	  are swapped out already, are not candidates. The cost of a process is the weighted sum of the memory it
+ *	  frees against the memory needed, its priority, its age and
+ *	  whether it runs outside the NUMA node whose memory is needed.
+ *	  Swapping out more than needed costs a longer swap in later, so
+ *	  the planner solves the choice as a knapsack rather than taking
+ *	  the largest processes first.
+ *
+ * @param nodeid[in] VE node ID
+ * @param required_free_size[in] Free memory required in bytes, as for
+ *				 ve_swap_out_f()
+ * @param num[in] Number of candidates
+ * @param pids[in] Candidate VE processes, NULL for all the processes
+ * @param attr[in] Attributes of swap planner, NULL for defaults
+ * @param plan[out] Processes chosen, released by ve_swap_plan_free()
+ *
+ * @return 0 on success and -1 on failure
+ */
+int ve_swap_plan(int nodeid, size_t required_free_size, int num,
+		const pid_t *pids, struct ve_swap_plan_attr *attr,
+		struct ve_swap_plan *plan)
+{
+	struct ve_swap_plan_attr a = {-1, {0}};
+	struct ve_proc_table table = {0};
+	struct ve_meminfo mem = {0};
+	struct ve_swap_struct *info = NULL;
+	struct ve_swap_cand *cand = NULL;
+	pid_t *all = NULL;
+	unsigned long long free_sz = 0;
+	int ncand = 0;
+	int retval = -1;
+	int indx = 0;
+	int len = 0;
+
+	VE_RPMLIB_TRACE("Entering");
+	if (!plan || 0 > num || (!pids && num) || (attr &&
+			(0 > attr->weights.size || 0 > attr->weights.priority ||
+			 0 > attr->weights.age || 0 > attr->weights.numa))) {
+		VE_RPMLIB_ERR("Wrong argument received: plan = %p, pids = %p, "
+				"num = %d", plan, pids, num);
+		errno = EINVAL;
+		goto hndl_return;
+	}
+	memset(plan, '\0', sizeof(struct ve_swap_plan));
+	if (attr)
+		a = *attr;
+	if (!a.weights.size && !a.weights.priority && !a.weights.age &&
+			!a.weights.numa) {
+		a.weights.size = VE_SWAP_PLAN_W_SIZE;
+		a.weights.priority = VE_SWAP_PLAN_W_PRIORITY;
+		a.weights.age = VE_SWAP_PLAN_W_AGE;
+		a.weights.numa = VE_SWAP_PLAN_W_NUMA;
+	}
+
+	if (0 > ve_mem_info(nodeid, &mem))
+		goto hndl_return;
+	free_sz = (unsigned long long)mem.kb_main_free * KB;
+	if (required_free_size <= free_sz) {
+		VE_RPMLIB_DEBUG("%llu bytes are already free", free_sz);
+		retval = 0;
+		goto hndl_return;
+	}
+	plan->need = required_free_size - free_sz;
+
+	if (0 > ve_proc_table_update(nodeid, &table))
+		goto hndl_return;
+	if (!pids) {
+		all = malloc(sizeof(pid_t) * (table.len ? table.len : 1));
+		if (!all) {
+			VE_RPMLIB_ERR("Memory allocation failed: %s",
+					strerror(errno));
+			goto hndl_free;
+		}
+		for (indx = 0; indx < table.len; indx++)
+			if (table.entry[indx].pid == table.entry[indx].tgid)
+				all[num++] = table.entry[indx].pid;
+		pids = all;
+	}
+	info = malloc(sizeof(struct ve_swap_struct) * (num ? num : 1));
+	cand = malloc(sizeof(struct ve_swap_cand) * (num ? num : 1));
+	if (!info || !cand) {
+		VE_RPMLIB_ERR("Memory allocation failed: %s",
+				strerror(errno));
+		goto hndl_free;
+	}
+	if (0 > ve_swap_info_vl(nodeid, num, pids, info, &len))
+		goto hndl_free;
+	for (indx = 0; indx < len; indx++) {
+		/* Exited processes and those VEOS is swapping are left out */
+		if (VE_PROC_ZOMBIE == info[indx].proc_state ||
+				VE_PROC_INVAL == info[indx].proc_state ||
+				VE_PROC_ACTIVE != info[indx].proc_substate)
+			continue;
+		if (info[indx].swappable_sz <= info[indx].swapped_sz)
+			continue;
+		cand[ncand].pid = info[indx].pid;
+		cand[ncand].size = info[indx].swappable_sz -
+					info[indx].swapped_sz;
+		ncand++;
+	}
+	ve_swap_plan_cost(nodeid, &a, cand, ncand, &table, plan->need);
+	retval = ve_swap_plan_pick(cand, ncand, plan->need, plan);
+	VE_RPMLIB_DEBUG("Chose %d of %d processes freeing %llu of %llu bytes",
+			plan->len, ncand, plan->freed, plan->need);
+hndl_free:
+	if (0 > retval) {
+		free(plan->pid);
+		memset(plan, '\0', sizeof(struct ve_swap_plan));
+	}
+	ve_proc_table_free(&table);
+	free(all);
+	free(info);
+	free(cand);
+hndl_return:
+	VE_RPMLIB_TRACE("Exiting");
+	return retval;
+}
+
+/**
+ * @brief This function chooses the VE processes to swap out as
+ *	  ve_swap_plan() does and requests VEOS to swap them out
+ *
+ * @param nodeid[in] VE node ID
+ * @param required_free_size[in] Free memory required in bytes
+ * @param num[in] Number of candidates
+ * @param pids[in] Candidate VE processes, NULL for all the processes
+ * @param attr[in] Attributes of swap planner, NULL for defaults
+ * @param plan[out] Processes chosen, released by ve_swap_plan_free()
+ *
+ * @return 0 on success and -1 on failure
+ */
+int ve_swap_plan_out(int nodeid, size_t required_free_size, int num,
+		const pid_t *pids, struct ve_swap_plan_attr *attr,
+		struct ve_swap_plan *plan)
+{
+	if (0 > ve_swap_plan(nodeid, required_free_size, num, pids, attr,
+				plan))
+		return -1;
+	if (plan->len && 0 > ve_swap_out_vl(nodeid, plan->len, plan->pid,
+						required_free_size))
+		return -1;
+	return 0;
+}
+
+/**
+ * @brief This function releases the processes chosen by swap planner
+ *
+ * @param plan[in] Plan to release
+ */
+void ve_swap_plan_free(struct ve_swap_plan *plan)
+{
+	if (!plan)
+		return;
+	free(plan->pid);
+	memset(plan, '\0', sizeof(struct ve_swap_plan));
+}
@@ -0,0 +1,451 @@
+/**
+ * Copyright (C) 2020 NEC Corporation
+ * This file is part of the VEOS information library.
+ *
+ * The VEOS information library is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either version
+ * 2.1 of the License, or (at your option) any later version.
+ *
+ * The VEOS information library is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with the VEOS information library; if not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+/**
+ * @file veosinfo_top.c
+ * @brief Computes utilization and rates of VE processes and cores from
+ * successive samples of VEOS process table and CPU statistics
+ *
+ * @internal
+ * @author RPM command
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include "veosinfo.h"
+#include "veosinfo_log.h"
+#include "veosinfo_internal.h"
+
+/**
+ * @brief This function initializes the top engine for given VE node
+ *
+ * @param top[out] Top engine to initialize
+ * @param nodeid[in] VE node number
+ * @param threads[in] Report each thread (true) or whole thread groups (false)
+ *
+ * @return 0 on success and -1 on failure
+ */
+int ve_top_init(struct ve_top *top, int nodeid, bool threads)
+{
+	int retval = -1;
+	struct ve_meminfo meminfo = {0};
+
+	VE_RPMLIB_TRACE("Entering");
+	if (!top) {
+		VE_RPMLIB_ERR("Wrong argument received: top = %p", top);
+		errno = EINVAL;
+		goto hndl_return;
+	}
+	memset(top, '\0', sizeof(struct ve_top));
+	top->nodeid = nodeid;
+	top->threads = threads;
+	if (-1 == ve_core_info(nodeid, &top->numcore)) {
+		VE_RPMLIB_ERR("Failed to get CPU cores: %s", strerror(errno));
+		goto hndl_return;
+	}
+	if (0 > ve_mem_info(nodeid, &meminfo)) {
+		VE_RPMLIB_ERR("Failed to get memory information: %s",
+				strerror(errno));
+		goto hndl_return;
+	}
+	top->kb_main_total = meminfo.kb_main_total;
+	retval = 0;
+hndl_return:
+	VE_RPMLIB_TRACE("Exiting");
+	return retval;
+}
+
+/**
+ * @brief Find a task of the previous sample, with PID reuse detection
+ *
+ * @param top[in] Top engine
+ * @param ent[in] Task of the current sample
+ *
+ * @return Task of previous sample on success and NULL if task is new
+ */
+static const struct ve_proc_entry *ve_top_prev(struct ve_top *top,
+					const struct ve_proc_entry *ent)
+{
+	int low = 0;
+	int high = top->prev_len;
+	int mid = 0;
+
+	while (low < high) {
+		mid = low + (high - low) / 2;
+		if (top->prev[mid].pid == ent->pid) {
+			/* Same PID with another start time is a new task */
+			if (top->prev[mid].start_time != ent->start_time)
+				return NULL;
+			return &top->prev[mid];
+		}
+		if (top->prev[mid].pid < ent->pid)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+	return NULL;
+}
+
+/**
+ * @brief Find a process already computed in this sample by PID
+ *
+ * @param top[in] Top engine
+ * @param pid[in] PID to look up
+ *
+ * @return Process on success and NULL if not found
+ */
+static struct ve_top_proc *ve_top_find(struct ve_top *top, pid_t pid)
+{
+	int low = 0;
+	int high = top->nproc;
+	int mid = 0;
+
+	while (low < high) {
+		mid = low + (high - low) / 2;
+		if (top->proc[mid].pid == pid)
+			return &top->proc[mid];
+		if (top->proc[mid].pid < pid)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+	return NULL;
+}
+
+/**
+ * @brief Compute the utilization of cores from the last two CPU statistics
+ *
+ * @param top[in/out] Top engine
+ */
+static void ve_top_cores(struct ve_top *top)
+{
+	int core = 0;
+	double user = 0, idle = 0;
+	double sum_user = 0, sum_idle = 0;
+	const struct ve_statinfo *old = &top->stat[0];
+	const struct ve_statinfo *new = &top->stat[1];
+
+	for (core = 0; core < top->numcore; core++) {
+		user = (double)(new->user[core] - old->user[core]);
+		idle = (double)(new->idle[core] - old->idle[core]);
+		sum_user += user;
+		sum_idle += idle;
+		if (user + idle > 0) {
+			top->core[core].user = user * 100 / (user + idle);
+			top->core[core].idle = idle * 100 / (user + idle);
+		} else {
+			top->core[core].user = 0;
+			top->core[core].idle = 100;
+		}
+	}
+	if (sum_user + sum_idle > 0) {
+		top->total.user = sum_user * 100 / (sum_user + sum_idle);
+		top->total.idle = sum_idle * 100 / (sum_user + sum_idle);
+	}
+	top->ctxt_rate = (double)(new->ctxt - old->ctxt) / top->interval;
+	top->fork_rate = (double)(new->processes - old->processes) /
+							top->interval;
+}
+
+/**
+ * @brief This function takes a sample of VE process table and CPU
+ *	  statistics, and computes utilization and rates since the
+ *	  previous sample.
+ *
+ * The first sample only records the counters, rates are available from
+ * the second sample on. A task whose PID was reused between two samples is
+ * accounted from its start, as it is detected by its start time.
+ *
+ * @param top[in/out] Top engine initialized by ve_top_init()
+ *
+ * @return 0 on success and -1 on failure
+ */
+int ve_top_sample(struct ve_top *top)
+{
+	int retval = -1;
+	int lv = 0;
+	int size = 0;
+	double usec = 0;
+	struct timespec now = {0};
+	struct ve_top_proc *proc = NULL;
+	struct ve_top_proc *leader = NULL;
+	struct ve_proc_entry *tmp = NULL;
+	const struct ve_proc_entry *ent = NULL;
+	const struct ve_proc_entry *old = NULL;
+
+	VE_RPMLIB_TRACE("Entering");
+	if (!top) {
+		VE_RPMLIB_ERR("Wrong argument received: top = %p", top);
+		errno = EINVAL;
+		goto hndl_return;
+	}
+
+	/* Keep the tasks of previous sample to compute the deltas */
+	if (top->prev_size < top->table.len) {
+		tmp = realloc(top->prev,
+			top->table.size * sizeof(struct ve_proc_entry));
+		if (!tmp) {
+			VE_RPMLIB_ERR("Memory allocation failed: %s",
+					strerror(errno));
+			goto hndl_return;
+		}
+		top->prev = tmp;
+		top->prev_size = top->table.size;
+	}
+	if (top->table.len)
+		memcpy(top->prev, top->table.entry,
+			top->table.len * sizeof(struct ve_proc_entry));
+	top->prev_len = top->table.len;
+	top->stat[0] = top->stat[1];
+
+	if (0 > ve_proc_table_update(top->nodeid, &top->table)) {
+		VE_RPMLIB_ERR("Failed to update process table: %s",
+				strerror(errno));
+		goto hndl_return;
+	}
+	if (0 > ve_stat_info(top->nodeid, &top->stat[1])) {
+		VE_RPMLIB_ERR("Failed to get CPU statistics: %s",
+				strerror(errno));
+		goto hndl_return;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	top->interval = (now.tv_sec - top->stamp.tv_sec) +
+			(now.tv_nsec - top->stamp.tv_nsec) / 1e9;
+	top->stamp = now;
+	top->nsample++;
+
+	if (top->proc_size < top->table.len) {
+		size = top->table.size;
+		proc = realloc(top->proc, size * sizeof(struct ve_top_proc));
+		if (!proc) {
+			VE_RPMLIB_ERR("Memory allocation failed: %s",
+					strerror(errno));
+			goto hndl_return;
+		}
+		top->proc = proc;
+		top->proc_size = size;
+	}
+
+	/* Tasks are in PID order, and a thread group leader normally has
+	 * the smallest PID of its group, so it is computed before its
+	 * threads. A thread seen before its leader, because of PID wrap
+	 * around, is reported on its own.
+	 */
+	top->nproc = 0;
+	usec = top->interval * MICROSEC_TO_SEC;
+	for (lv = 0; lv < top->table.len; lv++) {
+		ent = &top->table.entry[lv];
+		old = (top->nsample > 1) ? ve_top_prev(top, ent) : NULL;
+		leader = NULL;
+		if (!top->threads && ent->tgid != ent->pid)
+			leader = ve_top_find(top, ent->tgid);
+		if (leader) {
+			proc = leader;
+		} else {
+			proc = &top->proc[top->nproc++];
+			memset(proc, '\0', sizeof(struct ve_top_proc));
+			proc->pid = ent->pid;
+			proc->tgid = ent->tgid;
+			proc->state = ent->state;
+			proc->processor = ent->processor;
+			memcpy(proc->cmd, ent->cmd, sizeof(proc->cmd));
+		}
+		proc->nthreads++;
+		proc->utime += ent->utime;
+		/* Memory is shared by the threads of a thread group */
+		if (!leader)
+			proc->rss = ent->rss;
+		if (top->nsample < 2)
+			continue;
+		/* A task not in previous sample was started during the
+		 * interval, so all its counters belong to this interval.
+		 */
+		proc->cpu += (double)(ent->utime - (old ? old->utime : 0))
+							* 100 / usec;
+		proc->flt += (double)((ent->min_flt + ent->maj_flt) -
+				(old ? old->min_flt + old->maj_flt : 0)) /
+							top->interval;
+		proc->majflt += (double)(ent->maj_flt -
+				(old ? old->maj_flt : 0)) / top->interval;
+		proc->ctxsw += (double)((ent->nvcsw + ent->nivcsw) -
+				(old ? old->nvcsw + old->nivcsw : 0)) /
+							top->interval;
+	}
+	for (lv = 0; lv < top->nproc; lv++) {
+		if (top->kb_main_total)
+			top->proc[lv].mem = (double)top->proc[lv].rss * 100 /
+							top->kb_main_total;
+	}
+	if (top->nsample > 1)
+		ve_top_cores(top);
+	retval = 0;
+	VE_RPMLIB_DEBUG("Sample %d: %d processes in %f seconds",
+			top->nsample, top->nproc, top->interval);
+hndl_return:
+	VE_RPMLIB_TRACE("Exiting");
+	return retval;
+}
+
+/**
+ * @brief Get the value of given metric of a process
+ *
+ * @param proc[in] Process
+ * @param metric[in] Metric as per "enum ve_top_metric"
+ *
+ * @return Value of metric
+ */
+static double ve_top_value(const struct ve_top_proc *proc, int metric)
+{
+	switch (metric) {
+	case VE_TOP_CPU:
+		return proc->cpu;
+	case VE_TOP_MEM:
+		return proc->mem;
+	case VE_TOP_FLT:
+		return proc->flt;
+	case VE_TOP_MAJFLT:
+		return proc->majflt;
+	case VE_TOP_CTXSW:
+		return proc->ctxsw;
+	case VE_TOP_RSS:
+	default:
+		return (double)proc->rss;
+	}
+}
+
+/**
+ * @brief Restore the min-heap property downwards from given position
+ *
+ * @param heap[in/out] Heap of processes, smallest metric at the root
+ * @param len[in] Number of processes in heap
+ * @param pos[in] Position to sift down from
+ * @param metric[in] Metric as per "enum ve_top_metric"
+ */
+static void ve_top_sift(const struct ve_top_proc **heap, int len, int pos,
+			int metric)
+{
+	int child = 0;
+	const struct ve_top_proc *tmp = NULL;
+
+	while ((child = 2 * pos + 1) < len) {
+		if (child + 1 < len && ve_top_value(heap[child + 1], metric) <
+					ve_top_value(heap[child], metric))
+			child++;
+		if (ve_top_value(heap[pos], metric) <=
+				ve_top_value(heap[child], metric))
+			break;
+		tmp = heap[pos];
+		heap[pos] = heap[child];
+		heap[child] = tmp;
+		pos = child;
+	}
+}
+
+/**
+ * @brief This function selects the processes with the highest value of
+ *	  given metric in the last sample, in descending order.
+ *
+ * Selection keeps a heap of 'max' processes, so it costs
+ * O(processes * log(max)) and the process list is not sorted.
+ *
+ * @param top[in] Top engine
+ * @param metric[in] Metric as per "enum ve_top_metric"
+ * @param procs[out] Array to get the selected processes
+ * @param max[in] Number of entries of 'procs'
+ *
+ * @return Number of selected processes on success and -1 on failure
+ */
+int ve_top_select(struct ve_top *top, int metric, struct ve_top_proc *procs,
+			int max)
+{
+	int retval = -1;
+	int len = 0;
+	int lv = 0;
+	int pos = 0;
+	const struct ve_top_proc **heap = NULL;
+	const struct ve_top_proc *tmp = NULL;
+
+	VE_RPMLIB_TRACE("Entering");
+	if (!top || !procs || 0 >= max || 0 > metric ||
+					VE_TOP_METRIC_CNT <= metric) {
+		VE_RPMLIB_ERR("Wrong argument received: top = %p, procs = %p,"
+				" max = %d, metric = %d", top, procs, max,
+				metric);
+		errno = EINVAL;
+		goto hndl_return;
+	}
+	if (max > top->nproc)
+		max = top->nproc;
+	if (!max) {
+		retval = 0;
+		goto hndl_return;
+	}
+	heap = malloc(max * sizeof(struct ve_top_proc *));
+	if (!heap) {
+		VE_RPMLIB_ERR("Memory allocation failed: %s", strerror(errno));
+		goto hndl_return;
+	}
+	for (lv = 0; lv < top->nproc; lv++) {
+		if (len < max) {
+			heap[len++] = &top->proc[lv];
+			if (len == max) {
+				for (pos = len / 2 - 1; pos >= 0; pos--)
+					ve_top_sift(heap, len, pos, metric);
+			}
+			continue;
+		}
+		if (ve_top_value(&top->proc[lv], metric) <=
+				ve_top_value(heap[0], metric))
+			continue;
+		heap[0] = &top->proc[lv];
+		ve_top_sift(heap, len, 0, metric);
+	}
+	/* Pop the heap from the end to get descending order */
+	for (lv = len - 1; lv > 0; lv--) {
+		tmp = heap[0];
+		heap[0] = heap[lv];
+		heap[lv] = tmp;
+		ve_top_sift(heap, lv, 0, metric);
+	}
+	for (lv = 0; lv < len; lv++)
+		procs[lv] = *heap[lv];
+	free(heap);
+	retval = len;
+hndl_return:
+	VE_RPMLIB_TRACE("Exiting");
+	return retval;
+}
+
+/**
+ * @brief This function releases the memory held by top engine
+ *
+ * @param top[in] Top engine
+ */
+void ve_top_free(struct ve_top *top)
+{
+	if (!top)
+		return;
+	ve_proc_table_free(&top->table);
+	free(top->prev);
+	free(top->proc);
+	memset(top, '\0', sizeof(struct ve_top));
+}